@@ -0,0 +1,327 @@
+#include "batch.h"
+#include "cpu.h"
+#include "interpreter.h"
+#include "json.hpp"
+#include "lockstep.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// ============================================================================
+// Work-stealing pool
+// ============================================================================
+
+// One worker's queue. The owner takes jobs from the back; idle workers
+// steal from the front, so a thief takes the job the owner would run last.
+class JobQueue {
+public:
+    void push(size_t job) {
+        std::lock_guard<std::mutex> guard(lock);
+        items.push_back(job);
+    }
+    bool pop(size_t& job) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (items.empty()) return false;
+        job = items.back();
+        items.pop_back();
+        return true;
+    }
+    bool steal(size_t& job) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (items.empty()) return false;
+        job = items.front();
+        items.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex lock;
+    std::deque<size_t> items;
+};
+
+// Runs run(job) for every job in [0, count) on 'threads' workers. The job
+// set is fixed up front, so a worker that finds every queue empty is done.
+template <typename Fn>
+void runWorkStealing(size_t count, unsigned threads, Fn run) {
+    std::vector<JobQueue> queues(threads);
+    for (size_t job = 0; job < count; job++) queues[job % threads].push(job);
+
+    auto worker = [&](unsigned self) {
+        size_t job;
+        for (;;) {
+            bool found = queues[self].pop(job);
+            for (unsigned k = 1; !found && k < threads; k++) {
+                found = queues[(self + k) % threads].steal(job);
+            }
+            if (!found) return;
+            run(job);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& thread : pool) thread.join();
+}
+
+// ============================================================================
+// One job
+// ============================================================================
+
+const char* statusName(ExitReason reason) {
+    switch (reason) {
+        case ExitReason::EndOfProgram:     return "end";
+        case ExitReason::Halt:             return "halt";
+        case ExitReason::Illegal:          return "illegal";
+        case ExitReason::StackOverflow:    return "stack-overflow";
+        case ExitReason::InstructionLimit: return "instruction-limit";
+    }
+    return "error";
+}
+
+// FNV-1a over the (address, word) pairs of every non-zero word, in address
+// order: equal for equal memory contents, whatever the backend.
+uint64_t hashMemory(const GuestMemory& memory) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (v >> (8 * i)) & 0xFF;
+            hash *= 0x100000001b3ull;
+        }
+    };
+    memory.forEachWord(0, 0xFFFFFFFF, [&](uint32_t addr, uint32_t word) {
+        mix(addr);
+        mix(word);
+    });
+    return hash;
+}
+
+// Loads the job's data into a fresh CPU. Returns false (and marks the
+// result as an error) if the data override cannot be read.
+bool prepareJob(const BatchJob& job, CPU& cpu, const StackConfig& stack, BatchResult& result) {
+    loadMCData(job.program, cpu.memory);
+    if (!job.data.empty() && !loadMCData(job.data, cpu.memory)) {
+        result.status = "error";
+        result.error = "cannot open data file " + job.data;
+        return false;
+    }
+    cpu.regFile[2] = stack.base;
+    return true;
+}
+
+void collectResult(const CPU& cpu, ExitReason reason, BatchResult& result) {
+    result.status = statusName(reason);
+    result.instructions = cpu.clock;
+    result.pc = cpu.PC;
+    result.regs = cpu.regFile;
+    result.memoryHash = hashMemory(cpu.memory);
+}
+
+uint64_t budgetOf(const BatchJob& job) {
+    return job.maxInstructions ? job.maxInstructions : UINT64_MAX;
+}
+
+BatchResult runJob(const BatchJob& job, const Program& loaded, const StackConfig& stack) {
+    BatchResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    // Private state: the text may be modified by the job, memory is per job.
+    Program program = loaded;
+    std::unique_ptr<CPU> cpu(new CPU());
+    if (!prepareJob(job, *cpu, stack, result)) return result;
+    ExitReason reason = runThreaded(program, *cpu, stack, nullptr, budgetOf(job));
+    collectResult(*cpu, reason, result);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Runs the jobs 'group' (all of one program) as lanes of one lockstep
+// group. Every job reports the host time of the whole group.
+void runLockstepGroup(const std::vector<BatchJob>& jobs, const std::vector<size_t>& group,
+                      const Program& program, const StackConfig& stack,
+                      std::vector<BatchResult>& results, LockstepStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<CPU>> cpus;
+    std::vector<LockstepLane> lanes;
+    std::vector<size_t> owners;
+    for (size_t i : group) {
+        std::unique_ptr<CPU> cpu(new CPU());
+        if (!prepareJob(jobs[i], *cpu, stack, results[i])) continue;
+        LockstepLane lane;
+        lane.cpu = cpu.get();
+        lane.maxInstructions = budgetOf(jobs[i]);
+        lanes.push_back(lane);
+        owners.push_back(i);
+        cpus.push_back(std::move(cpu));
+    }
+    runLockstep(program, lanes, stack, &stats);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (size_t k = 0; k < lanes.size(); k++) {
+        collectResult(*lanes[k].cpu, lanes[k].reason, results[owners[k]]);
+        results[owners[k]].seconds = seconds;
+    }
+}
+
+std::string hex(uint64_t value, int width) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setfill('0') << std::setw(width) << value;
+    return out.str();
+}
+
+} // namespace
+
+// ============================================================================
+// Manifest, batch run and report
+// ============================================================================
+
+bool loadBatchManifest(const std::string& path, std::vector<BatchJob>& jobs) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[BATCH] Cannot open manifest " << path << "\n";
+        return false;
+    }
+    nlohmann::json manifest;
+    try {
+        manifest = nlohmann::json::parse(in);
+    } catch (const nlohmann::json::exception& e) {
+        std::cerr << "[BATCH] " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    const nlohmann::json& list = manifest.is_object() && manifest.contains("jobs") ? manifest["jobs"] : manifest;
+    if (!list.is_array()) {
+        std::cerr << "[BATCH] " << path << ": expected an array of jobs\n";
+        return false;
+    }
+
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    auto resolve = [&dir](const std::string& file) {
+        std::filesystem::path p(file);
+        return p.is_absolute() || dir.empty() ? file : (dir / p).string();
+    };
+    for (size_t i = 0; i < list.size(); i++) {
+        const nlohmann::json& entry = list[i];
+        if (!entry.is_object() || !entry.contains("program") || !entry["program"].is_string()) {
+            std::cerr << "[BATCH] " << path << ": job " << i << " has no \"program\"\n";
+            return false;
+        }
+        BatchJob job;
+        job.program = resolve(entry["program"].get<std::string>());
+        if (entry.contains("data") && entry["data"].is_string()) {
+            job.data = resolve(entry["data"].get<std::string>());
+        }
+        if (entry.contains("max_instructions") && entry["max_instructions"].is_number_unsigned()) {
+            job.maxInstructions = entry["max_instructions"].get<uint64_t>();
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+std::vector<BatchResult> runBatch(const std::vector<BatchJob>& jobs, unsigned threads,
+                                  const StackConfig& stack, LockstepStats* lockstep) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Parse every distinct program once; jobs copy it before running.
+    std::map<std::string, Program> programs;
+    std::map<std::string, bool> readable;
+    for (const BatchJob& job : jobs) {
+        if (readable.count(job.program)) continue;
+        readable[job.program] = static_cast<bool>(std::ifstream(job.program));
+        if (readable[job.program]) programs[job.program] = loadMCFile(job.program);
+    }
+
+    std::vector<BatchResult> results(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!readable.at(jobs[i].program)) {
+            results[i].status = "error";
+            results[i].error = "cannot open program " + jobs[i].program;
+        }
+    }
+
+    if (!lockstep) {
+        runWorkStealing(jobs.size(), threads, [&](size_t i) {
+            if (results[i].status.empty()) results[i] = runJob(jobs[i], programs.at(jobs[i].program), stack);
+        });
+        return results;
+    }
+
+    // Lockstep: jobs of the same program in groups of LOCKSTEP_LANES, and
+    // the groups on the pool.
+    std::map<std::string, std::vector<size_t>> byProgram;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (results[i].status.empty()) byProgram[jobs[i].program].push_back(i);
+    }
+    std::vector<std::vector<size_t>> groups;
+    for (const auto& entry : byProgram) {
+        for (size_t first = 0; first < entry.second.size(); first += LOCKSTEP_LANES) {
+            size_t last = std::min(entry.second.size(), first + LOCKSTEP_LANES);
+            groups.emplace_back(entry.second.begin() + first, entry.second.begin() + last);
+        }
+    }
+    std::mutex statsLock;
+    *lockstep = LockstepStats();
+    runWorkStealing(groups.size(), threads, [&](size_t g) {
+        LockstepStats stats;
+        runLockstepGroup(jobs, groups[g], programs.at(jobs[groups[g][0]].program), stack, results, stats);
+        std::lock_guard<std::mutex> guard(statsLock);
+        lockstep->issues += stats.issues;
+        lockstep->laneInstructions += stats.laneInstructions;
+        lockstep->divergentIssues += stats.divergentIssues;
+        lockstep->evicted += stats.evicted;
+    });
+    return results;
+}
+
+bool writeBatchReport(const std::string& path, const std::vector<BatchJob>& jobs,
+                      const std::vector<BatchResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "[BATCH] Cannot write report " << path << "\n";
+        return false;
+    }
+
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    if (csv) {
+        out << "job,program,data,status,instructions,pc,memory_hash,seconds";
+        for (int r = 0; r < 32; r++) out << ",x" << r;
+        out << ",error\n";
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const BatchResult& res = results[i];
+            out << i << "," << jobs[i].program << "," << jobs[i].data << "," << res.status << ","
+                << res.instructions << "," << hex(res.pc, 8) << "," << hex(res.memoryHash, 16) << ","
+                << res.seconds;
+            for (int32_t value : res.regs) out << "," << value;
+            out << "," << res.error << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    nlohmann::json report = nlohmann::json::array();
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchResult& res = results[i];
+        nlohmann::json entry;
+        entry["job"] = i;
+        entry["program"] = jobs[i].program;
+        entry["data"] = jobs[i].data;
+        entry["status"] = res.status;
+        if (!res.error.empty()) entry["error"] = res.error;
+        entry["instructions"] = res.instructions;
+        entry["pc"] = hex(res.pc, 8);
+        entry["registers"] = res.regs;
+        entry["memory_hash"] = hex(res.memoryHash, 16);
+        entry["seconds"] = res.seconds;
+        report.push_back(entry);
+    }
+    out << report.dump(2) << "\n";
+    return static_cast<bool>(out);
+}
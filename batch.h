@@ -0,0 +1,59 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "lockstep.h"
+#include "simulator.h"
+
+// Batch mode of the functional simulator.
+//
+// A manifest lists jobs: a program (.mc file, text and data lines), an
+// optional data override (a .mc or data.mc-style file whose words are
+// written over the program's data) and an optional instruction budget.
+// runBatch() runs the jobs on a work-stealing thread pool. Every job gets
+// its own copy of the Program and its own CPU (registers and GuestMemory);
+// nothing is shared between jobs except the read-only parsed programs, and
+// nothing is printed or written while they run.
+
+struct BatchJob {
+    std::string program;            // .mc file
+    std::string data;               // optional data override ("" = none)
+    uint64_t maxInstructions = 0;   // 0 = no limit
+};
+
+struct BatchResult {
+    std::string status;             // end, halt, illegal, stack-overflow, instruction-limit, error
+    std::string error;              // why the job could not run (status "error")
+    uint64_t instructions = 0;      // retired instructions (= cycles)
+    uint32_t pc = 0;                // PC at the stop
+    std::array<int32_t, 32> regs{}; // final register file
+    uint64_t memoryHash = 0;        // FNV-1a over every non-zero (address, word)
+    double seconds = 0;             // host time of the run
+};
+
+// Reads a JSON manifest: either an array of jobs or {"jobs": [...]}, each
+// job {"program": "...", "data": "...", "max_instructions": n} with only
+// "program" required. Relative paths are taken relative to the manifest.
+// Prints the problem and returns false on a malformed manifest.
+bool loadBatchManifest(const std::string& path, std::vector<BatchJob>& jobs);
+
+// Runs every job with the threaded engine on 'threads' workers (0 = one
+// per hardware thread). results[i] belongs to jobs[i].
+//
+// With 'lockstep' set, jobs that share a program instead run as lanes of
+// the lockstep engine (lockstep.h), LOCKSTEP_LANES to a group, and the
+// groups go to the workers; the engine counters are summed into *lockstep.
+// The results are the same either way.
+std::vector<BatchResult> runBatch(const std::vector<BatchJob>& jobs, unsigned threads,
+                                  const StackConfig& stack = StackConfig(),
+                                  LockstepStats* lockstep = nullptr);
+
+// Writes one report for the whole batch: CSV if 'path' ends in ".csv",
+// JSON otherwise. Returns false if the file cannot be written.
+bool writeBatchReport(const std::string& path, const std::vector<BatchJob>& jobs,
+                      const std::vector<BatchResult>& results);
+
+#endif
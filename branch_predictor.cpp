@@ -0,0 +1,537 @@
+#include "branch_predictor.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// 2-bit saturating counters: 0, 1 predict not taken, 2, 3 taken.
+constexpr uint8_t WEAKLY_NOT_TAKEN = 1;
+constexpr uint8_t WEAKLY_TAKEN = 2;
+
+inline void train(uint8_t &counter, bool taken) {
+    if (taken) {
+        if (counter < 3) counter++;
+    } else {
+        if (counter > 0) counter--;
+    }
+}
+
+inline uint64_t lowBits(uint64_t value, unsigned bits) {
+    return bits >= 64 ? value : value & ((uint64_t(1) << bits) - 1);
+}
+
+// The original predictor: one bit per entry, the branch's last outcome.
+class OneBitPredictor : public BranchPredictor {
+public:
+    explicit OneBitPredictor(unsigned tableBits)
+        : bits(tableBits), table(size_t(1) << tableBits, 0) {}
+
+    BranchPrediction predict(uint32_t pc) const override {
+        BranchPrediction p;
+        p.taken = table[index(pc)] != 0;
+        p.history = history;
+        return p;
+    }
+
+    void update(uint32_t pc, bool taken, const BranchPrediction &) override {
+        table[index(pc)] = taken ? 1 : 0;
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    void reset() override {
+        std::fill(table.begin(), table.end(), 0);
+        history = 0;
+    }
+
+    void seed(uint32_t pc, bool taken) override { table[index(pc)] = taken ? 1 : 0; }
+
+    std::string describe() const override {
+        return "1bit, " + std::to_string(table.size()) + " entries";
+    }
+
+private:
+    size_t index(uint32_t pc) const { return lowBits(pcIndex(pc), bits); }
+
+    unsigned bits;
+    std::vector<uint8_t> table;
+};
+
+// Bimodal: a 2-bit counter per entry.
+class BimodalPredictor : public BranchPredictor {
+public:
+    explicit BimodalPredictor(unsigned tableBits)
+        : bits(tableBits), counters(size_t(1) << tableBits, WEAKLY_NOT_TAKEN) {}
+
+    BranchPrediction predict(uint32_t pc) const override {
+        BranchPrediction p;
+        p.taken = counters[index(pc)] >= WEAKLY_TAKEN;
+        p.history = history;
+        return p;
+    }
+
+    void update(uint32_t pc, bool taken, const BranchPrediction &) override {
+        train(counters[index(pc)], taken);
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    void reset() override {
+        std::fill(counters.begin(), counters.end(), WEAKLY_NOT_TAKEN);
+        history = 0;
+    }
+
+    void seed(uint32_t pc, bool taken) override {
+        counters[index(pc)] = taken ? WEAKLY_TAKEN : WEAKLY_NOT_TAKEN;
+    }
+
+    std::string describe() const override {
+        return "bimodal, " + std::to_string(counters.size()) + " entries";
+    }
+
+private:
+    size_t index(uint32_t pc) const { return lowBits(pcIndex(pc), bits); }
+
+    unsigned bits;
+    std::vector<uint8_t> counters;
+};
+
+// gshare: 2-bit counters indexed by PC xor global history.
+class GsharePredictor : public BranchPredictor {
+public:
+    GsharePredictor(unsigned tableBits, unsigned historyBits)
+        : bits(tableBits), historyBits(historyBits),
+          counters(size_t(1) << tableBits, WEAKLY_NOT_TAKEN) {}
+
+    BranchPrediction predict(uint32_t pc) const override {
+        BranchPrediction p;
+        p.history = history;
+        p.taken = counters[index(pc, history)] >= WEAKLY_TAKEN;
+        return p;
+    }
+
+    void update(uint32_t pc, bool taken, const BranchPrediction &prediction) override {
+        train(counters[index(pc, prediction.history)], taken);
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    void reset() override {
+        std::fill(counters.begin(), counters.end(), WEAKLY_NOT_TAKEN);
+        history = 0;
+    }
+
+    void seed(uint32_t pc, bool taken) override {
+        counters[index(pc, 0)] = taken ? WEAKLY_TAKEN : WEAKLY_NOT_TAKEN;
+    }
+
+    std::string describe() const override {
+        return "gshare, " + std::to_string(counters.size()) + " entries, " +
+               std::to_string(historyBits) + "-bit history";
+    }
+
+    // For the tournament chooser, which keeps the global history itself.
+    bool predictWith(uint32_t pc, uint64_t h) const { return counters[index(pc, h)] >= WEAKLY_TAKEN; }
+    void trainWith(uint32_t pc, uint64_t h, bool taken) { train(counters[index(pc, h)], taken); }
+
+private:
+    size_t index(uint32_t pc, uint64_t h) const {
+        return lowBits(pcIndex(pc) ^ lowBits(h, historyBits), bits);
+    }
+
+    unsigned bits;
+    unsigned historyBits;
+    std::vector<uint8_t> counters;
+};
+
+// Tournament (Alpha 21264 style): a bimodal and a gshare predictor, and a
+// 2-bit chooser per PC entry that counts towards whichever was right when
+// they disagreed (0, 1 pick bimodal, 2, 3 gshare).
+class TournamentPredictor : public BranchPredictor {
+public:
+    TournamentPredictor(unsigned tableBits, unsigned historyBits)
+        : bits(tableBits), historyBits(historyBits), bimodal(tableBits), gshare(tableBits, historyBits),
+          choosers(size_t(1) << tableBits, WEAKLY_NOT_TAKEN) {}
+
+    BranchPrediction predict(uint32_t pc) const override {
+        BranchPrediction p;
+        p.history = history;
+        p.taken = choosers[index(pc)] >= WEAKLY_TAKEN ? gshare.predictWith(pc, history)
+                                                      : bimodal.predict(pc).taken;
+        return p;
+    }
+
+    void update(uint32_t pc, bool taken, const BranchPrediction &prediction) override {
+        bool local = bimodal.predict(pc).taken;
+        bool global = gshare.predictWith(pc, prediction.history);
+        if (local != global) {
+            train(choosers[index(pc)], global == taken);
+        }
+        bimodal.update(pc, taken, prediction);
+        gshare.trainWith(pc, prediction.history, taken);
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    void reset() override {
+        bimodal.reset();
+        gshare.reset();
+        std::fill(choosers.begin(), choosers.end(), WEAKLY_NOT_TAKEN);
+        history = 0;
+    }
+
+    void seed(uint32_t pc, bool taken) override {
+        bimodal.seed(pc, taken);
+        gshare.seed(pc, taken);
+    }
+
+    std::string describe() const override {
+        return "tournament, " + std::to_string(choosers.size()) + " entries per table, " +
+               std::to_string(historyBits) + "-bit history";
+    }
+
+private:
+    size_t index(uint32_t pc) const { return lowBits(pcIndex(pc), bits); }
+
+    unsigned bits;
+    unsigned historyBits;
+    BimodalPredictor bimodal;
+    GsharePredictor gshare;
+    std::vector<uint8_t> choosers;
+};
+
+// A compact TAGE (Seznec): a bimodal base predictor and four tagged tables
+// indexed with geometrically longer global histories. The longest matching
+// table provides the prediction. A misprediction allocates an entry in a
+// longer table whose 'useful' counter is 0; failing that, it ages them.
+class TagePredictor : public BranchPredictor {
+public:
+    static const int TABLES = 4;
+    static constexpr unsigned HISTORY[TABLES] = {5, 11, 22, 44};
+    static const unsigned TAG_BITS = 9;
+    static const uint64_t AGE_PERIOD = uint64_t(1) << 18;   // updates between useful-bit ageing
+
+    explicit TagePredictor(unsigned tableBits)
+        : baseBits(tableBits), taggedBits(tableBits - 2),
+          base(size_t(1) << tableBits, WEAKLY_NOT_TAKEN) {
+        for (auto &table : tagged) table.assign(size_t(1) << taggedBits, Entry());
+    }
+
+    BranchPrediction predict(uint32_t pc) const override {
+        BranchPrediction p;
+        p.history = history;
+        p.taken = lookup(pc, history).taken;
+        return p;
+    }
+
+    void update(uint32_t pc, bool taken, const BranchPrediction &prediction) override {
+        uint64_t h = prediction.history;
+        Lookup l = lookup(pc, h);
+
+        if (l.provider >= 0) {
+            Entry &e = tagged[l.provider][l.index[l.provider]];
+            if (l.taken != l.alternate) {
+                if (l.taken == taken) {
+                    if (e.useful < 3) e.useful++;
+                } else if (e.useful > 0) {
+                    e.useful--;
+                }
+            }
+            if (taken) {
+                if (e.counter < 3) e.counter++;
+            } else if (e.counter > -4) {
+                e.counter--;
+            }
+        } else {
+            train(base[baseIndex(pc)], taken);
+        }
+
+        if (l.taken != taken && l.provider < TABLES - 1) {
+            bool allocated = false;
+            for (int t = l.provider + 1; t < TABLES; t++) {
+                Entry &e = tagged[t][l.index[t]];
+                if (e.useful == 0) {
+                    e.tag = l.tag[t];
+                    e.counter = taken ? 0 : -1;
+                    allocated = true;
+                    break;
+                }
+            }
+            if (!allocated) {
+                for (int t = l.provider + 1; t < TABLES; t++) {
+                    Entry &e = tagged[t][l.index[t]];
+                    if (e.useful > 0) e.useful--;
+                }
+            }
+        }
+
+        if (++updates % AGE_PERIOD == 0) {
+            for (auto &table : tagged) {
+                for (Entry &e : table) e.useful >>= 1;
+            }
+        }
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    void reset() override {
+        std::fill(base.begin(), base.end(), WEAKLY_NOT_TAKEN);
+        for (auto &table : tagged) std::fill(table.begin(), table.end(), Entry());
+        updates = 0;
+        history = 0;
+    }
+
+    void seed(uint32_t pc, bool taken) override {
+        base[baseIndex(pc)] = taken ? WEAKLY_TAKEN : WEAKLY_NOT_TAKEN;
+    }
+
+    std::string describe() const override {
+        return "tage, " + std::to_string(base.size()) + "-entry base + 4x" +
+               std::to_string(size_t(1) << taggedBits) + " tagged, 5/11/22/44-bit history";
+    }
+
+private:
+    struct Entry {
+        uint16_t tag = 0;
+        int8_t counter = 0;     // 3-bit signed, >= 0 predicts taken
+        uint8_t useful = 0;     // 2-bit
+        bool valid() const { return tag != 0; }
+    };
+
+    struct Lookup {
+        bool taken = false;
+        bool alternate = false;  // the prediction had the provider missed
+        int provider = -1;       // tagged table that predicted, -1 for the base
+        size_t index[TABLES];
+        uint16_t tag[TABLES];
+    };
+
+    // XORs the 'length' newest history bits together in 'bits'-wide chunks.
+    static uint64_t fold(uint64_t h, unsigned length, unsigned bits) {
+        h = lowBits(h, length);
+        uint64_t folded = 0;
+        while (h != 0) {
+            folded ^= lowBits(h, bits);
+            h >>= bits;
+        }
+        return folded;
+    }
+
+    size_t baseIndex(uint32_t pc) const { return lowBits(pcIndex(pc), baseBits); }
+
+    Lookup lookup(uint32_t pc, uint64_t h) const {
+        Lookup l;
+        uint32_t p = pcIndex(pc);
+        for (int t = 0; t < TABLES; t++) {
+            l.index[t] = lowBits(p ^ (p >> taggedBits) ^ fold(h, HISTORY[t], taggedBits), taggedBits);
+            // Tag 0 marks a free entry.
+            uint16_t tag = static_cast<uint16_t>(lowBits(p ^ fold(h, HISTORY[t], TAG_BITS) ^
+                                                         (fold(h, HISTORY[t], TAG_BITS - 1) << 1), TAG_BITS));
+            l.tag[t] = tag == 0 ? 1 : tag;
+        }
+        bool basePrediction = base[baseIndex(pc)] >= WEAKLY_TAKEN;
+        l.taken = l.alternate = basePrediction;
+        for (int t = TABLES - 1; t >= 0; t--) {
+            const Entry &e = tagged[t][l.index[t]];
+            if (e.valid() && e.tag == l.tag[t]) {
+                if (l.provider < 0) {
+                    l.provider = t;
+                    l.taken = e.counter >= 0;
+                } else {
+                    l.alternate = e.counter >= 0;
+                    break;
+                }
+            }
+        }
+        return l;
+    }
+
+    unsigned baseBits;
+    unsigned taggedBits;
+    std::vector<uint8_t> base;
+    std::vector<Entry> tagged[TABLES];
+    uint64_t updates = 0;
+};
+
+constexpr unsigned TagePredictor::HISTORY[TagePredictor::TABLES];
+
+} // namespace
+
+bool BranchPredictor::parseConfig(const std::string &text, BranchPredictorConfig &config) {
+    std::stringstream ss(text);
+    std::string field;
+    std::vector<std::string> fields;
+    while (std::getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.empty() || fields.size() > 3) {
+        std::cerr << "ERROR: --predictor expects kind[:tableBits[:historyBits]], not \"" << text << "\"\n";
+        return false;
+    }
+    BranchPredictorConfig parsed;
+    parsed.kind = fields[0];
+    if (parsed.kind != "1bit" && parsed.kind != "bimodal" && parsed.kind != "gshare" &&
+        parsed.kind != "tournament" && parsed.kind != "tage") {
+        std::cerr << "ERROR: unknown branch predictor \"" << parsed.kind
+                  << "\" (1bit, bimodal, gshare, tournament, tage)\n";
+        return false;
+    }
+    unsigned *sizes[2] = {&parsed.tableBits, &parsed.historyBits};
+    for (size_t i = 1; i < fields.size(); i++) {
+        try {
+            size_t used = 0;
+            unsigned long value = std::stoul(fields[i], &used);
+            if (used != fields[i].size()) throw std::invalid_argument(fields[i]);
+            *sizes[i - 1] = static_cast<unsigned>(value);
+        } catch (...) {
+            std::cerr << "ERROR: --predictor: \"" << fields[i] << "\" is not a number\n";
+            return false;
+        }
+    }
+    // TAGE's tagged tables have a quarter of the base entries.
+    unsigned minBits = parsed.kind == "tage" ? 4 : 1;
+    if (parsed.tableBits < minBits || parsed.tableBits > 24) {
+        std::cerr << "ERROR: --predictor: table bits must be " << minBits << "..24\n";
+        return false;
+    }
+    if (parsed.historyBits < 1 || parsed.historyBits > 32) {
+        std::cerr << "ERROR: --predictor: history bits must be 1..32\n";
+        return false;
+    }
+    config = parsed;
+    return true;
+}
+
+std::unique_ptr<BranchPredictor> BranchPredictor::create(const BranchPredictorConfig &config) {
+    if (config.kind == "bimodal") return std::make_unique<BimodalPredictor>(config.tableBits);
+    if (config.kind == "gshare") return std::make_unique<GsharePredictor>(config.tableBits, config.historyBits);
+    if (config.kind == "tournament") return std::make_unique<TournamentPredictor>(config.tableBits, config.historyBits);
+    if (config.kind == "tage") return std::make_unique<TagePredictor>(config.tableBits);
+    return std::make_unique<OneBitPredictor>(config.tableBits);
+}
+
+namespace {
+
+bool isPowerOfTwo(unsigned long n) { return n != 0 && (n & (n - 1)) == 0; }
+
+} // namespace
+
+bool BranchTargetConfig::parseBtb(const std::string &text, BranchTargetConfig &config) {
+    std::stringstream ss(text);
+    std::string field;
+    std::vector<unsigned long> values;
+    while (std::getline(ss, field, ':')) {
+        try {
+            size_t used = 0;
+            values.push_back(std::stoul(field, &used));
+            if (used != field.size()) throw std::invalid_argument(field);
+        } catch (...) {
+            std::cerr << "ERROR: --btb: \"" << field << "\" is not a number\n";
+            return false;
+        }
+    }
+    if (values.empty() || values.size() > 2) {
+        std::cerr << "ERROR: --btb expects entries[:ways], not \"" << text << "\"\n";
+        return false;
+    }
+    unsigned long entries = values[0];
+    if (entries == 0) {
+        config.btbEntries = 0;
+        return true;
+    }
+    // Without a way count a small BTB is fully associative.
+    unsigned long ways = values.size() == 2 ? values[1] : std::min<unsigned long>(config.btbWays, entries);
+    if (!isPowerOfTwo(entries) || entries > (1u << 20) || !isPowerOfTwo(ways) || ways > entries) {
+        std::cerr << "ERROR: --btb: entries and ways must be powers of two, ways <= entries\n";
+        return false;
+    }
+    config.btbEntries = static_cast<unsigned>(entries);
+    config.btbWays = static_cast<unsigned>(ways);
+    return true;
+}
+
+BranchTargetBuffer::BranchTargetBuffer(unsigned entries, unsigned ways)
+    : ways(entries == 0 ? 0 : ways), sets(entries == 0 ? 0 : entries / ways), table(entries) {}
+
+bool BranchTargetBuffer::lookup(uint32_t pc, uint32_t &target) {
+    if (sets == 0) return false;
+    Entry *s = set(pc);
+    for (unsigned w = 0; w < ways; w++) {
+        if (s[w].valid && s[w].pc == pc) {
+            s[w].lastUsed = ++useClock;
+            target = s[w].target;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BranchTargetBuffer::update(uint32_t pc, uint32_t target) {
+    if (sets == 0) return;
+    Entry *s = set(pc);
+    // The entry of this PC, else the least recently used (free entries
+    // have never been used).
+    Entry *victim = &s[0];
+    for (unsigned w = 0; w < ways; w++) {
+        if (s[w].valid && s[w].pc == pc) {
+            victim = &s[w];
+            break;
+        }
+        if (s[w].lastUsed < victim->lastUsed) victim = &s[w];
+    }
+    victim->valid = true;
+    victim->pc = pc;
+    victim->target = target;
+    victim->lastUsed = ++useClock;
+}
+
+void BranchTargetBuffer::reset() {
+    std::fill(table.begin(), table.end(), Entry());
+    useClock = 0;
+}
+
+size_t BranchTargetBuffer::size() const {
+    size_t n = 0;
+    for (const Entry &e : table) {
+        if (e.valid) n++;
+    }
+    return n;
+}
+
+std::string BranchTargetBuffer::describe() const {
+    if (sets == 0) return "off";
+    return std::to_string(table.size()) + " entries, " + std::to_string(ways) + "-way";
+}
+
+void ReturnAddressStack::push(uint32_t returnAddress) {
+    if (stack.empty()) return;
+    stack[top] = returnAddress;
+    top = (top + 1) % stack.size();
+    if (count < stack.size()) count++;
+}
+
+bool ReturnAddressStack::pop(uint32_t &target) {
+    if (count == 0) return false;
+    top = static_cast<unsigned>((top + stack.size() - 1) % stack.size());
+    count--;
+    target = stack[top];
+    return true;
+}
+
+void ReturnAddressStack::reset() {
+    std::fill(stack.begin(), stack.end(), 0);
+    top = 0;
+    count = 0;
+}
+
+ReturnAddressStack::Snapshot ReturnAddressStack::snapshot() const {
+    Snapshot s;
+    s.top = top;
+    s.count = count;
+    s.slot = stack.empty() ? 0 : stack[top];
+    return s;
+}
+
+void ReturnAddressStack::restore(const Snapshot &s) {
+    if (stack.empty()) return;
+    top = s.top;
+    count = s.count;
+    stack[top] = s.slot;
+}
@@ -0,0 +1,154 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Conditional branch direction predictors for the pipelined simulator,
+// and the branch target buffer and return address stack that predict
+// where jal/jalr go.
+//
+// A predictor is asked at fetch (predict) and trained when the branch
+// resolves in EX (update), in program order. predict() changes nothing:
+// what it used, the global history included, travels down the pipeline
+// with the branch and comes back to update(), so a prediction that is
+// flushed before it resolves leaves no trace, and the tables are trained
+// at the same entries that predicted. The global history holds resolved
+// outcomes only.
+//
+// Every table is a fixed-size array of 2^tableBits entries indexed by PC
+// bits (and history), like the hardware, so distant branches can alias:
+//
+//   1bit        last outcome per entry (the original predictor)
+//   bimodal     2-bit saturating counters
+//   gshare      2-bit counters indexed by PC xor 'historyBits' of history
+//   tournament  bimodal and gshare, with 2-bit choosers per PC entry
+//   tage        bimodal base plus four tagged tables of 2^(tableBits-2)
+//               entries, indexed with 5, 11, 22 and 44 bits of history
+
+// What one prediction used; handed back to update() with the outcome.
+struct BranchPrediction {
+    bool taken = false;
+    uint64_t history = 0;       // global history at the prediction
+};
+
+struct BranchPredictorConfig {
+    std::string kind = "1bit";  // 1bit, bimodal, gshare, tournament, tage
+    unsigned tableBits = 12;    // log2 of the entries per table
+    unsigned historyBits = 12;  // global history used by gshare/tournament
+};
+
+class BranchPredictor {
+public:
+    virtual ~BranchPredictor() = default;
+
+    // The prediction for the conditional branch at 'pc'.
+    virtual BranchPrediction predict(uint32_t pc) const = 0;
+
+    // Trains with the outcome of the branch at 'pc' that 'prediction' was
+    // made for, and shifts it into the global history.
+    virtual void update(uint32_t pc, bool taken, const BranchPrediction &prediction) = 0;
+
+    // Forgets everything: tables back to not taken, empty history.
+    virtual void reset() = 0;
+
+    // Sets the entries 'pc' maps to under an empty history to predict
+    // 'taken' (restoring a checkpoint, which keeps one bit per branch).
+    virtual void seed(uint32_t pc, bool taken) = 0;
+
+    // "gshare, 4096 entries, 12-bit history"
+    virtual std::string describe() const = 0;
+
+    // Parses "kind[:tableBits[:historyBits]]", e.g. "gshare:14:12". Prints
+    // the problem and returns false on an unknown kind or size.
+    static bool parseConfig(const std::string &text, BranchPredictorConfig &config);
+    static std::unique_ptr<BranchPredictor> create(const BranchPredictorConfig &config);
+
+protected:
+    static uint32_t pcIndex(uint32_t pc) { return pc >> 2; }
+
+    uint64_t history = 0;       // resolved outcomes, newest in bit 0
+};
+
+struct BranchTargetConfig {
+    unsigned btbEntries = 64;   // 0: no BTB, every jump goes on to PC + 4
+    unsigned btbWays = 4;
+    unsigned rasEntries = 8;    // 0: no return address stack
+
+    // Parses "entries[:ways]" (powers of two, ways <= entries, or "0").
+    // Prints the problem and returns false on a bad size.
+    static bool parseBtb(const std::string &text, BranchTargetConfig &config);
+};
+
+// Set-associative branch target buffer: jump PC -> last target, 'ways'
+// entries per set, least recently used replaced. Sets are indexed by the
+// low PC bits and the whole PC is kept as the tag.
+class BranchTargetBuffer {
+public:
+    BranchTargetBuffer(unsigned entries, unsigned ways);
+
+    // Sets 'target' and returns true on a hit, which also makes the entry
+    // the most recently used of its set.
+    bool lookup(uint32_t pc, uint32_t &target);
+    void update(uint32_t pc, uint32_t target);
+    void reset();
+
+    // Calls visit(pc, target) for every valid entry, in table order.
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        for (const Entry &e : table) {
+            if (e.valid) visit(e.pc, e.target);
+        }
+    }
+    // "64 entries, 4-way" or "off"
+    std::string describe() const;
+    size_t size() const;        // valid entries
+
+private:
+    struct Entry {
+        bool valid = false;
+        uint32_t pc = 0;
+        uint32_t target = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    Entry *set(uint32_t pc) { return &table[((pc >> 2) % sets) * ways]; }
+
+    unsigned ways;
+    unsigned sets;
+    std::vector<Entry> table;
+    uint64_t useClock = 0;
+};
+
+// Circular return address stack: calls push the return address, returns
+// pop it; a push onto a full stack drops the oldest entry. Fetch pushes
+// and pops speculatively, so the state before each is kept and put back
+// when the instruction is flushed.
+class ReturnAddressStack {
+public:
+    struct Snapshot {
+        unsigned top = 0;
+        unsigned count = 0;
+        uint32_t slot = 0;      // what a push would overwrite
+    };
+
+    explicit ReturnAddressStack(unsigned entries) : stack(entries, 0) {}
+
+    void push(uint32_t returnAddress);
+    // Returns false when the stack is empty.
+    bool pop(uint32_t &target);
+    void reset();
+
+    Snapshot snapshot() const;
+    void restore(const Snapshot &s);
+    unsigned capacity() const { return static_cast<unsigned>(stack.size()); }
+
+private:
+    std::vector<uint32_t> stack;
+    unsigned top = 0;           // next free slot
+    unsigned count = 0;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "checkpoint.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+constexpr char MAGIC[8] = {'R', 'V', 'C', 'K', 'P', 'T', '0', '1'};
+constexpr uint32_t VERSION = 1;
+
+constexpr uint32_t FLAG_COMPRESSED = 1u << 0;   // some pages use the word map
+constexpr uint32_t FLAG_PREDICTOR  = 1u << 1;   // predictor section present
+
+constexpr uint8_t PAGE_RAW = 0;
+constexpr uint8_t PAGE_WORDMAP = 1;
+
+constexpr uint32_t PAGE_WORDS = GuestMemory::PAGE_SIZE / 4;
+
+// Little-endian output into a byte buffer, written to the file in one go.
+class Writer {
+public:
+    std::vector<uint8_t> bytes;
+
+    void u8(uint8_t v) { bytes.push_back(v); }
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; i++) bytes.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void u64(uint64_t v) {
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+    void raw(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), p, p + len);
+    }
+};
+
+// Bounds-checked little-endian input; any read past the end sets 'failed'.
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data) : data(data) {}
+    bool failed = false;
+
+    const uint8_t* take(size_t len) {
+        if (failed || data.size() - pos < len) {
+            failed = true;
+            return nullptr;
+        }
+        const uint8_t* p = data.data() + pos;
+        pos += len;
+        return p;
+    }
+    uint8_t u8() {
+        const uint8_t* p = take(1);
+        return p ? p[0] : 0;
+    }
+    uint32_t u32() {
+        const uint8_t* p = take(4);
+        return p ? static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24) : 0;
+    }
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | (static_cast<uint64_t>(u32()) << 32);
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t pos = 0;
+};
+
+uint32_t loadWord(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+bool saveCheckpoint(const std::string& path, const Checkpoint& state,
+                    const GuestMemory& memory, bool compress) {
+    // Text as runs of consecutive words.
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> runs;
+    for (const auto& entry : state.text) {
+        if (runs.empty() || entry.first != runs.back().first + 4 * runs.back().second.size()) {
+            runs.emplace_back(entry.first, std::vector<uint32_t>());
+        }
+        runs.back().second.push_back(entry.second);
+    }
+
+    Writer body;
+    uint32_t pages = 0;
+    bool anyCompressed = false;
+    memory.forEachPage([&](uint32_t base, const uint8_t* bytes) {
+        pages++;
+        body.u32(base >> GuestMemory::PAGE_BITS);
+        uint32_t map[PAGE_WORDS / 32] = {};
+        uint32_t nonZero = 0;
+        if (compress) {
+            for (uint32_t w = 0; w < PAGE_WORDS; w++) {
+                if (loadWord(bytes + 4 * w) != 0) {
+                    map[w / 32] |= 1u << (w % 32);
+                    nonZero++;
+                }
+            }
+        }
+        if (compress && sizeof(map) + 4 * nonZero < GuestMemory::PAGE_SIZE) {
+            anyCompressed = true;
+            body.u8(PAGE_WORDMAP);
+            for (uint32_t bits : map) body.u32(bits);
+            for (uint32_t w = 0; w < PAGE_WORDS; w++) {
+                if (map[w / 32] & (1u << (w % 32))) body.raw(bytes + 4 * w, 4);
+            }
+        } else {
+            body.u8(PAGE_RAW);
+            body.raw(bytes, GuestMemory::PAGE_SIZE);
+        }
+    });
+
+    Writer out;
+    out.raw(MAGIC, sizeof(MAGIC));
+    out.u32(VERSION);
+    out.u32((anyCompressed ? FLAG_COMPRESSED : 0) | (state.predictor.empty() ? 0 : FLAG_PREDICTOR));
+    out.u64(state.instructions);
+    out.u32(state.pc);
+    for (int32_t r : state.regs) out.u32(static_cast<uint32_t>(r));
+    out.u32(static_cast<uint32_t>(runs.size()));
+    out.u32(pages);
+    out.u32(static_cast<uint32_t>(state.predictor.size()));
+    for (const auto& run : runs) {
+        out.u32(run.first);
+        out.u32(static_cast<uint32_t>(run.second.size()));
+        for (uint32_t word : run.second) out.u32(word);
+    }
+    out.raw(body.bytes.data(), body.bytes.size());
+    for (const auto& entry : state.predictor) {
+        out.u32(entry.first);
+        out.u8(entry.second);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "[CHECKPOINT] Cannot write " << path << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(out.bytes.data()), static_cast<std::streamsize>(out.bytes.size()));
+    if (!file) {
+        std::cerr << "[CHECKPOINT] Write error on " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool loadCheckpoint(const std::string& path, Checkpoint& state, GuestMemory& memory) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "[CHECKPOINT] Cannot open " << path << "\n";
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Reader in(data);
+
+    const uint8_t* magic = in.take(sizeof(MAGIC));
+    if (!magic || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "[CHECKPOINT] " << path << " is not a checkpoint\n";
+        return false;
+    }
+    uint32_t version = in.u32();
+    if (version != VERSION) {
+        std::cerr << "[CHECKPOINT] " << path << ": unsupported version " << version << "\n";
+        return false;
+    }
+    in.u32();   // flags: the sections describe themselves
+    state = Checkpoint();
+    state.instructions = in.u64();
+    state.pc = in.u32();
+    for (int32_t& r : state.regs) r = static_cast<int32_t>(in.u32());
+    state.regs[0] = 0;
+    uint32_t runs = in.u32();
+    uint32_t pages = in.u32();
+    uint32_t predictorEntries = in.u32();
+
+    for (uint32_t r = 0; r < runs && !in.failed; r++) {
+        uint32_t start = in.u32();
+        uint32_t count = in.u32();
+        for (uint32_t i = 0; i < count && !in.failed; i++) state.text[start + 4 * i] = in.u32();
+    }
+
+    memory.clear();
+    uint8_t page[GuestMemory::PAGE_SIZE];
+    for (uint32_t p = 0; p < pages && !in.failed; p++) {
+        uint32_t base = in.u32() << GuestMemory::PAGE_BITS;
+        uint8_t encoding = in.u8();
+        if (encoding == PAGE_RAW) {
+            const uint8_t* bytes = in.take(GuestMemory::PAGE_SIZE);
+            if (bytes) memory.load(base, bytes, GuestMemory::PAGE_SIZE);
+        } else if (encoding == PAGE_WORDMAP) {
+            uint32_t map[PAGE_WORDS / 32];
+            for (uint32_t& bits : map) bits = in.u32();
+            std::memset(page, 0, sizeof(page));
+            for (uint32_t w = 0; w < PAGE_WORDS && !in.failed; w++) {
+                if (!(map[w / 32] & (1u << (w % 32)))) continue;
+                const uint8_t* word = in.take(4);
+                if (word) std::memcpy(page + 4 * w, word, 4);
+            }
+            if (!in.failed) memory.load(base, page, sizeof(page));
+        } else {
+            std::cerr << "[CHECKPOINT] " << path << ": unknown page encoding " << int(encoding) << "\n";
+            return false;
+        }
+    }
+
+    for (uint32_t e = 0; e < predictorEntries && !in.failed; e++) {
+        uint32_t pc = in.u32();
+        state.predictor.emplace_back(pc, in.u8());
+    }
+    if (in.failed) {
+        std::cerr << "[CHECKPOINT] " << path << " is truncated\n";
+        return false;
+    }
+    return true;
+}
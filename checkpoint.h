@@ -0,0 +1,50 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "guest_memory.h"
+
+// Architectural checkpoints, shared by the functional and the pipeline
+// simulator.
+//
+// A checkpoint is a little-endian binary file:
+//
+//   header     "RVCKPT01", format version, flags, retired instruction
+//              count, PC, x0..x31, and the number of text runs, memory
+//              pages and predictor entries that follow
+//   text       runs of consecutive instruction words: start, count, words
+//   pages      every allocated guest page: page number, encoding, payload.
+//              Encoding 0 is the raw 4 KiB; encoding 1 (compressed) is a
+//              1024-bit map of the non-zero words followed by those words,
+//              used when it is smaller than the raw page
+//   predictor  optional (branch PC, state) pairs of a branch predictor
+//
+// Only pages that were written are stored, and loading allocates exactly
+// those pages, so save and load time follow the touched memory rather than
+// the 4 GiB address space.
+
+struct Checkpoint {
+    uint64_t instructions = 0;                  // retired before the checkpoint
+    uint32_t pc = 0;
+    std::array<int32_t, 32> regs{};
+    std::map<uint32_t, uint32_t> text;          // address -> instruction word
+    std::vector<std::pair<uint32_t, uint8_t>> predictor;   // (branch PC, state)
+};
+
+// Writes 'state' and every allocated page of 'memory' to 'path'. With
+// 'compress' sparse pages use the word-map encoding. Prints the problem and
+// returns false if the file cannot be written.
+bool saveCheckpoint(const std::string& path, const Checkpoint& state,
+                    const GuestMemory& memory, bool compress = true);
+
+// Reads a checkpoint into 'state' and replaces the contents of 'memory'
+// with its pages. Prints the problem and returns false on a missing,
+// truncated or foreign file.
+bool loadCheckpoint(const std::string& path, Checkpoint& state, GuestMemory& memory);
+
+#endif
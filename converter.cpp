@@ -1,4 +1,5 @@
 #include "converter.h"
+#include "isa.h"
 #include "symbol_table.h"
 #include <map>
 #include <bitset>
@@ -9,30 +10,6 @@ using namespace std;
 #include "symbol_table.h"
 #include "converter.h"
 
-// Lookup table for func3 and func7 for all 31 required instructions
-map<string, pair<string, string>> instructionMap = {
-    // R-format instructions (func3, func7)
-    {"add", {"000", "0000000"}}, {"sub", {"000", "0100000"}}, {"xor", {"100", "0000000"}},
-    {"or", {"110", "0000000"}}, {"and", {"111", "0000000"}}, {"sll", {"001", "0000000"}},
-    {"slt", {"010", "0000000"}}, {"sra", {"101", "0100000"}}, {"srl", {"101", "0000000"}},
-    {"mul", {"000", "0000001"}}, {"div", {"100", "0000001"}}, {"rem", {"110", "0000001"}},
-
-    // I-format instructions (func3, no func7 needed)
-    {"addi", {"000", ""}}, {"andi", {"111", ""}}, {"ori", {"110", ""}},
-    {"lb", {"000", ""}}, {"lh", {"001", ""}}, {"lw", {"010", ""}}, {"ld", {"011", ""}}, {"jalr", {"000", ""}},
-
-    // S-format instructions (func3, no func7 needed)
-    {"sb", {"000", ""}}, {"sh", {"001", ""}}, {"sw", {"010", ""}}, {"sd", {"011", ""}},
-
-    // SB-format instructions (func3, no func7 needed)
-    {"beq", {"000", ""}}, {"bne", {"001", ""}}, {"blt", {"100", ""}}, {"bge", {"101", ""}},
-
-    // U-format instructions (No func3, no func7)
-    {"lui", {"", ""}}, {"auipc", {"", ""}},
-
-    // UJ-format instructions (No func3, no func7)
-    {"jal", {"", ""}}};
-
 // Helper function to convert register name to binary (e.g., "x1" -> "00001")
 string registerToBinary(const string &reg) {
     int regNum = stoi(reg.substr(1)); 
@@ -50,15 +27,15 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
     string opcode, func3, func7, rd, rs1, rs2, immediate;
     uint32_t machineCode = 0;
 
-    // Lookup func3 and func7 from the map
-    auto it = instructionMap.find(instruction.opcode);
-    if (it != instructionMap.end()) {
-        func3 = it->second.first;
-        func7 = it->second.second;
-    } else {
+    // Opcode, func3 and func7 come from the ISA table (isa.h)
+    const IsaEntry* entry = isaFind(instruction.opcode);
+    if (!entry) {
         cerr << "Error: Unknown instruction '" << instruction.assembly << "'" << endl;
         return 0;
     }
+    opcode = bitset<7>(entry->opcode).to_string();
+    if (entry->funct3 >= 0) func3 = bitset<3>(entry->funct3).to_string();
+    if (entry->funct7 >= 0) func7 = bitset<7>(entry->funct7).to_string();
 
     // Extract other fields based on the instruction format
     if (instruction.format == "R") {
@@ -71,9 +48,7 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         instruction.rs2=rs2;
         instruction.func3=func3;
         instruction.func7=func7;
-        instruction.opcode="0110011";
-
-        opcode = "0110011";
+        instruction.opcode=opcode;
     } 
     else if (instruction.format == "I") {
         // I-format: addi, lw, jalr, etc.
@@ -81,12 +56,9 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         rs1 = registerToBinary(instruction.rs1);
         // immediateToBinary now returns exactly 12 bits.
         immediate = immediateToBinary(stoi(instruction.immediate), 12);
-        if (instruction.opcode == "jalr")
-            opcode = "1100111";
-        else if (instruction.opcode == "lw" || instruction.opcode == "lh" || instruction.opcode == "lb" || instruction.opcode == "ld")
-            opcode = "0000011";
-        else
-            opcode = "0010011";
+        // Shifts by an immediate keep func7 in imm[11:5]
+        if (!func7.empty())
+            immediate = func7 + immediate.substr(7);
         instruction.rd = rd;
         instruction.rs1 = rs1;
         instruction.func3 = func3;
@@ -100,7 +72,6 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         rs1 = registerToBinary(instruction.rs1);
         rs2 = registerToBinary(instruction.rs2);
         immediate = immediateToBinary(stoi(instruction.immediate), 12);
-        opcode = "0100011";        
         instruction.rs1=rs1;
         instruction.rs2=rs2;
         instruction.func3=func3;
@@ -115,7 +86,6 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         // Convert immediate (string) to int32_t offset
         immediate = std::bitset<13>(stoi(instruction.immediate)).to_string();
         cout<<immediate<<endl;
-        opcode="1100011";
         instruction.rs1=rs1;
         instruction.rs2=rs2;
         instruction.func3=func3;
@@ -130,7 +100,6 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         // U-format: lui, auipc
         rd = registerToBinary(instruction.rd);
         immediate = immediateToBinary(stoi(instruction.immediate), 20);
-        opcode = instruction.opcode == "lui" ? "0110111" : "0010111"; 
         instruction.rd=rd;        
         instruction.immediate=immediate;
         instruction.opcode=opcode;
@@ -144,11 +113,14 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         // The JAL immediate field encodes (offset / 2) into 20 bits.
         immediate = immediateToBinary(offset / 2, 20);
     
-        opcode = "1101111";
         instruction.rd = rd;
         instruction.immediate = immediate;
         instruction.opcode = opcode;
     }
+    else if (instruction.format == "SYS") {
+        // No operands: halt
+        instruction.opcode = opcode;
+    }
     
 
     // Combine fields into 32-bit machine code
@@ -175,6 +147,9 @@ uint32_t convertToMachineCode( Instruction &instruction, const SymbolTable &symb
         machineCode = stoul(immediate[0] + immediate.substr(10, 10) + immediate[9] +
                             immediate.substr(1, 8) + rd + opcode, nullptr, 2);
     }
+    else if (instruction.format == "SYS") {
+        machineCode = stoul(opcode, nullptr, 2);
+    }
 
     return machineCode;
 }
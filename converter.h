@@ -7,8 +7,6 @@
 #include "parser.h"
 using namespace std;
 
-// Declare instructionMap without defining it
-extern map<string, pair<string, string>> instructionMap;
 uint32_t convertToMachineCode( Instruction& instruction, const SymbolTable& symbolTable);
 string registerToBinary(const string& reg);
 string immediateToBinary(int imm, int bits);
@@ -0,0 +1,376 @@
+#include "cycle_json.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Upper bound of one record without the predictor table; the table is
+// reserved entry by entry.
+const size_t MAX_FIXED_RECORD = 4096;
+const size_t MAX_PREDICTOR_ENTRY = 32;
+
+const struct {
+    const char *name;
+    unsigned field;
+} FIELD_NAMES[] = {
+    {"cycle", JSON_CYCLE},
+    {"pc", JSON_PC},
+    {"pipeline", JSON_PIPELINE},
+    {"forwarding", JSON_FORWARDING},
+    {"hazards", JSON_HAZARDS},
+    {"predictor", JSON_PREDICTOR},
+    {"latches", JSON_LATCHES},
+    {"regs", JSON_REGS},
+    {"stats", JSON_STATS},
+};
+
+/*
+ * ===== Formatting. =====
+ *
+ * Each helper writes at 'p' and returns the position after its text; the
+ * caller has reserved the room. The cursor is a local, so stores through
+ * it do not force the compiler to reload the writer's members.
+ */
+
+template <size_t N>
+char *putLiteral(char *p, const char (&text)[N]) {
+    std::memcpy(p, text, N - 1);
+    return p + N - 1;
+}
+
+char *putString(char *p, const char *text) {
+    size_t length = std::strlen(text);
+    std::memcpy(p, text, length);
+    return p + length;
+}
+
+char *putUnsigned(char *p, uint64_t value) {
+    return std::to_chars(p, p + 20, value).ptr;
+}
+
+char *putSigned(char *p, int32_t value) {
+    return std::to_chars(p, p + 11, value).ptr;
+}
+
+char *putBit(char *p, bool value) {
+    *p = value ? '1' : '0';
+    return p + 1;
+}
+
+// 0x and at least 'minDigits' lowercase hex digits.
+char *putHexDigits(char *p, uint32_t value, int minDigits = 1) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    int digits = 1;
+    while (digits < 8 && (value >> (4 * digits)) != 0) digits++;
+    digits = std::max(digits, minDigits);
+    *p++ = '0';
+    *p++ = 'x';
+    for (int i = digits - 1; i >= 0; i--) {
+        *p++ = HEX_DIGITS[(value >> (4 * i)) & 0xF];
+    }
+    return p;
+}
+
+// The same as a JSON string.
+char *putHex(char *p, uint32_t value, int minDigits = 1) {
+    *p++ = '"';
+    p = putHexDigits(p, value, minDigits);
+    *p++ = '"';
+    return p;
+}
+
+// "name": preceded by ',' unless it is the record's first field.
+template <size_t N>
+char *putKey(char *p, bool &first, const char (&name)[N]) {
+    if (!first) *p++ = ',';
+    first = false;
+    *p++ = '"';
+    p = putLiteral(p, name);
+    return putLiteral(p, "\":");
+}
+
+// "IF":"0x18: 0x00a00513", or "---" for an empty stage.
+template <size_t N>
+char *putStage(char *p, const char (&name)[N], uint32_t pc, uint32_t ir, bool valid) {
+    *p++ = '"';
+    p = putLiteral(p, name);
+    p = putLiteral(p, "\":");
+    if (!valid) {
+        return putLiteral(p, "\"---\"");
+    }
+    *p++ = '"';
+    p = putHexDigits(p, pc);
+    p = putLiteral(p, ": ");
+    p = putHexDigits(p, ir, 8);
+    *p++ = '"';
+    return p;
+}
+
+// "ID_EX":{"valid":1,"pc":"0x..","ir":"0x..","rd":5,"reg_write":1,"mem_read":0,"ra":..}
+char *putLatch(char *p, const char *name, uint32_t pc, uint32_t ir, bool valid,
+               const PipelineSim::DecodedInstr *d, const char *const *valueNames,
+               const int32_t *values, int count) {
+    *p++ = '"';
+    p = putString(p, name);
+    p = putLiteral(p, "\":{\"valid\":");
+    p = putBit(p, valid);
+    p = putLiteral(p, ",\"pc\":");
+    p = putHex(p, pc);
+    p = putLiteral(p, ",\"ir\":");
+    p = putHex(p, ir, 8);
+    if (d) {
+        p = putLiteral(p, ",\"rd\":");
+        p = putUnsigned(p, d->rd);
+        p = putLiteral(p, ",\"reg_write\":");
+        p = putBit(p, d->regWrite);
+        p = putLiteral(p, ",\"mem_read\":");
+        p = putBit(p, d->memRead);
+    }
+    for (int i = 0; i < count; i++) {
+        p = putLiteral(p, ",\"");
+        p = putString(p, valueNames[i]);
+        p = putLiteral(p, "\":");
+        p = putSigned(p, values[i]);
+    }
+    *p++ = '}';
+    return p;
+}
+
+} // namespace
+
+CycleJsonWriter::CycleJsonWriter(std::ostream &out, unsigned fields, size_t bufferSize)
+    : out(out), fields(fields), buffer(std::max(bufferSize, 2 * MAX_FIXED_RECORD)) {}
+
+CycleJsonWriter::~CycleJsonWriter() {
+    flush();
+}
+
+bool CycleJsonWriter::parseFields(const std::string &list, unsigned &fields) {
+    if (list == "all") {
+        fields = JSON_ALL_FIELDS;
+        return true;
+    }
+    unsigned selected = 0;
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        bool known = false;
+        for (const auto &f : FIELD_NAMES) {
+            if (name == f.name) {
+                selected |= f.field;
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            std::cerr << "ERROR: unknown --json-fields entry \"" << name << "\" (expected";
+            for (const auto &f : FIELD_NAMES) std::cerr << " " << f.name;
+            std::cerr << ", or all)\n";
+            return false;
+        }
+    }
+    if (selected == 0) {
+        std::cerr << "ERROR: --json-fields selects no field\n";
+        return false;
+    }
+    fields = selected;
+    return true;
+}
+
+void CycleJsonWriter::start(const PipelineSim &sim) {
+    PipelineStats stats = sim.stats();
+    previousMemWb = sim.memWb();
+    previousDataStalls = stats.dataHazardStalls;
+    previousControlStalls = stats.controlHazardStalls;
+}
+
+char *CycleJsonWriter::reserve(char *cursor, size_t n) {
+    if (cursor + n <= buffer.data() + buffer.size()) {
+        return cursor;
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(cursor - buffer.data()));
+    return buffer.data();
+}
+
+bool CycleJsonWriter::flush() {
+    if (used > 0) {
+        out.write(buffer.data(), static_cast<std::streamsize>(used));
+        used = 0;
+    }
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+// ===== One record =====
+
+void CycleJsonWriter::write(const PipelineSim &sim) {
+    const PipelineSim::IF_ID &ifId = sim.ifId();
+    const PipelineSim::ID_EX &idEx = sim.idEx();
+    const PipelineSim::EX_MEM &exMem = sim.exMem();
+    const PipelineSim::MEM_WB &memWb = sim.memWb();
+    // The counters are only needed by two fields.
+    PipelineStats stats;
+    if (fields & (JSON_HAZARDS | JSON_STATS)) stats = sim.stats();
+
+    char *p = reserve(buffer.data() + used, MAX_FIXED_RECORD);
+    bool first = true;
+    *p++ = '{';
+    if (fields & JSON_CYCLE) {
+        p = putKey(p, first, "cycle");
+        p = putUnsigned(p, sim.cycles());
+    }
+    if (fields & JSON_PC) {
+        p = putKey(p, first, "pc");
+        p = putHex(p, sim.pc());
+    }
+    if (fields & JSON_PIPELINE) {
+        p = putKey(p, first, "pipeline");
+        *p++ = '{';
+        p = putStage(p, "IF", ifId.PC, ifId.IR, ifId.valid);
+        *p++ = ',';
+        p = putStage(p, "ID", idEx.PC, idEx.IR, idEx.valid);
+        *p++ = ',';
+        p = putStage(p, "EX", exMem.PC, exMem.IR, exMem.valid);
+        *p++ = ',';
+        p = putStage(p, "MEM", memWb.PC, memWb.IR, memWb.valid);
+        *p++ = ',';
+        // written back this cycle: what MEM/WB held after the previous one
+        p = putStage(p, "WB", previousMemWb.PC, previousMemWb.IR, previousMemWb.valid);
+        *p++ = '}';
+    }
+    if (fields & JSON_FORWARDING) {
+        p = putKey(p, first, "forwarding");
+        *p++ = '[';
+        bool any = false;
+        if (idEx.forwardRAFromEX_MEM || idEx.forwardRBFromEX_MEM || idEx.forwardRMFromEX_MEM) {
+            p = putLiteral(p, "{\"from\":\"MEM\",\"to\":\"EX\"}");
+            any = true;
+        }
+        if (idEx.forwardRAFromMEM_WB || idEx.forwardRBFromMEM_WB || idEx.forwardRMFromMEM_WB) {
+            if (any) *p++ = ',';
+            p = putLiteral(p, "{\"from\":\"WB\",\"to\":\"EX\"}");
+            any = true;
+        }
+        if (exMem.forwardRMFromMEM_WB) {
+            if (any) *p++ = ',';
+            p = putLiteral(p, "{\"from\":\"WB\",\"to\":\"MEM\"}");
+        }
+        *p++ = ']';
+    }
+    if (fields & JSON_HAZARDS) {
+        // A hazard shows as the stall it caused in ID this cycle.
+        bool raw = stats.dataHazardStalls > previousDataStalls;
+        bool control = stats.controlHazardStalls > previousControlStalls;
+        p = putKey(p, first, "hazards");
+        *p++ = '[';
+        if (raw) p = putLiteral(p, "{\"type\":\"RAW\",\"stage\":\"ID\"}");
+        if (control) {
+            if (raw) *p++ = ',';
+            p = putLiteral(p, "{\"type\":\"control\",\"stage\":\"ID\"}");
+        }
+        *p++ = ']';
+    }
+    if (fields & JSON_LATCHES) {
+        static const char *const ID_EX_VALUES[] = {"ra", "rb", "rm"};
+        static const char *const EX_MEM_VALUES[] = {"rz", "rm"};
+        static const char *const MEM_WB_VALUES[] = {"ry"};
+        const int32_t idExValues[] = {idEx.RA, idEx.RB, idEx.RM};
+        const int32_t exMemValues[] = {exMem.RZ, exMem.RM};
+        const int32_t memWbValues[] = {memWb.RY};
+        p = putKey(p, first, "latches");
+        *p++ = '{';
+        // IF/ID has not been decoded yet: only PC and IR are meaningful.
+        p = putLatch(p, "IF_ID", ifId.PC, ifId.IR, ifId.valid, nullptr, nullptr, nullptr, 0);
+        *p++ = ',';
+        p = putLatch(p, "ID_EX", idEx.PC, idEx.IR, idEx.valid, &idEx.d, ID_EX_VALUES, idExValues, 3);
+        *p++ = ',';
+        p = putLatch(p, "EX_MEM", exMem.PC, exMem.IR, exMem.valid, &exMem.d, EX_MEM_VALUES, exMemValues, 2);
+        *p++ = ',';
+        p = putLatch(p, "MEM_WB", memWb.PC, memWb.IR, memWb.valid, &memWb.d, MEM_WB_VALUES, memWbValues, 1);
+        *p++ = '}';
+    }
+    if (fields & JSON_REGS) {
+        const int32_t *regs = sim.registers();
+        p = putKey(p, first, "regs");
+        *p++ = '[';
+        for (int i = 0; i < PipelineSim::NUM_REGS; i++) {
+            if (i > 0) *p++ = ',';
+            p = putSigned(p, regs[i]);
+        }
+        *p++ = ']';
+    }
+    if (fields & JSON_STATS) {
+        const struct {
+            const char *name;
+            uint64_t value;
+        } counters[] = {
+            {"cycles", stats.cycles},
+            {"instructions", stats.instructions},
+            {"data_transfer", stats.dataTransfer},
+            {"alu", stats.alu},
+            {"control", stats.control},
+            {"stalls", stats.stalls},
+            {"data_hazards", stats.dataHazards},
+            {"control_hazards", stats.controlHazards},
+            {"mispredictions", stats.mispredictions},
+            {"data_hazard_stalls", stats.dataHazardStalls},
+            {"control_hazard_stalls", stats.controlHazardStalls},
+            {"branches", stats.branches},
+            {"branch_misses", stats.branchMisses},
+            {"jumps", stats.jumps},
+            {"jump_misses", stats.jumpMisses},
+            {"btb_lookups", stats.btbLookups},
+            {"btb_hits", stats.btbHits},
+            {"ras_predictions", stats.rasPredictions},
+            {"ras_correct", stats.rasCorrect},
+            {"branch_operand_stalls", stats.branchOperandStalls},
+        };
+        p = putKey(p, first, "stats");
+        *p++ = '{';
+        for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+            if (i > 0) *p++ = ',';
+            *p++ = '"';
+            p = putString(p, counters[i].name);
+            p = putLiteral(p, "\":");
+            p = putUnsigned(p, counters[i].value);
+        }
+        *p++ = '}';
+    }
+    if (fields & JSON_PREDICTOR) {
+        // Last: the table is unbounded, so room is reserved per entry.
+        p = putKey(p, first, "predictor");
+        p = putLiteral(p, "{\"PHT\":{");
+        bool firstEntry = true;
+        for (const auto &entry : sim.predictorTable()) {
+            p = reserve(p, MAX_PREDICTOR_ENTRY);
+            if (!firstEntry) *p++ = ',';
+            firstEntry = false;
+            p = putHex(p, entry.first);
+            *p++ = ':';
+            p = putBit(p, entry.second);
+        }
+        p = reserve(p, MAX_PREDICTOR_ENTRY);
+        p = putLiteral(p, "},\"BTB\":{");
+        firstEntry = true;
+        sim.branchTargetBuffer().forEach([&](uint32_t pc, uint32_t target) {
+            p = reserve(p, MAX_PREDICTOR_ENTRY);
+            if (!firstEntry) *p++ = ',';
+            firstEntry = false;
+            p = putHex(p, pc);
+            *p++ = ':';
+            p = putHex(p, target);
+        });
+        p = reserve(p, MAX_PREDICTOR_ENTRY);
+        p = putLiteral(p, "}}");
+    }
+    p = putLiteral(p, "}\n");
+    used = p - buffer.data();
+
+    previousMemWb = memWb;
+    previousDataStalls = stats.dataHazardStalls;
+    previousControlStalls = stats.controlHazardStalls;
+    recordCount++;
+}
@@ -0,0 +1,88 @@
+#ifndef CYCLE_JSON_H
+#define CYCLE_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "pipeline_sim.h"
+
+// Per-cycle NDJSON export of the pipelined simulator (--json).
+//
+// Every cycle becomes one line holding a JSON object, in the shape
+// phase3_gui.py draws:
+//
+//   {"cycle":7,"pc":"0x1c",
+//    "pipeline":{"IF":"0x18: 0x00a00513","ID":"---",...,"WB":"0x8: ..."},
+//    "forwarding":[{"from":"MEM","to":"EX"}],
+//    "hazards":[{"type":"RAW","stage":"ID"}],
+//    "predictor":{"PHT":{"0x10":1},"BTB":{"0x40":"0x10"}}}
+//
+// plus, on request, "latches" (all fields of the four pipeline buffers),
+// "regs" and "stats". The text is formatted by hand straight into one
+// reusable buffer that is written out when it fills, so a cycle costs no
+// allocation and no json.hpp document; a run of millions of cycles is
+// limited by the disk. "predictor" is the most expensive field, since the
+// whole table and BTB are written every cycle.
+
+enum CycleJsonField : unsigned {
+    JSON_CYCLE      = 1u << 0,
+    JSON_PC         = 1u << 1,
+    JSON_PIPELINE   = 1u << 2,   // stage -> "0xPC: 0xIR" text, WB included
+    JSON_FORWARDING = 1u << 3,
+    JSON_HAZARDS    = 1u << 4,
+    JSON_PREDICTOR  = 1u << 5,
+    JSON_LATCHES    = 1u << 6,   // IF/ID, ID/EX, EX/MEM, MEM/WB in full
+    JSON_REGS       = 1u << 7,
+    JSON_STATS      = 1u << 8,
+
+    JSON_DEFAULT_FIELDS = JSON_CYCLE | JSON_PC | JSON_PIPELINE | JSON_FORWARDING |
+                          JSON_HAZARDS | JSON_PREDICTOR,
+    JSON_ALL_FIELDS = (1u << 9) - 1
+};
+
+class CycleJsonWriter {
+public:
+    explicit CycleJsonWriter(std::ostream &out, unsigned fields = JSON_DEFAULT_FIELDS,
+                             size_t bufferSize = 1 << 20);
+    ~CycleJsonWriter();
+    CycleJsonWriter(const CycleJsonWriter&) = delete;
+    CycleJsonWriter& operator=(const CycleJsonWriter&) = delete;
+
+    // Parses a comma-separated list of field names ("cycle,pc,regs"), or
+    // "all". Prints the problem and returns false on an unknown name.
+    static bool parseFields(const std::string &list, unsigned &fields);
+
+    // Takes the state the next record is relative to (the instruction
+    // that leaves MEM/WB and the stall counters). Call before the first
+    // cycle, or after jumping the simulator to another point.
+    void start(const PipelineSim &sim);
+
+    // Appends the record of the cycle 'sim' has just run.
+    void write(const PipelineSim &sim);
+
+    // Writes out the buffer. Returns false if the stream failed.
+    bool flush();
+
+    uint64_t records() const { return recordCount; }
+
+private:
+    // A cursor with room for 'n' more bytes: 'cursor' itself, or the start
+    // of the buffer after writing out everything before 'cursor'.
+    char *reserve(char *cursor, size_t n);
+
+    std::ostream &out;
+    unsigned fields;
+    std::vector<char> buffer;
+    size_t used = 0;
+    uint64_t recordCount = 0;
+
+    // The previous cycle's MEM/WB, written back in this one, and the
+    // stall counters it ended with.
+    PipelineSim::MEM_WB previousMemWb{};
+    uint64_t previousDataStalls = 0;
+    uint64_t previousControlStalls = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+// Test: runs regression programs on every engine and compares the results.
+//
+// Each program runs on the functional simulator's engines (switch, threaded,
+// blocks, JIT) and on the pipelined simulator with forwarding off and on and
+// branches resolved in EX and in ID, plus the pipeline's functional
+// fast-forward. All of them must end with the switch engine's retired
+// instruction count, registers and memory, and with its PC if the program
+// stops on HALT (past a zero word the pipeline's fetch PC has moved on).
+//
+// Build: g++ -std=c++17 -O2 -pthread differential_test.cpp pipeline_sim.cpp branch_predictor.cpp simulator.cpp interpreter.cpp jit_x86.cpp checkpoint.cpp parser.cpp converter.cpp symbol_table.cpp guest_memory.cpp -o differential_test
+// Run:   ./differential_test [program.mc ...]   (default: the programs below)
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "pipeline_sim.h"
+#include "simulator.h"
+
+static const char *const PROGRAMS[] = {
+    "halt_test.mc",     // halt on the taken path and on wrong paths
+    "divide_test.mc",   // div/rem by zero and INT_MIN / -1
+};
+
+struct Outcome {
+    uint32_t pc = 0;
+    bool halted = false;                                // stopped on HALT
+    uint64_t instructions = 0;
+    int32_t regs[32] = {};
+    std::vector<std::pair<uint32_t, uint32_t>> memory;  // non-zero words
+};
+
+static void readMemory(const GuestMemory &memory, Outcome &out) {
+    memory.forEachWord(0, 0xFFFFFFFF, [&](uint32_t addr, uint32_t word) {
+        out.memory.emplace_back(addr, word);
+    });
+}
+
+static Outcome runFunctional(const std::string &path, Engine engine) {
+    Program program = loadMCFile(path);
+    CPU cpu;
+    StackConfig stack;
+    loadMCData(path, cpu.memory);
+    cpu.regFile[2] = stack.base;
+
+    // The engines report how they stopped on std::cout; keep that out of
+    // the test's output.
+    std::ostringstream quiet;
+    std::streambuf *saved = std::cout.rdbuf(quiet.rdbuf());
+    runProgram(program, cpu, stack, engine, 1, false);
+    std::cout.rdbuf(saved);
+
+    Outcome out;
+    const DecodedInstr *last = program.fetch(cpu.PC);
+    out.pc = cpu.PC;
+    out.halted = last && last->op == OP_HALT;
+    out.instructions = cpu.clock;
+    for (int i = 0; i < 32; i++) out.regs[i] = cpu.regFile[i];
+    readMemory(cpu.memory, out);
+    return out;
+}
+
+static Outcome fromPipeline(const PipelineSim &sim, uint64_t instructions) {
+    Outcome out;
+    out.pc = sim.pc();
+    out.instructions = instructions;
+    for (int i = 0; i < 32; i++) out.regs[i] = sim.registers()[i];
+    readMemory(sim.memory(), out);
+    return out;
+}
+
+static Outcome runPipeline(const std::string &path, bool forward, bool resolveInId) {
+    PipelineSim sim;
+    sim.Knob2 = forward;
+    sim.Knob7 = resolveInId;
+    sim.load(path);
+    sim.runToRetire();
+    return fromPipeline(sim, sim.retired());
+}
+
+static Outcome runFastForward(const std::string &path) {
+    PipelineSim sim;
+    sim.load(path);
+    bool ended = false;
+    uint64_t executed = sim.fastForward(UINT64_MAX, ended);
+    return fromPipeline(sim, executed);
+}
+
+static int failures = 0;
+
+static void compare(const std::string &path, const char *name, const Outcome &want, const Outcome &got) {
+    std::string what;
+    if (want.halted && got.pc != want.pc) what = "PC";
+    else if (got.instructions != want.instructions) what = "instruction count";
+    else if (got.memory != want.memory) what = "memory";
+    for (int i = 0; i < 32 && what.empty(); i++) {
+        if (got.regs[i] != want.regs[i]) what = "x" + std::to_string(i);
+    }
+    if (!what.empty()) {
+        std::cout << "FAIL: " << path << ": " << name << " differs in " << what << "\n";
+        failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> paths(argv + 1, argv + argc);
+    if (paths.empty()) paths.assign(std::begin(PROGRAMS), std::end(PROGRAMS));
+
+    for (const std::string &path : paths) {
+        if (loadMCFile(path).code.empty()) {
+            std::cout << "FAIL: cannot load " << path << "\n";
+            failures++;
+            continue;
+        }
+        Outcome want = runFunctional(path, Engine::Switch);
+        compare(path, "threaded engine", want, runFunctional(path, Engine::Threaded));
+        compare(path, "block engine", want, runFunctional(path, Engine::Blocks));
+        compare(path, "JIT engine", want, runFunctional(path, Engine::Jit));
+        compare(path, "pipeline", want, runPipeline(path, false, false));
+        compare(path, "pipeline, resolve in ID", want, runPipeline(path, false, true));
+        compare(path, "pipeline, forwarding", want, runPipeline(path, true, false));
+        compare(path, "pipeline, forwarding, resolve in ID", want, runPipeline(path, true, true));
+        compare(path, "pipeline fast-forward", want, runFastForward(path));
+        std::cout << path << ": " << want.instructions << " instructions, PC = 0x" << std::hex
+                  << want.pc << std::dec << "\n";
+    }
+
+    std::cout << (failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
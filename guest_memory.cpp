@@ -0,0 +1,198 @@
+#include "guest_memory.h"
+#include <cstring>
+
+#if (defined(__unix__) || defined(__APPLE__)) && UINTPTR_MAX > 0xFFFFFFFFu
+#include <sys/mman.h>
+#define GUEST_MEMORY_HAS_MMAP 1
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+#ifdef GUEST_MEMORY_HAS_MMAP
+// 4 GiB guest space plus one page of slack so that a multi-byte access at
+// the very top of the address space stays inside the mapping.
+static constexpr size_t FLAT_SIZE = (size_t(1) << 32) + GuestMemory::PAGE_SIZE;
+
+static uint8_t* reserveFlatSpace(void* hint, int extraFlags) {
+    void* p = mmap(hint, FLAT_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | extraFlags, -1, 0);
+    return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+}
+#endif
+
+const uint8_t GuestMemory::zeroPage[GuestMemory::PAGE_SIZE] = {};
+
+GuestMemory::GuestMemory() {
+    flushTlb();
+}
+
+void GuestMemory::flushTlb() {
+    for (uint32_t i = 0; i < TLB_ENTRIES; i++) {
+        readTlb[i] = {TLB_INVALID, nullptr};
+        writeTlb[i] = {TLB_INVALID, nullptr};
+    }
+}
+
+GuestMemory::~GuestMemory() {
+    releaseFlat();
+}
+
+bool GuestMemory::useFlatBackend() {
+#ifdef GUEST_MEMORY_HAS_MMAP
+    if (flatBase) return true;
+    uint8_t* base = reserveFlatSpace(nullptr, 0);
+    if (!base) return false;
+#ifdef MADV_HUGEPAGE
+    madvise(base, FLAT_SIZE, MADV_HUGEPAGE);
+#endif
+    touchedPages.reset(new uint64_t[NUM_PAGES / 64]());
+
+    // Move any pages written so far into the flat space.
+    forEachPage([&](uint32_t pageBase, const uint8_t* bytes) {
+        std::memcpy(base + pageBase, bytes, PAGE_SIZE);
+        uint32_t page = pageBase >> PAGE_BITS;
+        touchedPages[page >> 6] |= 1ull << (page & 63);
+    });
+    for (auto& table : directory) {
+        table.reset();
+    }
+    flushTlb();
+    flatBase = base;     // pageCount is unchanged: the same pages are touched
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GuestMemory::releaseFlat() {
+#ifdef GUEST_MEMORY_HAS_MMAP
+    if (flatBase) {
+        munmap(flatBase, FLAT_SIZE);
+        flatBase = nullptr;
+        touchedPages.reset();
+    }
+#endif
+}
+
+// Allocate (zero-filled) the page holding addr, creating its directory
+// table first if needed.
+uint8_t* GuestMemory::allocatePage(uint32_t addr) {
+    std::unique_ptr<Table>& table = directory[dirIndex(addr)];
+    if (!table) {
+        table.reset(new Table());
+    }
+    std::unique_ptr<Page>& page = table->pages[pageIndex(addr)];
+    if (!page) {
+        page.reset(new Page());   // value-initialised => all zero
+        pageCount++;
+        // A cached read translation for this page points at the zero page.
+        ReadTlbEntry& e = readTlb[(addr >> PAGE_BITS) & (TLB_ENTRIES - 1)];
+        if (e.vpn == (addr >> PAGE_BITS)) {
+            e.vpn = TLB_INVALID;
+        }
+    }
+    return page->bytes;
+}
+
+void GuestMemory::forEachPage(const std::function<void(uint32_t, const uint8_t*)>& fn) const {
+    if (flatBase) {
+        for (uint32_t w = 0; w < NUM_PAGES / 64; w++) {
+            uint64_t bits = touchedPages[w];
+            for (uint32_t b = 0; bits != 0; b++, bits >>= 1) {
+                if (bits & 1) {
+                    uint32_t base = (w * 64 + b) << PAGE_BITS;
+                    fn(base, flatBase + base);
+                }
+            }
+        }
+        return;
+    }
+    for (uint32_t d = 0; d < DIR_SIZE; d++) {
+        const Table* table = directory[d].get();
+        if (!table) continue;
+        for (uint32_t p = 0; p < DIR_SIZE; p++) {
+            const Page* page = table->pages[p].get();
+            if (!page) continue;
+            uint32_t base = (d << (PAGE_BITS + DIR_BITS)) | (p << PAGE_BITS);
+            fn(base, page->bytes);
+        }
+    }
+}
+
+void GuestMemory::load(uint32_t addr, const void* src, size_t len) {
+    const uint8_t* in = static_cast<const uint8_t*>(src);
+    if (flatBase) {
+        for (size_t i = 0; i < len; i += PAGE_SIZE) {
+            markTouched(addr + static_cast<uint32_t>(i));
+        }
+        if (len > 0) markTouched(addr + static_cast<uint32_t>(len - 1));
+        std::memcpy(flatBase + addr, in, len);
+        return;
+    }
+    while (len > 0) {
+        uint32_t off = addr & PAGE_MASK;
+        size_t chunk = PAGE_SIZE - off;
+        if (chunk > len) chunk = len;
+        std::memcpy(touchPage(addr) + off, in, chunk);
+        addr += static_cast<uint32_t>(chunk);
+        in += chunk;
+        len -= chunk;
+    }
+}
+
+void GuestMemory::dump(uint32_t addr, void* dst, size_t len) const {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    if (flatBase) {
+        std::memcpy(out, flatBase + addr, len);
+        return;
+    }
+    while (len > 0) {
+        uint32_t off = addr & PAGE_MASK;
+        size_t chunk = PAGE_SIZE - off;
+        if (chunk > len) chunk = len;
+        const uint8_t* page = findPage(addr);
+        if (page) {
+            std::memcpy(out, page + off, chunk);
+        } else {
+            std::memset(out, 0, chunk);
+        }
+        addr += static_cast<uint32_t>(chunk);
+        out += chunk;
+        len -= chunk;
+    }
+}
+
+void GuestMemory::forEachWord(uint32_t lo, uint32_t hi,
+                              const std::function<void(uint32_t, uint32_t)>& fn) const {
+    forEachPage([&](uint32_t base, const uint8_t* bytes) {
+        if (base + PAGE_MASK < lo || base > hi) return;
+        for (uint32_t off = 0; off < PAGE_SIZE; off += 4) {
+            uint32_t addr = base + off;
+            if (addr < lo || addr > hi) continue;
+            uint32_t word = load32(bytes + off);
+            if (word != 0) fn(addr, word);
+        }
+    });
+}
+
+void GuestMemory::clear() {
+    for (auto& table : directory) {
+        table.reset();
+    }
+    flushTlb();
+    pageCount = 0;
+#ifdef GUEST_MEMORY_HAS_MMAP
+    if (flatBase) {
+        // Map fresh zero pages over the old reservation.
+        if (!reserveFlatSpace(flatBase, MAP_FIXED)) {
+            releaseFlat();
+            return;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(flatBase, FLAT_SIZE, MADV_HUGEPAGE);
+#endif
+        std::memset(touchedPages.get(), 0, (NUM_PAGES / 64) * sizeof(uint64_t));
+    }
+#endif
+}
@@ -0,0 +1,281 @@
+#ifndef GUEST_MEMORY_H
+#define GUEST_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// GuestMemory: sparse paged model of the 32-bit guest address space.
+//
+// The address space is split into 4 KiB pages that are only allocated the
+// first time they are written. A two-level page directory (1024 x 1024
+// entries) maps a guest page number to its host page. Reads from pages that
+// were never written return 0 without allocating anything.
+//
+// In front of the page directory sits a small direct-mapped software TLB
+// (separate read and write entries) that maps a guest page number straight
+// to its host page, so repeated accesses to the same pages skip the
+// directory walk. Read entries for pages that were never written point at a
+// shared zero page; allocating a page invalidates its read entry.
+//
+// Optionally (useFlatBackend) the whole 4 GiB guest space can instead be
+// reserved up front with mmap(MAP_NORESERVE). A guest address is then just
+// an offset from one host base pointer and the kernel supplies zero pages
+// lazily on first touch. If the reservation is not possible the paged
+// backend stays in use.
+//
+// All multi-byte accessors are little-endian, independent of the host.
+class GuestMemory {
+public:
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;   // 4 KiB
+    static constexpr uint32_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr uint32_t DIR_BITS  = 10;                // entries per directory level
+    static constexpr uint32_t DIR_SIZE  = 1u << DIR_BITS;
+
+    GuestMemory();
+    ~GuestMemory();
+    GuestMemory(const GuestMemory&) = delete;
+    GuestMemory& operator=(const GuestMemory&) = delete;
+
+    // Reserves the whole guest address space with mmap and switches to the
+    // flat backend, copying over any pages written so far. Transparent huge
+    // pages are requested where the host supports them. Returns false (and
+    // keeps the paged backend) if the reservation fails or the host is not a
+    // 64-bit POSIX system.
+    bool useFlatBackend();
+    bool isFlat() const { return flatBase != nullptr; }
+
+    // Flat backend only: host pointer for a guest address (one add).
+    // Returns nullptr when the paged backend is in use.
+    uint8_t* hostPointer(uint32_t addr) const {
+        return flatBase ? flatBase + addr : nullptr;
+    }
+
+    // ---- 8/16/32-bit accessors ----
+    uint8_t read8(uint32_t addr) const {
+        if (flatBase) return flatBase[addr];
+        return readPage(addr)[addr & PAGE_MASK];
+    }
+
+    uint16_t read16(uint32_t addr) const {
+        if (flatBase) return load16(flatBase + addr);
+        uint32_t off = addr & PAGE_MASK;
+        if (off > PAGE_SIZE - 2) {
+            // Access straddles two pages.
+            return static_cast<uint16_t>(read8(addr) | (read8(addr + 1) << 8));
+        }
+        return load16(readPage(addr) + off);
+    }
+
+    uint32_t read32(uint32_t addr) const {
+        if (flatBase) return load32(flatBase + addr);
+        uint32_t off = addr & PAGE_MASK;
+        if (off > PAGE_SIZE - 4) {
+            // Access straddles two pages.
+            return static_cast<uint32_t>(read16(addr)) |
+                   (static_cast<uint32_t>(read16(addr + 2)) << 16);
+        }
+        return load32(readPage(addr) + off);
+    }
+
+    void write8(uint32_t addr, uint8_t value) {
+        if (flatBase) {
+            markTouched(addr);
+            flatBase[addr] = value;
+            return;
+        }
+        writePage(addr)[addr & PAGE_MASK] = value;
+    }
+
+    void write16(uint32_t addr, uint16_t value) {
+        if (flatBase) {
+            markTouched(addr);
+            markTouched(addr + 1);
+            store16(flatBase + addr, value);
+            return;
+        }
+        uint32_t off = addr & PAGE_MASK;
+        if (off > PAGE_SIZE - 2) {
+            write8(addr, value & 0xFF);
+            write8(addr + 1, (value >> 8) & 0xFF);
+            return;
+        }
+        store16(writePage(addr) + off, value);
+    }
+
+    void write32(uint32_t addr, uint32_t value) {
+        if (flatBase) {
+            markTouched(addr);
+            markTouched(addr + 3);
+            store32(flatBase + addr, value);
+            return;
+        }
+        uint32_t off = addr & PAGE_MASK;
+        if (off > PAGE_SIZE - 4) {
+            write16(addr, value & 0xFFFF);
+            write16(addr + 2, (value >> 16) & 0xFFFF);
+            return;
+        }
+        store32(writePage(addr) + off, value);
+    }
+
+    // ---- Bulk transfer ----
+    // Copies len bytes from host memory into the guest starting at addr.
+    void load(uint32_t addr, const void* src, size_t len);
+    // Copies len guest bytes starting at addr into host memory. Bytes on
+    // pages that were never written read as zero.
+    void dump(uint32_t addr, void* dst, size_t len) const;
+    // Calls fn(address, word) for every non-zero, word-aligned 32-bit word in
+    // [lo, hi] (inclusive), in ascending address order. Only allocated pages
+    // are visited, so this is proportional to the touched memory.
+    void forEachWord(uint32_t lo, uint32_t hi,
+                     const std::function<void(uint32_t, uint32_t)>& fn) const;
+
+    // ---- Page bookkeeping ----
+    bool isPageAllocated(uint32_t addr) const {
+        if (flatBase) return isTouched(addr);
+        return findPage(addr) != nullptr;
+    }
+    size_t allocatedPages() const { return pageCount; }
+
+    // Calls fn(pageBaseAddress, pageBytes) for every allocated page in
+    // ascending address order.
+    void forEachPage(const std::function<void(uint32_t, const uint8_t*)>& fn) const;
+
+    // Releases every page; the whole address space reads as zero again.
+    void clear();
+
+    // ---- Software TLB statistics (paged backend only) ----
+    uint64_t tlbHits() const { return tlbHitCount; }
+    uint64_t tlbMisses() const { return tlbMissCount; }
+
+    // ---- Code generator support ----
+    // The JIT (jit_x86.cpp) inlines the TLB hit path. Each table has
+    // TLB_ENTRIES entries of 16 bytes: the guest page number (uint32_t) at
+    // offset 0 and the host page pointer at offset 8. A hit must bump the
+    // counter returned by tlbHitCounter(); misses go through read/write.
+    static constexpr uint32_t TLB_ENTRIES = 64;
+    const void* readTlbTable() const { return readTlb; }
+    const void* writeTlbTable() const { return writeTlb; }
+    uint64_t* tlbHitCounter() const { return &tlbHitCount; }
+
+private:
+    struct Page  { uint8_t bytes[PAGE_SIZE]; };
+    struct Table { std::unique_ptr<Page> pages[DIR_SIZE]; };
+
+    std::unique_ptr<Table> directory[DIR_SIZE];
+    size_t pageCount = 0;
+
+    // Software TLB: direct-mapped on the low bits of the guest page number.
+    static constexpr uint32_t TLB_INVALID = 0xFFFFFFFF;   // never a page number
+    struct ReadTlbEntry  { uint32_t vpn; const uint8_t* page; };
+    struct WriteTlbEntry { uint32_t vpn; uint8_t* page; };
+    static_assert(sizeof(void*) != 8 ||
+                  (sizeof(ReadTlbEntry) == 16 && offsetof(ReadTlbEntry, page) == 8 &&
+                   sizeof(WriteTlbEntry) == 16 && offsetof(WriteTlbEntry, page) == 8),
+                  "TLB entry layout is relied on by jit_x86.cpp");
+
+    mutable ReadTlbEntry readTlb[TLB_ENTRIES];
+    WriteTlbEntry writeTlb[TLB_ENTRIES];
+    mutable uint64_t tlbHitCount = 0;
+    mutable uint64_t tlbMissCount = 0;
+
+    static const uint8_t zeroPage[PAGE_SIZE];
+
+    // Host page to read addr from (the shared zero page if unallocated).
+    const uint8_t* readPage(uint32_t addr) const {
+        uint32_t vpn = addr >> PAGE_BITS;
+        ReadTlbEntry& e = readTlb[vpn & (TLB_ENTRIES - 1)];
+        if (e.vpn == vpn) {
+            tlbHitCount++;
+            return e.page;
+        }
+        tlbMissCount++;
+        const uint8_t* page = findPage(addr);
+        e.vpn = vpn;
+        e.page = page ? page : zeroPage;
+        return e.page;
+    }
+
+    // Host page to write addr to, allocating it on first touch.
+    uint8_t* writePage(uint32_t addr) {
+        uint32_t vpn = addr >> PAGE_BITS;
+        WriteTlbEntry& e = writeTlb[vpn & (TLB_ENTRIES - 1)];
+        if (e.vpn == vpn) {
+            tlbHitCount++;
+            return e.page;
+        }
+        tlbMissCount++;
+        e.vpn = vpn;
+        e.page = touchPage(addr);
+        return e.page;
+    }
+
+    void flushTlb();
+
+    // Flat backend: base of the 4 GiB reservation plus a bitmap of the
+    // guest pages that have been written (used for dumps and iteration).
+    uint8_t* flatBase = nullptr;
+    std::unique_ptr<uint64_t[]> touchedPages;
+
+    static constexpr uint32_t NUM_PAGES = 1u << (32 - PAGE_BITS);
+
+    bool isTouched(uint32_t addr) const {
+        uint32_t page = addr >> PAGE_BITS;
+        return (touchedPages[page >> 6] >> (page & 63)) & 1;
+    }
+    void markTouched(uint32_t addr) {
+        uint32_t page = addr >> PAGE_BITS;
+        uint64_t bit = 1ull << (page & 63);
+        uint64_t& word = touchedPages[page >> 6];
+        if (!(word & bit)) {
+            word |= bit;
+            pageCount++;
+        }
+    }
+    void releaseFlat();
+
+    static uint32_t dirIndex(uint32_t addr)  { return addr >> (PAGE_BITS + DIR_BITS); }
+    static uint32_t pageIndex(uint32_t addr) { return (addr >> PAGE_BITS) & (DIR_SIZE - 1); }
+
+    const uint8_t* findPage(uint32_t addr) const {
+        const Table* table = directory[dirIndex(addr)].get();
+        if (!table) return nullptr;
+        const Page* page = table->pages[pageIndex(addr)].get();
+        return page ? page->bytes : nullptr;
+    }
+
+    uint8_t* touchPage(uint32_t addr) {
+        Table* table = directory[dirIndex(addr)].get();
+        if (table) {
+            Page* page = table->pages[pageIndex(addr)].get();
+            if (page) return page->bytes;
+        }
+        return allocatePage(addr);
+    }
+
+    // Slow path of touchPage: creates the directory entry and/or page.
+    uint8_t* allocatePage(uint32_t addr);
+
+    static uint16_t load16(const uint8_t* p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+    static uint32_t load32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+    static void store16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+    }
+    static void store32(uint8_t* p, uint32_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+        p[2] = (v >> 16) & 0xFF;
+        p[3] = (v >> 24) & 0xFF;
+    }
+};
+
+#endif // GUEST_MEMORY_H
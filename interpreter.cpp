@@ -0,0 +1,487 @@
+#include "interpreter.h"
+#include "jit_x86.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Computed goto ("labels as values") is a GCC/Clang extension. Other
+// compilers get the same handlers wrapped in a switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define RV_COMPUTED_GOTO 1
+#endif
+
+// Handler labels in Op order, for the computed-goto tables.
+#define RV_OP_LABELS                                                              \
+    &&H_OP_ILLEGAL,                                                               \
+    &&H_OP_ADD, &&H_OP_SUB, &&H_OP_SLL, &&H_OP_SLT, &&H_OP_SLTU, &&H_OP_XOR,      \
+    &&H_OP_SRL, &&H_OP_SRA, &&H_OP_OR, &&H_OP_AND,                                \
+    &&H_OP_MUL, &&H_OP_DIV, &&H_OP_REM,                                           \
+    &&H_OP_ADDI, &&H_OP_SLTI, &&H_OP_SLTIU, &&H_OP_XORI, &&H_OP_ORI, &&H_OP_ANDI, \
+    &&H_OP_SLLI, &&H_OP_SRLI, &&H_OP_SRAI,                                        \
+    &&H_OP_LB, &&H_OP_LH, &&H_OP_LW, &&H_OP_LBU, &&H_OP_LHU,                      \
+    &&H_OP_SB, &&H_OP_SH, &&H_OP_SW,                                              \
+    &&H_OP_BEQ, &&H_OP_BNE, &&H_OP_BLT, &&H_OP_BGE, &&H_OP_BLTU, &&H_OP_BGEU,     \
+    &&H_OP_LUI, &&H_OP_AUIPC, &&H_OP_JAL, &&H_OP_JALR,                            \
+    &&H_OP_HALT
+
+// Write a result register; x0 stays hardwired to zero.
+#define WRITE_RD(v) do { R[INS->rd] = (v); R[0] = 0; } while (0)
+// Stop on any access to the stack guard region [guardLo, guardLo + guardSize).
+#define CHECK_STACK(addr) do {                                         \
+        if ((addr) - guardLo < guardSize) STOP(ExitReason::StackOverflow); \
+    } while (0)
+
+// ============================================================================
+// Threaded-code interpreter
+// ============================================================================
+
+ExitReason runThreaded(Program& program, CPU& cpu, const StackConfig& stack, FusionStats* statsOut,
+                       uint64_t maxInstructions) {
+    const DecodedInstr* code = program.code.data();
+    const uint32_t base = program.base;
+    const uint32_t count = static_cast<uint32_t>(program.code.size());
+    int32_t* R = cpu.regFile.data();
+    GuestMemory& mem = cpu.memory;
+
+    const uint32_t guardLo = stack.base - stack.limit - stack.guard;
+    const uint32_t guardSize = stack.guard;
+
+    uint64_t retired = 0;
+    uint64_t hitsLuiAddi = 0, hitsAuipcJalr = 0, hitsAddiBne = 0;
+    ExitReason reason = ExitReason::EndOfProgram;
+    uint32_t pc = cpu.PC;                  // only used for jumps off the program
+    const DecodedInstr* d = program.fetch(pc);
+    if (!d) return ExitReason::EndOfProgram;
+
+#define INS d
+// Address of the current instruction.
+#define CUR_PC (base + static_cast<uint32_t>(d - code) * 4)
+// Continue at the next sequential instruction. The Program always ends in
+// an invalid entry, so running off the end lands in the ILLEGAL handler.
+#define NEXT() do { ++retired; ++d; DISPATCH(); } while (0)
+// Continue at an arbitrary target address. Every loop passes through a
+// taken jump or branch, so this is where the instruction budget is checked.
+#define JUMP(target) do {                                              \
+        ++retired;                                                     \
+        pc = (target);                                                 \
+        uint32_t index_ = (pc - base) >> 2;                            \
+        if ((pc & 0x3) || index_ >= count) goto exit_off_program;      \
+        d = code + index_;                                             \
+        if (retired >= maxInstructions) STOP(ExitReason::InstructionLimit); \
+        DISPATCH();                                                    \
+    } while (0)
+#define JUMP_INDIRECT(target) JUMP(target)
+#define BRANCH(cond) do { if (cond) JUMP(CUR_PC + INS->imm); NEXT(); } while (0)
+// The code array is updated in place, so the next fetch sees the store.
+#define TEXT_STORE(addr, value, size) do {                             \
+        if (program.mayTouchText(addr)) program.storeText(addr, value, size); \
+    } while (0)
+#define STOP(why) do { reason = (why); goto exit_at_d; } while (0)
+
+#ifdef RV_COMPUTED_GOTO
+    static const void* const handlers[FUSED_END] = {
+        RV_OP_LABELS, &&H_FUSED_LUI_ADDI, &&H_FUSED_AUIPC_JALR, &&H_FUSED_ADDI_BNE
+    };
+#define HANDLER(op) H_##op:
+#define DISPATCH() goto *handlers[d->exec]
+    DISPATCH();
+#else
+#define HANDLER(op) case op:
+#define DISPATCH() goto dispatch
+dispatch:
+    switch (d->exec) {
+#endif
+
+#include "interpreter_handlers.inc"
+
+    // ---- Superinstructions ----
+    // Each runs d[0] and d[1] exactly as their own handlers would; the
+    // first instruction retires here and the second through NEXT/BRANCH/JUMP.
+    HANDLER(FUSED_LUI_ADDI) {
+        hitsLuiAddi++;
+        ++retired;
+        R[d->rd] = static_cast<int32_t>(static_cast<uint32_t>(d->imm) + static_cast<uint32_t>(d[1].imm));
+        ++d;
+        NEXT();
+    }
+    HANDLER(FUSED_AUIPC_JALR) {
+        hitsAuipcJalr++;
+        ++retired;
+        uint32_t here = CUR_PC;
+        R[d->rd] = static_cast<int32_t>(here + d->imm);
+        ++d;
+        uint32_t target = (R[d->rs1] + d->imm) & ~1u;
+        WRITE_RD(static_cast<int32_t>(here + 8));
+        JUMP(target);
+    }
+    HANDLER(FUSED_ADDI_BNE) {
+        hitsAddiBne++;
+        ++retired;
+        R[d->rd] = static_cast<int32_t>(static_cast<uint32_t>(R[d->rd]) + static_cast<uint32_t>(d->imm));
+        ++d;
+        BRANCH(R[d->rs1] != R[d->rs2]);
+    }
+
+#ifndef RV_COMPUTED_GOTO
+    default:
+        STOP(ExitReason::Illegal);
+    }
+#endif
+
+#undef HANDLER
+#undef DISPATCH
+#undef INS
+#undef CUR_PC
+#undef NEXT
+#undef JUMP
+#undef JUMP_INDIRECT
+#undef BRANCH
+#undef TEXT_STORE
+#undef STOP
+
+exit_at_d:
+    cpu.PC = base + static_cast<uint32_t>(d - code) * 4;
+    goto done;
+
+exit_off_program:
+    cpu.PC = pc;
+    reason = ExitReason::EndOfProgram;
+
+done:
+    cpu.clock += retired;
+    if (statsOut) {
+        *statsOut = FusionStats();
+        for (const DecodedInstr& entry : program.code) {
+            if (entry.exec >= OP_COUNT) statsOut->sites[entry.exec - OP_COUNT]++;
+        }
+        statsOut->hits[FUSED_LUI_ADDI - OP_COUNT] = hitsLuiAddi;
+        statsOut->hits[FUSED_AUIPC_JALR - OP_COUNT] = hitsAuipcJalr;
+        statsOut->hits[FUSED_ADDI_BNE - OP_COUNT] = hitsAddiBne;
+        statsOut->retired = retired;
+    }
+    return reason;
+}
+
+// ============================================================================
+// Basic-block translation cache
+// ============================================================================
+
+namespace {
+
+// Block-internal operation: end of a block that was cut at MAX_BLOCK_OPS
+// instructions; continues with the block at the next address.
+constexpr uint8_t OP_FALLTHROUGH = OP_COUNT;
+constexpr uint32_t MAX_BLOCK_OPS = 64;
+
+// One translated instruction. The handler address is resolved at
+// translation time (direct threading), so dispatch is a single load+jump.
+struct BlockOp {
+    const void* handler = nullptr;  // unused with the switch fallback
+    uint32_t pc = 0;
+    int32_t  imm = 0;
+    uint8_t  rd = 0;
+    uint8_t  rs1 = 0;
+    uint8_t  rs2 = 0;
+    uint8_t  op = OP_ILLEGAL;
+    bool     valid = false;
+};
+
+// A straight-line run of instructions ending at the first branch, jal, jalr
+// or stop. 'next' holds the chained successors: [0] is the fall-through
+// (not-taken) block, [1] the taken / jump target. For jalr, [1] caches the
+// last target and is only followed when the target matches.
+struct Block {
+    uint32_t pc = 0;                    // start address (cache key)
+    uint32_t first = 0, last = 0;       // program.code indices covered
+    Block* next[2] = {nullptr, nullptr};
+    bool dead = false;
+    bool cut = false;                   // ends in OP_FALLTHROUGH
+    uint32_t heat = 0;                  // entries while interpreted (JIT trigger)
+    JitBlockFn native = nullptr;        // compiled code, once hot
+    std::vector<BlockOp> ops;
+};
+
+bool endsBlock(uint8_t op) {
+    return (op >= OP_BEQ && op <= OP_BGEU) || op == OP_JAL || op == OP_JALR ||
+           op == OP_HALT || op == OP_ILLEGAL;
+}
+
+class BlockCache {
+public:
+    BlockCache(const Program& program, BlockStats& stats)
+        : program(program), stats(stats), byIndex(program.code.size(), nullptr) {}
+
+    // Returns the block starting at pc, translating it on first use, or
+    // nullptr if pc is not a program address.
+    Block* lookup(uint32_t pc, const void* const* handlers) {
+        stats.lookups++;
+        uint32_t index = (pc - program.base) >> 2;
+        if ((pc & 0x3) || index >= byIndex.size()) return nullptr;
+        Block* block = byIndex[index];
+        return block ? block : translate(index, handlers);
+    }
+
+    // Drops every block covering a code index in [lo, hi] and unchains them.
+    void invalidate(uint32_t lo, uint32_t hi) {
+        bool any = false;
+        for (auto& block : blocks) {
+            if (block->first <= hi && block->last >= lo) {
+                block->dead = true;
+                byIndex[block->first] = nullptr;
+                stats.invalidated++;
+                any = true;
+            }
+        }
+        if (!any) return;
+        for (auto& block : blocks) {
+            for (Block*& succ : block->next) {
+                if (succ && succ->dead) succ = nullptr;
+            }
+        }
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                    [](const std::unique_ptr<Block>& b) { return b->dead; }),
+                     blocks.end());
+    }
+
+private:
+    Block* translate(uint32_t index, const void* const* handlers) {
+        std::unique_ptr<Block> block(new Block());
+        block->pc = program.base + index * 4;
+        block->first = index;
+        for (uint32_t i = index; ; i++) {
+            const DecodedInstr& d = program.code[i];
+            BlockOp op;
+            op.pc = program.base + i * 4;
+            op.imm = d.imm;
+            op.rd = d.rd;
+            op.rs1 = d.rs1;
+            op.rs2 = d.rs2;
+            op.op = d.op;
+            op.valid = d.valid;
+            block->ops.push_back(op);
+            block->last = i;
+            if (endsBlock(d.op)) break;       // the sentinel entry always ends a block
+            if (block->ops.size() == MAX_BLOCK_OPS) {
+                BlockOp cut;
+                cut.pc = op.pc + 4;
+                cut.op = OP_FALLTHROUGH;
+                block->ops.push_back(cut);
+                block->cut = true;
+                break;
+            }
+        }
+        if (handlers) {
+            for (BlockOp& op : block->ops) op.handler = handlers[op.op];
+        }
+        stats.translated++;
+        Block* raw = block.get();
+        byIndex[index] = raw;
+        blocks.push_back(std::move(block));
+        return raw;
+    }
+
+    const Program& program;
+    BlockStats& stats;
+    std::vector<Block*> byIndex;                 // start index -> block
+    std::vector<std::unique_ptr<Block>> blocks;  // owner
+};
+
+} // namespace
+
+ExitReason runBlocks(Program& program, CPU& cpu, const StackConfig& stack, BlockStats* statsOut,
+                     uint32_t jitThreshold) {
+    BlockStats stats;
+    BlockCache cache(program, stats);
+
+    // Native tier: blocks entered jitThreshold times are compiled.
+    std::unique_ptr<JitX86> jit;
+    JitContext ctx;
+    if (jitThreshold > 0) {
+        jit.reset(new JitX86(cpu.memory, stack));
+        if (!jit->available()) {
+            jit.reset();
+            stats.jitUnavailable = true;
+        }
+        ctx.regs = cpu.regFile.data();
+        ctx.mem = &cpu.memory;
+        ctx.program = &program;
+    }
+    auto compileBlock = [&](Block& block) {
+        auto start = std::chrono::steady_clock::now();
+        block.native = jit->compile(program, block.first, block.last, block.cut);
+        stats.jitCompileSeconds +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (block.native) {
+            stats.jitBlocks++;
+        } else {
+            stats.jitRejected++;
+        }
+    };
+
+    int32_t* R = cpu.regFile.data();
+    GuestMemory& mem = cpu.memory;
+
+    const uint32_t guardLo = stack.base - stack.limit - stack.guard;
+    const uint32_t guardSize = stack.guard;
+
+    uint64_t retired = 0;
+    ExitReason reason = ExitReason::EndOfProgram;
+    uint32_t pc = cpu.PC;
+    Block* b = nullptr;
+    const BlockOp* u = nullptr;
+
+#define INS u
+#define CUR_PC (u->pc)
+#define NEXT() do { ++retired; ++u; DISPATCH(); } while (0)
+// Start executing block b: natively if it has been compiled (or just became
+// hot enough to be), interpreted otherwise.
+#define ENTER_BLOCK() do {                                             \
+        if (b->native) goto run_native;                                \
+        if (jit && ++b->heat == jitThreshold) {                        \
+            compileBlock(*b);                                          \
+            if (b->native) goto run_native;                            \
+        }                                                              \
+        u = b->ops.data();                                             \
+        DISPATCH();                                                    \
+    } while (0)
+// Leave the block through successor 'slot'. The first time, the successor
+// is found through the cache and chained; afterwards it is followed directly.
+#define FOLLOW(slot, target) do {                                      \
+        ++retired;                                                     \
+        Block* next_ = b->next[slot];                                  \
+        if (!next_) {                                                  \
+            pc = (target);                                             \
+            next_ = cache.lookup(pc, handlers);                        \
+            if (!next_) goto exit_off_program;                         \
+            b->next[slot] = next_;                                     \
+        } else {                                                       \
+            stats.chained++;                                           \
+        }                                                              \
+        b = next_;                                                     \
+        ENTER_BLOCK();                                                 \
+    } while (0)
+#define BRANCH(cond) do {                                              \
+        if (cond) FOLLOW(1, CUR_PC + INS->imm);                        \
+        FOLLOW(0, CUR_PC + 4);                                         \
+    } while (0)
+#define JUMP(target) FOLLOW(1, target)
+// jalr: follow the cached successor only if it is this target.
+#define JUMP_INDIRECT(target) do {                                     \
+        uint32_t to_ = (target);                                       \
+        if (b->next[1] && b->next[1]->pc != to_) b->next[1] = nullptr; \
+        FOLLOW(1, to_);                                                \
+    } while (0)
+// A store into the text re-decodes the program and drops the blocks that
+// translated the old bytes (possibly the running one), then resumes at the
+// next instruction through the cache.
+#define TEXT_STORE(addr, value, size) do {                             \
+        if (program.mayTouchText(addr) && program.storeText(addr, value, size)) { \
+            uint32_t lo_ = (addr) < program.base ? 0 : ((addr) - program.base) >> 2; \
+            uint32_t hi_ = ((addr) + (size) - 1 - program.base) >> 2;  \
+            pc = CUR_PC + 4;                                           \
+            ++retired;                                                 \
+            cache.invalidate(lo_, hi_);                                \
+            goto resync;                                               \
+        }                                                              \
+    } while (0)
+#define STOP(why) do { reason = (why); goto exit_at_u; } while (0)
+
+#ifdef RV_COMPUTED_GOTO
+    static const void* const handlers[OP_COUNT + 1] = { RV_OP_LABELS, &&H_OP_FALLTHROUGH };
+#define HANDLER(op) H_##op:
+#define DISPATCH() goto *u->handler
+#else
+    static const void* const* const handlers = nullptr;
+#define HANDLER(op) case op:
+#define DISPATCH() goto dispatch
+#endif
+
+resync:
+    b = cache.lookup(pc, handlers);
+    if (!b) goto exit_off_program;
+    ENTER_BLOCK();
+#ifndef RV_COMPUTED_GOTO
+dispatch:
+    switch (u->op) {
+#endif
+
+#include "interpreter_handlers.inc"
+
+    HANDLER(OP_FALLTHROUGH) {
+        --retired;                 // not an instruction
+        FOLLOW(0, CUR_PC);
+    }
+
+#ifndef RV_COMPUTED_GOTO
+    default:
+        STOP(ExitReason::Illegal);
+    }
+#endif
+
+run_native: {
+        uint32_t exit = b->native(&ctx);
+        uint32_t length = b->last - b->first + 1;
+        if (exit == JIT_EXIT_FALLTHROUGH || exit == JIT_EXIT_TAKEN) {
+            retired += length;
+            stats.jitInstructions += length;
+            // Same chaining as FOLLOW; the target check covers jalr.
+            Block* next = b->next[exit];
+            if (next && next->pc == ctx.nextPc) {
+                stats.chained++;
+            } else {
+                pc = ctx.nextPc;
+                next = cache.lookup(pc, handlers);
+                if (!next) goto exit_off_program;
+                b->next[exit] = next;
+            }
+            b = next;
+            ENTER_BLOCK();
+        }
+        const BlockOp* at = &b->ops[ctx.exitIndex];
+        retired += ctx.exitIndex;
+        stats.jitInstructions += ctx.exitIndex;
+        if (exit == JIT_EXIT_STACK) {
+            u = at;
+            STOP(ExitReason::StackOverflow);
+        }
+        // JIT_EXIT_TEXT_STORE: the store has retired and changed the text.
+        ++retired;
+        stats.jitInstructions++;
+        pc = at->pc + 4;
+        uint32_t lo = ctx.storeAddr < program.base ? 0 : (ctx.storeAddr - program.base) >> 2;
+        uint32_t hi = (ctx.storeAddr + ctx.storeSize - 1 - program.base) >> 2;
+        cache.invalidate(lo, hi);
+        goto resync;
+    }
+
+#undef HANDLER
+#undef DISPATCH
+#undef INS
+#undef CUR_PC
+#undef NEXT
+#undef ENTER_BLOCK
+#undef FOLLOW
+#undef JUMP
+#undef JUMP_INDIRECT
+#undef BRANCH
+#undef TEXT_STORE
+#undef STOP
+
+exit_at_u:
+    cpu.PC = u->pc;
+    cpu.clock += retired;
+    if (jit) stats.jitCodeBytes = jit->codeBytes();
+    if (statsOut) *statsOut = stats;
+    return reason;
+
+exit_off_program:
+    cpu.PC = pc;
+    cpu.clock += retired;
+    if (jit) stats.jitCodeBytes = jit->codeBytes();
+    if (statsOut) *statsOut = stats;
+    return ExitReason::EndOfProgram;
+}
+
+#undef WRITE_RD
+#undef CHECK_STACK
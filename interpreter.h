@@ -0,0 +1,61 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cstdint>
+#include "cpu.h"
+#include "simulator.h"
+
+// Fast execution engines for the functional simulator.
+//
+// Every engine runs the predecoded Program from cpu.PC until it stops, adds
+// the number of retired instructions to cpu.clock and leaves cpu.PC at the
+// instruction that stopped it (or at the address that has no instruction).
+// Registers and memory end up exactly as with the reference switch loop in
+// simulate(); only the per-stage trace output is missing. Stores into the
+// program text update 'program', as they do in the reference loop.
+
+// Counters reported by runThreaded(), indexed by Fused - OP_COUNT.
+struct FusionStats {
+    uint64_t sites[FUSED_COUNT] = {};   // fused pairs in the program text
+    uint64_t hits[FUSED_COUNT] = {};    // times a fused pair ran as one handler
+    uint64_t retired = 0;               // all instructions retired by the run
+};
+
+// Threaded-code interpreter: one small handler per operation, and every
+// handler dispatches straight to the handler of the next instruction
+// (computed goto on GCC/Clang, a switch elsewhere). Dispatch goes through
+// DecodedInstr::exec, so the Fused idioms run as superinstructions.
+//
+// The run stops with ExitReason::InstructionLimit at the first taken
+// branch or jump once maxInstructions have retired (so it may overshoot by
+// one straight-line run); cpu.PC is then the next instruction to execute.
+ExitReason runThreaded(Program& program, CPU& cpu, const StackConfig& stack,
+                       FusionStats* stats = nullptr, uint64_t maxInstructions = UINT64_MAX);
+
+// Counters reported by runBlocks().
+struct BlockStats {
+    uint64_t translated = 0;    // blocks translated
+    uint64_t lookups = 0;       // block-cache lookups (entry, unchained exits)
+    uint64_t chained = 0;       // block exits that followed a chained successor
+    uint64_t invalidated = 0;   // blocks dropped because a store hit their text
+    // Native tier (jitThreshold > 0).
+    bool     jitUnavailable = false;  // no x86-64 host or no executable buffer
+    uint64_t jitBlocks = 0;           // blocks compiled
+    uint64_t jitRejected = 0;         // hot blocks left interpreted
+    uint64_t jitInstructions = 0;     // instructions retired in native code
+    double   jitCompileSeconds = 0;   // host time spent compiling
+    uint64_t jitCodeBytes = 0;        // native code emitted
+};
+
+// Basic-block translation cache: straight-line runs up to the first branch,
+// jal or jalr are translated once into direct-threaded blocks keyed by start
+// PC, and each block chains to its successor blocks, so a hot loop runs
+// without going back through the cache lookup.
+//
+// With jitThreshold > 0, a block entered that many times is compiled to
+// x86-64 code (jit_x86.h) and runs natively from then on; blocks the JIT
+// cannot compile stay interpreted.
+ExitReason runBlocks(Program& program, CPU& cpu, const StackConfig& stack,
+                     BlockStats* stats = nullptr, uint32_t jitThreshold = 0);
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// The RV32 instructions known to the assembler and both simulators, as one
+// constexpr table. Everything that used to be spelled out per tool derives
+// from it at compile time:
+//
+//   assembler      mnemonic -> format and fixed encoding fields (isaFind)
+//   simulators     (opcode, funct3, funct7) -> table entry (isaLookup), which
+//                  gives the functional handler (Op) and, via
+//                  pipelineControl(), the control bundle of the pipeline
+//
+// Adding an instruction means adding a row here and, where its behaviour
+// is new, a handler in the engines.
+
+// Operation (handler index) of a predecoded instruction in the functional
+// simulator.
+enum Op : uint8_t {
+    OP_ILLEGAL,                     // unsupported encoding
+    // R-type
+    OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+    OP_MUL, OP_DIV, OP_REM,
+    // I-type arithmetic
+    OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+    // Loads and stores
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_SB, OP_SH, OP_SW,
+    // Branches
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+    // U/J-type and jumps
+    OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+    OP_HALT,                        // custom HALT (opcode 0x7F)
+    OP_COUNT
+};
+
+// ALU operation of the pipeline's EX stage. Branches use the operation
+// whose result is zero when the branch is taken.
+enum ALUOpType {
+    ALU_ADD,
+    ALU_SUB,
+    ALU_MUL,
+    ALU_DIV,
+    ALU_REM,
+    ALU_AND,
+    ALU_OR,
+    ALU_XOR,
+    ALU_SLL,
+    ALU_SRL,
+    ALU_SRA,
+    ALU_SLT,
+    ALU_PASS, // Pass-through for LUI/AUIPC
+    ALU_EQ,   // Equality comparison (RA == RB)
+    ALU_GE,   // Greater-than-or-equal comparison (RA >= RB)
+    ALU_SLTU, // Unsigned less-than
+    ALU_GEU   // Unsigned greater-than-or-equal
+};
+
+// Encoding format, named as in the assembler's output.
+enum class InstrFormat : uint8_t { R, I, S, SB, U, UJ, SYS };
+
+// Functional unit / timing class.
+enum class Latency : uint8_t { Alu, Mul, Div, Load, Store, Branch, Jump, System };
+
+struct IsaEntry {
+    std::string_view mnemonic;
+    InstrFormat format;
+    uint8_t opcode;
+    int8_t funct3;      // -1: not part of the encoding
+    int8_t funct7;      // -1: not part of the encoding (I-type shifts keep it in imm[11:5])
+    Op op;              // functional handler; OP_ILLEGAL if only assembled
+    ALUOpType aluOp;
+    Latency latency;
+};
+
+constexpr IsaEntry ISA_TABLE[] = {
+    // R-type
+    {"add",   InstrFormat::R,   0x33, 0x0, 0x00, OP_ADD,   ALU_ADD,  Latency::Alu},
+    {"sub",   InstrFormat::R,   0x33, 0x0, 0x20, OP_SUB,   ALU_SUB,  Latency::Alu},
+    {"sll",   InstrFormat::R,   0x33, 0x1, 0x00, OP_SLL,   ALU_SLL,  Latency::Alu},
+    {"slt",   InstrFormat::R,   0x33, 0x2, 0x00, OP_SLT,   ALU_SLT,  Latency::Alu},
+    {"sltu",  InstrFormat::R,   0x33, 0x3, 0x00, OP_SLTU,  ALU_SLTU, Latency::Alu},
+    {"xor",   InstrFormat::R,   0x33, 0x4, 0x00, OP_XOR,   ALU_XOR,  Latency::Alu},
+    {"srl",   InstrFormat::R,   0x33, 0x5, 0x00, OP_SRL,   ALU_SRL,  Latency::Alu},
+    {"sra",   InstrFormat::R,   0x33, 0x5, 0x20, OP_SRA,   ALU_SRA,  Latency::Alu},
+    {"or",    InstrFormat::R,   0x33, 0x6, 0x00, OP_OR,    ALU_OR,   Latency::Alu},
+    {"and",   InstrFormat::R,   0x33, 0x7, 0x00, OP_AND,   ALU_AND,  Latency::Alu},
+    {"mul",   InstrFormat::R,   0x33, 0x0, 0x01, OP_MUL,   ALU_MUL,  Latency::Mul},
+    {"div",   InstrFormat::R,   0x33, 0x4, 0x01, OP_DIV,   ALU_DIV,  Latency::Div},
+    {"rem",   InstrFormat::R,   0x33, 0x6, 0x01, OP_REM,   ALU_REM,  Latency::Div},
+    // I-type arithmetic
+    {"addi",  InstrFormat::I,   0x13, 0x0, -1,   OP_ADDI,  ALU_ADD,  Latency::Alu},
+    {"slti",  InstrFormat::I,   0x13, 0x2, -1,   OP_SLTI,  ALU_SLT,  Latency::Alu},
+    {"sltiu", InstrFormat::I,   0x13, 0x3, -1,   OP_SLTIU, ALU_SLTU, Latency::Alu},
+    {"xori",  InstrFormat::I,   0x13, 0x4, -1,   OP_XORI,  ALU_XOR,  Latency::Alu},
+    {"ori",   InstrFormat::I,   0x13, 0x6, -1,   OP_ORI,   ALU_OR,   Latency::Alu},
+    {"andi",  InstrFormat::I,   0x13, 0x7, -1,   OP_ANDI,  ALU_AND,  Latency::Alu},
+    {"slli",  InstrFormat::I,   0x13, 0x1, 0x00, OP_SLLI,  ALU_SLL,  Latency::Alu},
+    {"srli",  InstrFormat::I,   0x13, 0x5, 0x00, OP_SRLI,  ALU_SRL,  Latency::Alu},
+    {"srai",  InstrFormat::I,   0x13, 0x5, 0x20, OP_SRAI,  ALU_SRA,  Latency::Alu},
+    // Loads (ld/sd are RV64: assembled, and timed as word accesses by the pipeline)
+    {"lb",    InstrFormat::I,   0x03, 0x0, -1,   OP_LB,      ALU_ADD, Latency::Load},
+    {"lh",    InstrFormat::I,   0x03, 0x1, -1,   OP_LH,      ALU_ADD, Latency::Load},
+    {"lw",    InstrFormat::I,   0x03, 0x2, -1,   OP_LW,      ALU_ADD, Latency::Load},
+    {"ld",    InstrFormat::I,   0x03, 0x3, -1,   OP_ILLEGAL, ALU_ADD, Latency::Load},
+    {"lbu",   InstrFormat::I,   0x03, 0x4, -1,   OP_LBU,     ALU_ADD, Latency::Load},
+    {"lhu",   InstrFormat::I,   0x03, 0x5, -1,   OP_LHU,     ALU_ADD, Latency::Load},
+    // Stores
+    {"sb",    InstrFormat::S,   0x23, 0x0, -1,   OP_SB,      ALU_ADD, Latency::Store},
+    {"sh",    InstrFormat::S,   0x23, 0x1, -1,   OP_SH,      ALU_ADD, Latency::Store},
+    {"sw",    InstrFormat::S,   0x23, 0x2, -1,   OP_SW,      ALU_ADD, Latency::Store},
+    {"sd",    InstrFormat::S,   0x23, 0x3, -1,   OP_ILLEGAL, ALU_ADD, Latency::Store},
+    // Branches
+    {"beq",   InstrFormat::SB,  0x63, 0x0, -1,   OP_BEQ,   ALU_SUB,  Latency::Branch},
+    {"bne",   InstrFormat::SB,  0x63, 0x1, -1,   OP_BNE,   ALU_EQ,   Latency::Branch},
+    {"blt",   InstrFormat::SB,  0x63, 0x4, -1,   OP_BLT,   ALU_GE,   Latency::Branch},
+    {"bge",   InstrFormat::SB,  0x63, 0x5, -1,   OP_BGE,   ALU_SLT,  Latency::Branch},
+    {"bltu",  InstrFormat::SB,  0x63, 0x6, -1,   OP_BLTU,  ALU_GEU,  Latency::Branch},
+    {"bgeu",  InstrFormat::SB,  0x63, 0x7, -1,   OP_BGEU,  ALU_SLTU, Latency::Branch},
+    // U/J-type and jumps
+    {"lui",   InstrFormat::U,   0x37, -1,  -1,   OP_LUI,   ALU_PASS, Latency::Alu},
+    {"auipc", InstrFormat::U,   0x17, -1,  -1,   OP_AUIPC, ALU_PASS, Latency::Alu},
+    {"jal",   InstrFormat::UJ,  0x6F, -1,  -1,   OP_JAL,   ALU_PASS, Latency::Jump},
+    {"jalr",  InstrFormat::I,   0x67, 0x0, -1,   OP_JALR,  ALU_ADD,  Latency::Jump},
+    {"halt",  InstrFormat::SYS, 0x7F, -1,  -1,   OP_HALT,  ALU_PASS, Latency::System},
+};
+constexpr size_t ISA_SIZE = sizeof(ISA_TABLE) / sizeof(ISA_TABLE[0]);
+constexpr uint8_t ISA_NONE = 0xFF;
+
+// ===== Decode: (opcode, funct3, funct7) -> table index. =====
+// funct7 only takes the values 0x00, 0x20 and 0x01 in RV32IM, so it folds
+// into two bits and the whole key space is a 4 KiB array.
+constexpr uint32_t isaFunct7Class(uint32_t funct7) {
+    return funct7 == 0x00 ? 0 : funct7 == 0x20 ? 1 : funct7 == 0x01 ? 2 : 3;
+}
+
+constexpr uint32_t isaKey(uint32_t opcode, uint32_t funct3, uint32_t funct7) {
+    return (opcode << 5) | (funct3 << 2) | isaFunct7Class(funct7);
+}
+
+constexpr std::array<uint8_t, 128 * 32> buildIsaDecodeTable() {
+    std::array<uint8_t, 128 * 32> table{};
+    for (auto& slot : table) slot = ISA_NONE;
+    for (size_t i = 0; i < ISA_SIZE; i++) {
+        const IsaEntry& e = ISA_TABLE[i];
+        for (uint32_t f3 = 0; f3 < 8; f3++) {
+            if (e.funct3 >= 0 && static_cast<uint32_t>(e.funct3) != f3) continue;
+            for (uint32_t f7 = 0; f7 < 4; f7++) {
+                if (e.funct7 >= 0 && isaFunct7Class(static_cast<uint32_t>(e.funct7)) != f7) continue;
+                table[(e.opcode << 5) | (f3 << 2) | f7] = static_cast<uint8_t>(i);
+            }
+        }
+    }
+    return table;
+}
+inline constexpr std::array<uint8_t, 128 * 32> ISA_DECODE = buildIsaDecodeTable();
+
+// Format of each major opcode (SYS for opcodes with no instruction), so
+// that immediates are extracted the same way for every word.
+constexpr std::array<InstrFormat, 128> buildIsaFormats() {
+    std::array<InstrFormat, 128> formats{};
+    for (auto& f : formats) f = InstrFormat::SYS;
+    for (size_t i = 0; i < ISA_SIZE; i++) formats[ISA_TABLE[i].opcode] = ISA_TABLE[i].format;
+    return formats;
+}
+inline constexpr std::array<InstrFormat, 128> ISA_FORMATS = buildIsaFormats();
+
+// The table entry of an instruction word, or nullptr if it is not one.
+inline const IsaEntry* isaLookup(uint32_t word) {
+    uint8_t index = ISA_DECODE[isaKey(word & 0x7F, (word >> 12) & 0x7, (word >> 25) & 0x7F)];
+    return index == ISA_NONE ? nullptr : &ISA_TABLE[index];
+}
+
+// ===== Assembly: mnemonic -> table entry. =====
+// Indices of ISA_TABLE sorted by mnemonic, for a binary search.
+constexpr std::array<uint8_t, ISA_SIZE> buildIsaMnemonicIndex() {
+    std::array<uint8_t, ISA_SIZE> order{};
+    for (size_t i = 0; i < ISA_SIZE; i++) order[i] = static_cast<uint8_t>(i);
+    for (size_t i = 1; i < ISA_SIZE; i++) {
+        for (size_t j = i; j > 0 && ISA_TABLE[order[j]].mnemonic < ISA_TABLE[order[j - 1]].mnemonic; j--) {
+            uint8_t t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+    return order;
+}
+inline constexpr std::array<uint8_t, ISA_SIZE> ISA_BY_MNEMONIC = buildIsaMnemonicIndex();
+
+// The table entry for a mnemonic, or nullptr if there is none.
+inline const IsaEntry* isaFind(std::string_view mnemonic) {
+    size_t lo = 0, hi = ISA_SIZE;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        std::string_view m = ISA_TABLE[ISA_BY_MNEMONIC[mid]].mnemonic;
+        if (m == mnemonic) return &ISA_TABLE[ISA_BY_MNEMONIC[mid]];
+        if (m < mnemonic) lo = mid + 1; else hi = mid;
+    }
+    return nullptr;
+}
+
+// Assembler name of a format ("R", "I", "S", "SB", "U", "UJ", "SYS").
+constexpr const char* isaFormatName(InstrFormat format) {
+    switch (format) {
+        case InstrFormat::R:  return "R";
+        case InstrFormat::I:  return "I";
+        case InstrFormat::S:  return "S";
+        case InstrFormat::SB: return "SB";
+        case InstrFormat::U:  return "U";
+        case InstrFormat::UJ: return "UJ";
+        default:              return "SYS";
+    }
+}
+
+// ===== RV32M division semantics. =====
+// No traps: every engine and the pipeline's ALU divide through these.
+inline int32_t signedDiv(int32_t a, int32_t b) {
+    if (b == 0) return -1;                     // division by zero => -1
+    if (a == INT_MIN && b == -1) return a;     // overflow => dividend
+    return a / b;
+}
+
+inline int32_t signedRem(int32_t a, int32_t b) {
+    if (b == 0) return a;                      // remainder by zero => dividend
+    if (a == INT_MIN && b == -1) return 0;     // overflow => 0
+    return a % b;
+}
+
+// ===== Pipeline control bundle. =====
+struct PipelineControl {
+    bool regWrite = false;
+    bool memRead = false;
+    bool memWrite = false;
+    bool branch = false;
+    bool jump = false;
+    ALUOpType aluOp = ALU_PASS;
+    uint8_t memToReg = 0;       // 0 = ALU result, 1 = memory, 2 = PC + 4
+    uint8_t memSize = 2;        // 0 = byte, 1 = halfword, 2 = word
+    bool memSignExtend = false;
+    bool halt = false;          // stops fetch; the pipeline drains and halts
+};
+
+constexpr PipelineControl pipelineControl(const IsaEntry& e) {
+    PipelineControl c;
+    c.aluOp = e.aluOp;
+    switch (e.latency) {
+        case Latency::Load:
+            c.regWrite = true;
+            c.memRead = true;
+            c.memToReg = 1;
+            c.memSize = (e.funct3 & 3) < 2 ? (e.funct3 & 3) : 2;
+            c.memSignExtend = e.funct3 < 2;
+            break;
+        case Latency::Store:
+            c.memWrite = true;
+            c.memSize = e.funct3 < 2 ? e.funct3 : 2;
+            break;
+        case Latency::Branch:
+            c.branch = true;
+            break;
+        case Latency::Jump:
+            c.regWrite = true;
+            c.jump = true;
+            c.branch = e.opcode == 0x6F;    // JAL also counts as a branch
+            c.memToReg = 2;
+            break;
+        case Latency::System:
+            c.halt = e.op == OP_HALT;
+            break;
+        default:
+            c.regWrite = true;
+            break;
+    }
+    return c;
+}
+
+constexpr std::array<PipelineControl, ISA_SIZE> buildPipelineControls() {
+    std::array<PipelineControl, ISA_SIZE> controls{};
+    for (size_t i = 0; i < ISA_SIZE; i++) controls[i] = pipelineControl(ISA_TABLE[i]);
+    return controls;
+}
+inline constexpr std::array<PipelineControl, ISA_SIZE> PIPELINE_CONTROLS = buildPipelineControls();
+
+#endif
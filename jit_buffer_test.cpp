@@ -0,0 +1,89 @@
+// Test: fills a small JIT code buffer with store-heavy blocks.
+//
+// Stores on the paged backend are the longest code the JIT emits. The test
+// compiles blocks of them until the buffer refuses more, then single-store
+// blocks until it is nearly full, and checks that the code never ran past
+// the buffer and that the blocks compiled first still run correctly.
+//
+// Build: g++ -std=c++17 -O2 jit_buffer_test.cpp jit_x86.cpp simulator.cpp interpreter.cpp checkpoint.cpp parser.cpp converter.cpp symbol_table.cpp guest_memory.cpp -o jit_buffer_test
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include "jit_x86.h"
+
+static constexpr uint32_t DATA = 0x10000000;
+static constexpr uint32_t STORES = 96;         // instructions per block
+static constexpr size_t BUFFER = 64 << 10;
+
+// S-type store of x5 to 'offset'(x6); funct3 0 = sb, 1 = sh, 2 = sw.
+static uint32_t store(uint32_t funct3, uint32_t offset) {
+    return ((offset >> 5) << 25) | (5 << 20) | (6 << 15) | (funct3 << 12) | ((offset & 0x1F) << 7) | 0x23;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        std::cout << "FAIL: " << what << "\n";
+        failures++;
+    }
+}
+
+int main() {
+#ifndef RV_JIT_X86
+    std::cout << "No native tier on this host; nothing to test.\n";
+    return 0;
+#else
+    // sw, sh, sb in turn, each to its own word.
+    std::map<uint32_t, uint32_t> words;
+    for (uint32_t i = 0; i < STORES; i++) {
+        words[i * 4] = store(2 - i % 3, i * 4);
+    }
+    words[STORES * 4] = 0;     // HALT
+    Program program = buildProgram(words);
+
+    GuestMemory mem;
+    JitX86 jit(mem, StackConfig(), BUFFER);
+    if (!jit.available()) {
+        std::cout << "Could not map the code buffer.\n";
+        return 1;
+    }
+
+    JitBlockFn first = jit.compile(program, 0, STORES - 1, true);
+    check(first != nullptr, "first block compiles");
+    size_t blocks = first ? 1 : 0;
+    while (jit.compile(program, 0, STORES - 1, true)) {
+        blocks++;
+        check(jit.codeBytes() <= BUFFER, "block fits the buffer");
+    }
+    while (jit.compile(program, 0, 0, true)) {
+        check(jit.codeBytes() <= BUFFER, "single store fits the buffer");
+    }
+    check(jit.codeBytes() <= BUFFER, "code stays inside the buffer");
+    check(BUFFER - jit.codeBytes() < 512, "buffer is nearly full");
+    std::cout << blocks << " blocks of " << STORES << " stores, " << jit.codeBytes()
+              << " of " << BUFFER << " bytes used\n";
+
+    if (first) {
+        int32_t regs[32] = {};
+        regs[5] = 0x11223344;
+        regs[6] = static_cast<int32_t>(DATA);
+        JitContext ctx;
+        ctx.regs = regs;
+        ctx.mem = &mem;
+        ctx.program = &program;
+        check(first(&ctx) == JIT_EXIT_FALLTHROUGH, "block leaves through its fall-through");
+        check(ctx.nextPc == STORES * 4, "block continues after its last store");
+        static const uint32_t expected[3] = {0x11223344, 0x3344, 0x44};
+        for (uint32_t i = 0; i < STORES; i++) {
+            if (mem.read32(DATA + i * 4) != expected[i % 3]) {
+                check(false, "stored values");
+                break;
+            }
+        }
+    }
+
+    std::cout << (failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+#endif
+}
@@ -0,0 +1,419 @@
+#include "jit_x86.h"
+#include "interpreter.h"
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#ifdef RV_JIT_X86
+#include <sys/mman.h>
+
+// ===== Helpers called from native code. =====
+// Loads and stores go through the guest memory layer. The native code only
+// inlines its software-TLB hit path (and plain flat-backend loads); misses,
+// page-crossing accesses and stores near the program text call these.
+static uint32_t jitRead8(GuestMemory* mem, uint32_t addr)  { return mem->read8(addr); }
+static uint32_t jitRead16(GuestMemory* mem, uint32_t addr) { return mem->read16(addr); }
+static uint32_t jitRead32(GuestMemory* mem, uint32_t addr) { return mem->read32(addr); }
+
+// Returns 1 if the store also changed the program text.
+static uint32_t jitTextStore(JitContext* ctx, uint32_t addr, uint32_t value, uint32_t size) {
+    if (ctx->program->mayTouchText(addr) && ctx->program->storeText(addr, value, size)) {
+        ctx->storeAddr = addr;
+        ctx->storeSize = size;
+        return 1;
+    }
+    return 0;
+}
+static uint32_t jitWrite8(JitContext* ctx, uint32_t addr, uint32_t value) {
+    ctx->mem->write8(addr, value);
+    return jitTextStore(ctx, addr, value, 1);
+}
+static uint32_t jitWrite16(JitContext* ctx, uint32_t addr, uint32_t value) {
+    ctx->mem->write16(addr, value);
+    return jitTextStore(ctx, addr, value, 2);
+}
+static uint32_t jitWrite32(JitContext* ctx, uint32_t addr, uint32_t value) {
+    ctx->mem->write32(addr, value);
+    return jitTextStore(ctx, addr, value, 4);
+}
+static uint32_t jitDiv(uint32_t a, uint32_t b) {
+    return static_cast<uint32_t>(signedDiv(static_cast<int32_t>(a), static_cast<int32_t>(b)));
+}
+static uint32_t jitRem(uint32_t a, uint32_t b) {
+    return static_cast<uint32_t>(signedRem(static_cast<int32_t>(a), static_cast<int32_t>(b)));
+}
+
+namespace {
+
+// Host registers. rbx holds the guest register file and rbp the JitContext
+// for the whole block (both callee-saved); eax/ecx/edx are scratch.
+enum HostReg : uint8_t { EAX = 0, ECX = 1, EDX = 2 };
+
+constexpr uint8_t CTX_NEXT_PC    = offsetof(JitContext, nextPc);
+constexpr uint8_t CTX_EXIT_INDEX = offsetof(JitContext, exitIndex);
+constexpr uint8_t CTX_MEM        = offsetof(JitContext, mem);
+constexpr uint8_t CTX_REGS       = offsetof(JitContext, regs);
+
+// Upper bound on the bytes emitted for one guest instruction. The longest
+// path is a store on the paged backend, about 170 bytes: register loads 6,
+// address 5, stack check 33, text-range check 16, TLB probe 62, inline
+// store 9, helper call and text-store exit 42.
+constexpr size_t MAX_BYTES_PER_INSTR = 192;
+// Epilogue, prologue and the fall-through exit of a cut block, with the
+// alignment padding after it.
+constexpr size_t MAX_BLOCK_FRAME = 64;
+
+class Emitter {
+public:
+    Emitter(uint8_t* at, const uint8_t* epilogue) : p(at), epilogue(epilogue) {}
+
+    uint8_t* pos() const { return p; }
+
+    void byte(uint8_t b) { *p++ = b; }
+    void bytes(std::initializer_list<uint8_t> bs) { for (uint8_t b : bs) *p++ = b; }
+    void imm32(uint32_t v) { std::memcpy(p, &v, 4); p += 4; }
+    void imm64(uint64_t v) { std::memcpy(p, &v, 8); p += 8; }
+
+    // mov r32, guest x[r]   (x0 reads as zero)
+    void loadReg(HostReg h, uint32_t r) {
+        if (r == 0) {
+            bytes({0x31, static_cast<uint8_t>(0xC0 | (h << 3) | h)});     // xor h, h
+        } else {
+            bytes({0x8B, static_cast<uint8_t>(0x43 | (h << 3)), static_cast<uint8_t>(4 * r)});
+        }
+    }
+    // mov guest x[r], r32   (writes to x0 are dropped)
+    void storeReg(uint32_t r, HostReg h) {
+        if (r == 0) return;
+        bytes({0x89, static_cast<uint8_t>(0x43 | (h << 3)), static_cast<uint8_t>(4 * r)});
+    }
+    // mov dword guest x[r], imm32
+    void storeRegImm(uint32_t r, uint32_t v) {
+        if (r == 0) return;
+        bytes({0xC7, 0x43, static_cast<uint8_t>(4 * r)});
+        imm32(v);
+    }
+    // mov dword [rbp + off], imm32
+    void storeCtxImm(uint8_t off, uint32_t v) { bytes({0xC7, 0x45, off}); imm32(v); }
+    // mov eax, imm32
+    void movEax(uint32_t v) { byte(0xB8); imm32(v); }
+    // add eax, imm32
+    void addEax(int32_t v) {
+        if (v != 0) { byte(0x05); imm32(static_cast<uint32_t>(v)); }
+    }
+    // movabs r11, fn ; call r11
+    void call(const void* fn) {
+        bytes({0x49, 0xBB});
+        imm64(reinterpret_cast<uint64_t>(fn));
+        bytes({0x41, 0xFF, 0xD3});
+    }
+    // jmp epilogue (rel32)
+    void jmpEpilogue() {
+        byte(0xE9);
+        imm32(static_cast<uint32_t>(epilogue - (p + 4)));
+    }
+    // Short forward jump with the target patched later by bind().
+    uint8_t* jccForward(uint8_t opcode) { bytes({opcode, 0}); return p - 1; }
+    void bind(uint8_t* rel8) {
+        assert(p - (rel8 + 1) <= 127);
+        *rel8 = static_cast<uint8_t>(p - (rel8 + 1));
+    }
+    // movabs rsi, imm64
+    void movRsi(const void* v) { bytes({0x48, 0xBE}); imm64(reinterpret_cast<uint64_t>(v)); }
+
+    // Inline software-TLB probe for the guest address in eax. On a hit,
+    // rsi = host page and edi = page offset; jumps to 'miss' (two rel8
+    // fixups appended) if the entry does not match or the access of 'size'
+    // bytes would cross into the next page.
+    void tlbProbe(const void* table, uint64_t* hitCounter, uint32_t size, uint8_t* miss[2]) {
+        static_assert(GuestMemory::TLB_ENTRIES <= 128, "TLB index mask must fit an imm8");
+        bytes({0x89, 0xC1});                                    // mov ecx, eax
+        bytes({0xC1, 0xE9, GuestMemory::PAGE_BITS});            // shr ecx, PAGE_BITS   (vpn)
+        bytes({0x89, 0xCA});                                    // mov edx, ecx
+        bytes({0x83, 0xE2, GuestMemory::TLB_ENTRIES - 1});      // and edx, TLB_ENTRIES-1
+        bytes({0xC1, 0xE2, 0x04});                              // shl edx, 4          (16-byte entries)
+        movRsi(table);
+        bytes({0x39, 0x0C, 0x16});                              // cmp [rsi+rdx], ecx
+        miss[0] = jccForward(0x75);                             // jne miss
+        bytes({0x89, 0xC7});                                    // mov edi, eax
+        bytes({0x81, 0xE7}); imm32(GuestMemory::PAGE_MASK);     // and edi, PAGE_MASK
+        bytes({0x81, 0xFF}); imm32(GuestMemory::PAGE_SIZE - size);  // cmp edi, PAGE_SIZE-size
+        miss[1] = jccForward(0x77);                             // ja miss
+        bytes({0x48, 0x8B, 0x74, 0x16, 0x08});                  // mov rsi, [rsi+rdx+8]
+        bytes({0x48, 0xB9}); imm64(reinterpret_cast<uint64_t>(hitCounter));  // movabs rcx, counter
+        bytes({0x48, 0xFF, 0x01});                              // inc qword [rcx]
+    }
+
+    // eax = 'size'-byte load from [rsi+rdi], sign- or zero-extended.
+    void loadHost(uint32_t size, bool isSigned) {
+        if (size == 4) bytes({0x8B, 0x04, 0x3E});                               // mov eax, [rsi+rdi]
+        if (size == 2) bytes({0x0F, static_cast<uint8_t>(isSigned ? 0xBF : 0xB7), 0x04, 0x3E});
+        if (size == 1) bytes({0x0F, static_cast<uint8_t>(isSigned ? 0xBE : 0xB6), 0x04, 0x3E});
+    }
+    // 'size'-byte store of ecx to [rsi+rdi].
+    void storeHost(uint32_t size) {
+        if (size == 4) bytes({0x89, 0x0C, 0x3E});                               // mov [rsi+rdi], ecx
+        if (size == 2) bytes({0x66, 0x89, 0x0C, 0x3E});                         // mov [rsi+rdi], cx
+        if (size == 1) bytes({0x88, 0x0C, 0x3E});                               // mov [rsi+rdi], cl
+    }
+
+    // mov eax, code ; jmp epilogue
+    void exitWith(uint32_t code) { movEax(code); jmpEpilogue(); }
+
+    // Leaves the block through successor 'slot' with nextPc = target.
+    void exitTo(uint32_t slot, uint32_t target) {
+        storeCtxImm(CTX_NEXT_PC, target);
+        exitWith(slot);
+    }
+    // Early exit at block instruction 'index'.
+    void exitAt(uint32_t index, uint32_t code) {
+        storeCtxImm(CTX_EXIT_INDEX, index);
+        exitWith(code);
+    }
+
+    // Address in eax: leave with JIT_EXIT_STACK if it is in the guard region.
+    void checkStack(uint32_t index, uint32_t guardLo, uint32_t guardSize) {
+        bytes({0x89, 0xC1});                    // mov ecx, eax
+        bytes({0x81, 0xE9}); imm32(guardLo);    // sub ecx, guardLo
+        bytes({0x81, 0xF9}); imm32(guardSize);  // cmp ecx, guardSize
+        uint8_t* ok = jccForward(0x73);         // jae ok
+        exitAt(index, JIT_EXIT_STACK);
+        bind(ok);
+    }
+
+    // eax = (eax <cc> ecx / imm) ? 1 : 0 for the setcc opcode byte 'cc'.
+    void setccEax(uint8_t cc) {
+        bytes({0x0F, cc, 0xC0});                // setcc al
+        bytes({0x0F, 0xB6, 0xC0});              // movzx eax, al
+    }
+
+private:
+    uint8_t* p;
+    const uint8_t* epilogue;
+};
+
+} // namespace
+
+JitX86::JitX86(const GuestMemory& mem, const StackConfig& stack, size_t bufferSize) : mem(mem) {
+    guardLo = stack.base - stack.limit - stack.guard;
+    guardSize = stack.guard;
+    void* code = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED) {
+        buffer = static_cast<uint8_t*>(code);
+        capacity = bufferSize;
+    }
+}
+
+JitX86::~JitX86() {
+    if (buffer) munmap(buffer, capacity);
+}
+
+JitBlockFn JitX86::compile(const Program& program, uint32_t first, uint32_t last, bool cut) {
+    if (!buffer) return nullptr;
+    for (uint32_t i = first; i <= last; i++) {
+        uint8_t op = program.code[i].op;
+        if (op == OP_ILLEGAL || op == OP_HALT) return nullptr;
+    }
+    // Room is checked again before every instruction; a block that runs
+    // out of it is dropped and its partial code overwritten by the next.
+    if (capacity - used < MAX_BLOCK_FRAME + MAX_BYTES_PER_INSTR) return nullptr;
+
+    // Layout: shared epilogue first, so every exit is a backward jump to a
+    // known address, then the entry point.
+    uint8_t* start = buffer + used;
+    uint8_t* epilogue = start;
+    Emitter e(start, epilogue);
+    e.bytes({0x41, 0x5C, 0x5D, 0x5B, 0xC3});    // pop r12; pop rbp; pop rbx; ret
+
+    uint8_t* entry = e.pos();
+    // push rbx; push rbp; push r12 (keeps rsp 16-byte aligned for the calls)
+    e.bytes({0x53, 0x55, 0x41, 0x54});
+    e.bytes({0x48, 0x8B, 0x5F, CTX_REGS});      // mov rbx, [rdi + regs]
+    e.bytes({0x48, 0x89, 0xFD});                // mov rbp, rdi
+
+    for (uint32_t i = first; i <= last; i++) {
+        const DecodedInstr& d = program.code[i];
+        const uint32_t pc = program.base + i * 4;
+        const uint32_t index = i - first;
+        const uint32_t imm = static_cast<uint32_t>(d.imm);
+        uint8_t* const instrStart = e.pos();
+        if (static_cast<size_t>(buffer + capacity - instrStart) < MAX_BYTES_PER_INSTR + MAX_BLOCK_FRAME) {
+            return nullptr;
+        }
+
+        switch (d.op) {
+            // ---- R-type: eax = rs1 op ecx ----
+            case OP_ADD: case OP_SUB: case OP_XOR: case OP_OR: case OP_AND:
+            case OP_SLL: case OP_SRL: case OP_SRA: case OP_SLT: case OP_SLTU: case OP_MUL:
+                e.loadReg(EAX, d.rs1);
+                e.loadReg(ECX, d.rs2);
+                switch (d.op) {
+                    case OP_ADD:  e.bytes({0x01, 0xC8}); break;          // add eax, ecx
+                    case OP_SUB:  e.bytes({0x29, 0xC8}); break;          // sub eax, ecx
+                    case OP_XOR:  e.bytes({0x31, 0xC8}); break;
+                    case OP_OR:   e.bytes({0x09, 0xC8}); break;
+                    case OP_AND:  e.bytes({0x21, 0xC8}); break;
+                    case OP_SLL:  e.bytes({0xD3, 0xE0}); break;          // shl eax, cl (masks to 5 bits)
+                    case OP_SRL:  e.bytes({0xD3, 0xE8}); break;          // shr eax, cl
+                    case OP_SRA:  e.bytes({0xD3, 0xF8}); break;          // sar eax, cl
+                    case OP_SLT:  e.bytes({0x39, 0xC8}); e.setccEax(0x9C); break;   // cmp; setl
+                    case OP_SLTU: e.bytes({0x39, 0xC8}); e.setccEax(0x92); break;   // cmp; setb
+                    case OP_MUL:  e.bytes({0x0F, 0xAF, 0xC1}); break;    // imul eax, ecx
+                }
+                e.storeReg(d.rd, EAX);
+                break;
+            case OP_DIV: case OP_REM:
+                e.loadReg(EAX, d.rs1);
+                e.loadReg(ECX, d.rs2);
+                e.bytes({0x89, 0xC7});                                  // mov edi, eax
+                e.bytes({0x89, 0xCE});                                  // mov esi, ecx
+                e.call(reinterpret_cast<const void*>(d.op == OP_DIV ? jitDiv : jitRem));
+                e.storeReg(d.rd, EAX);
+                break;
+
+            // ---- I-type arithmetic: eax = rs1 op imm ----
+            case OP_ADDI:
+                e.loadReg(EAX, d.rs1);
+                e.addEax(d.imm);
+                e.storeReg(d.rd, EAX);
+                break;
+            case OP_XORI: case OP_ORI: case OP_ANDI: case OP_SLTI: case OP_SLTIU:
+                e.loadReg(EAX, d.rs1);
+                switch (d.op) {
+                    case OP_XORI:  e.byte(0x35); e.imm32(imm); break;
+                    case OP_ORI:   e.byte(0x0D); e.imm32(imm); break;
+                    case OP_ANDI:  e.byte(0x25); e.imm32(imm); break;
+                    case OP_SLTI:  e.byte(0x3D); e.imm32(imm); e.setccEax(0x9C); break;
+                    case OP_SLTIU: e.byte(0x3D); e.imm32(imm); e.setccEax(0x92); break;
+                }
+                e.storeReg(d.rd, EAX);
+                break;
+            case OP_SLLI: case OP_SRLI: case OP_SRAI:
+                e.loadReg(EAX, d.rs1);
+                e.bytes({0xC1, static_cast<uint8_t>(d.op == OP_SLLI ? 0xE0 : d.op == OP_SRLI ? 0xE8 : 0xF8),
+                         static_cast<uint8_t>(d.rs2)});
+                e.storeReg(d.rd, EAX);
+                break;
+
+            // ---- Loads ----
+            case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: {
+                const uint32_t size = (d.op == OP_LB || d.op == OP_LBU) ? 1 : (d.op == OP_LW) ? 4 : 2;
+                const bool isSigned = d.op == OP_LB || d.op == OP_LH;
+                e.loadReg(EAX, d.rs1);
+                e.addEax(d.imm);
+                e.checkStack(index, guardLo, guardSize);
+                if (mem.isFlat()) {
+                    e.movRsi(mem.hostPointer(0));
+                    e.bytes({0x89, 0xC7});                              // mov edi, eax
+                    e.loadHost(size, isSigned);
+                    e.storeReg(d.rd, EAX);
+                    break;
+                }
+                uint8_t* miss[2];
+                e.tlbProbe(mem.readTlbTable(), mem.tlbHitCounter(), size, miss);
+                e.loadHost(size, isSigned);
+                uint8_t* done = e.jccForward(0xEB);                     // jmp done
+                e.bind(miss[0]);
+                e.bind(miss[1]);
+                e.bytes({0x48, 0x8B, 0x7D, CTX_MEM});                   // mov rdi, [rbp + mem]
+                e.bytes({0x89, 0xC6});                                  // mov esi, eax
+                e.call(size == 1 ? reinterpret_cast<const void*>(jitRead8)
+                     : size == 2 ? reinterpret_cast<const void*>(jitRead16)
+                     : reinterpret_cast<const void*>(jitRead32));
+                if (d.op == OP_LB) e.bytes({0x0F, 0xBE, 0xC0});         // movsx eax, al
+                if (d.op == OP_LH) e.bytes({0x0F, 0xBF, 0xC0});         // movsx eax, ax
+                e.bind(done);
+                e.storeReg(d.rd, EAX);
+                break;
+            }
+
+            // ---- Stores: inline TLB hit, else helper(ctx, addr, value) ----
+            // Stores that may reach the program text always take the helper,
+            // which re-decodes the text and reports it (non-zero eax).
+            case OP_SB: case OP_SH: case OP_SW: {
+                const uint32_t size = d.op == OP_SB ? 1 : d.op == OP_SH ? 2 : 4;
+                e.loadReg(EAX, d.rs1);
+                e.addEax(d.imm);
+                e.checkStack(index, guardLo, guardSize);
+                uint8_t* slow[3] = {nullptr, nullptr, nullptr};
+                uint8_t* done = nullptr;
+                if (!mem.isFlat()) {
+                    if (program.textSize() > 0) {
+                        e.bytes({0x89, 0xC1});                          // mov ecx, eax
+                        e.bytes({0x81, 0xE9}); e.imm32(program.base - 3);       // sub ecx, base-3
+                        e.bytes({0x81, 0xF9}); e.imm32(program.textSize() + 3); // cmp ecx, text+3
+                        slow[2] = e.jccForward(0x72);                   // jb slow
+                    }
+                    e.tlbProbe(mem.writeTlbTable(), mem.tlbHitCounter(), size, slow);
+                    e.loadReg(ECX, d.rs2);
+                    e.storeHost(size);
+                    done = e.jccForward(0xEB);                          // jmp done
+                    for (uint8_t* fixup : slow) {
+                        if (fixup) e.bind(fixup);
+                    }
+                }
+                e.loadReg(EDX, d.rs2);
+                e.bytes({0x48, 0x89, 0xEF});                            // mov rdi, rbp
+                e.bytes({0x89, 0xC6});                                  // mov esi, eax
+                e.call(size == 1 ? reinterpret_cast<const void*>(jitWrite8)
+                     : size == 2 ? reinterpret_cast<const void*>(jitWrite16)
+                     : reinterpret_cast<const void*>(jitWrite32));
+                e.bytes({0x85, 0xC0});                                  // test eax, eax
+                uint8_t* ok = e.jccForward(0x74);                       // jz ok
+                e.exitAt(index, JIT_EXIT_TEXT_STORE);
+                e.bind(ok);
+                if (done) e.bind(done);
+                break;
+            }
+
+            // ---- Block terminators ----
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU: {
+                static const uint8_t jcc[] = {0x74, 0x75, 0x7C, 0x7D, 0x72, 0x73};
+                e.loadReg(EAX, d.rs1);
+                e.loadReg(ECX, d.rs2);
+                e.bytes({0x39, 0xC8});                                  // cmp eax, ecx
+                uint8_t* taken = e.jccForward(jcc[d.op - OP_BEQ]);
+                e.exitTo(JIT_EXIT_FALLTHROUGH, pc + 4);
+                e.bind(taken);
+                e.exitTo(JIT_EXIT_TAKEN, pc + imm);
+                break;
+            }
+            case OP_JAL:
+                e.storeRegImm(d.rd, pc + 4);
+                e.exitTo(JIT_EXIT_TAKEN, pc + imm);
+                break;
+            case OP_JALR:
+                e.loadReg(EAX, d.rs1);
+                e.addEax(d.imm);
+                e.byte(0x25); e.imm32(~1u);                             // and eax, ~1
+                e.bytes({0x89, 0x45, CTX_NEXT_PC});                     // mov [rbp + nextPc], eax
+                e.storeRegImm(d.rd, pc + 4);
+                e.exitWith(JIT_EXIT_TAKEN);
+                break;
+
+            case OP_LUI:
+                e.storeRegImm(d.rd, imm);
+                break;
+            case OP_AUIPC:
+                e.storeRegImm(d.rd, pc + imm);
+                break;
+        }
+        assert(static_cast<size_t>(e.pos() - instrStart) <= MAX_BYTES_PER_INSTR);
+    }
+    if (cut) {
+        e.exitTo(JIT_EXIT_FALLTHROUGH, program.base + (last + 1) * 4);
+    }
+
+    used = static_cast<size_t>(e.pos() - buffer);
+    used = (used + 15) & ~size_t(15);
+    return reinterpret_cast<JitBlockFn>(entry);
+}
+
+#else // !RV_JIT_X86
+
+JitX86::JitX86(const GuestMemory& mem, const StackConfig&, size_t) : mem(mem) {}
+JitX86::~JitX86() {}
+JitBlockFn JitX86::compile(const Program&, uint32_t, uint32_t, bool) { return nullptr; }
+
+#endif
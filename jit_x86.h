@@ -0,0 +1,71 @@
+#ifndef JIT_X86_H
+#define JIT_X86_H
+
+#include <cstddef>
+#include <cstdint>
+#include "guest_memory.h"
+#include "simulator.h"
+
+// The native tier needs an x86-64 host and mmap for the code buffer.
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define RV_JIT_X86 1
+#endif
+
+// State shared between runBlocks() and the native code of a block. The
+// guest registers are not copied: 'regs' points at CPU::regFile and the
+// native code reads and writes x1..x31 there directly.
+struct JitContext {
+    int32_t*     regs = nullptr;
+    GuestMemory* mem = nullptr;
+    Program*     program = nullptr;
+    uint32_t     nextPc = 0;      // set on JIT_EXIT_FALLTHROUGH / JIT_EXIT_TAKEN
+    uint32_t     exitIndex = 0;   // block instruction that caused an early exit
+    uint32_t     storeAddr = 0;   // JIT_EXIT_TEXT_STORE: the store that hit the text
+    uint32_t     storeSize = 0;
+};
+
+// Why a native block returned.
+enum JitExit : uint32_t {
+    JIT_EXIT_FALLTHROUGH = 0,   // successor slot 0 (not taken / next block)
+    JIT_EXIT_TAKEN = 1,         // successor slot 1 (taken branch, jal, jalr)
+    JIT_EXIT_STACK = 2,         // instruction exitIndex hit the stack guard (not executed)
+    JIT_EXIT_TEXT_STORE = 3,    // instruction exitIndex stored into the program text
+};
+
+using JitBlockFn = uint32_t (*)(JitContext*);
+
+// x86-64 code generator for translated blocks. Code is appended to one
+// mmap'd executable buffer and never freed: the native code of a block that
+// is later invalidated simply becomes unreachable. The generated code
+// embeds the addresses of 'mem''s TLB tables (or of its flat reservation),
+// so the backend must not change after the first compile.
+class JitX86 {
+public:
+    static constexpr size_t DEFAULT_BUFFER = 16u << 20;
+
+    JitX86(const GuestMemory& mem, const StackConfig& stack, size_t bufferSize = DEFAULT_BUFFER);
+    ~JitX86();
+    JitX86(const JitX86&) = delete;
+    JitX86& operator=(const JitX86&) = delete;
+
+    // False if this host has no native tier or the buffer could not be mapped.
+    bool available() const { return buffer != nullptr; }
+
+    // Compiles program.code[first..last] as one block. 'cut' means the block
+    // has no terminator and continues at the instruction after 'last'.
+    // Returns nullptr for blocks with unsupported instructions (HALT, illegal
+    // encodings) or when the buffer is full; those stay interpreted.
+    JitBlockFn compile(const Program& program, uint32_t first, uint32_t last, bool cut);
+
+    size_t codeBytes() const { return used; }
+
+private:
+    const GuestMemory& mem;
+    uint8_t* buffer = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint32_t guardLo = 0;
+    uint32_t guardSize = 0;
+};
+
+#endif
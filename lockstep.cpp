@@ -0,0 +1,332 @@
+#include "lockstep.h"
+#include "interpreter.h"
+#include <algorithm>
+
+// GCC/Clang vector extensions: arithmetic, shifts and comparisons work
+// element-wise on whole vectors and are lowered to AVX2 (or SSE) code.
+#if defined(__GNUC__) || defined(__clang__)
+#define RV_LANE_VECTORS 1
+#endif
+
+namespace {
+
+// Finishes a lane on the threaded engine, on its own copy of the program.
+// 'done' instructions have already retired in lockstep.
+ExitReason finishAlone(const Program& shared, LockstepLane& lane, const StackConfig& stack,
+                       uint64_t done, uint32_t storeAddr = 0, uint32_t storeValue = 0,
+                       uint32_t storeSize = 0) {
+    Program program = shared;
+    if (storeSize) program.storeText(storeAddr, storeValue, storeSize);
+    uint64_t budget = lane.maxInstructions;
+    if (budget != UINT64_MAX) budget = budget > done ? budget - done : 0;
+    return runThreaded(program, *lane.cpu, stack, nullptr, budget);
+}
+
+#ifdef RV_LANE_VECTORS
+
+typedef uint32_t LaneU __attribute__((vector_size(4 * LOCKSTEP_LANES)));
+typedef int32_t  LaneS __attribute__((vector_size(4 * LOCKSTEP_LANES)));
+typedef uint64_t LaneCount __attribute__((vector_size(8 * LOCKSTEP_LANES)));   // per-lane counters
+
+// Vectors are passed to the helpers by reference: GCC's note on by-value
+// vector parameters (their calling convention changed in GCC 4.6) cannot be
+// silenced. Returning them by value draws -Wpsabi, because the convention
+// depends on -mavx2; that does not matter for functions only this file
+// calls. GCC reports it when it finishes the function, at the end of the
+// file, so it stays off from here on rather than in a push/pop pair.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+inline LaneU splat(uint32_t v) { return LaneU{} + v; }
+// Per lane: mask ? a : b (mask lanes are all ones or all zeros).
+inline LaneU blend(const LaneU& mask, const LaneU& a, const LaneU& b) { return (a & mask) | (b & ~mask); }
+inline LaneU lanesWhere(const LaneS& cmp) { return (LaneU)cmp; }   // comparison result -> mask
+inline LaneS asSigned(const LaneU& v) { return (LaneS)v; }
+inline LaneU asUnsigned(const LaneS& v) { return (LaneU)v; }
+inline LaneCount ones(const LaneU& mask) { return __builtin_convertvector(mask & splat(1), LaneCount); }
+
+inline bool sameLanes(const LaneU& x, const LaneU& y) {
+    LaneU diff = x ^ y;
+    uint32_t any = 0;
+    for (unsigned l = 0; l < LOCKSTEP_LANES; l++) any |= diff[l];
+    return any == 0;
+}
+
+// True if a 'size'-byte store at addr writes at least one text byte.
+bool storeHitsText(const Program& program, uint32_t addr, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        if (addr + i - program.base < program.textSize()) return true;
+    }
+    return false;
+}
+
+// Runs up to LOCKSTEP_LANES lanes as one group.
+void runGroup(const Program& program, LockstepLane* lanes, unsigned n, const StackConfig& stack,
+              LockstepStats& stats) {
+    const uint32_t base = program.base;
+    const uint32_t count = static_cast<uint32_t>(program.code.size());
+    const uint32_t guardLo = stack.base - stack.limit - stack.guard;
+    const uint32_t guardSize = stack.guard;
+
+    LaneU regs[32];
+    LaneU pc = {};
+    LaneCount retired = {};
+    LaneU live = {};        // all ones for lanes still in the group
+    ExitReason reason[LOCKSTEP_LANES] = {};
+    struct { bool left; uint32_t addr, value, size; } evicted[LOCKSTEP_LANES] = {};
+
+    for (unsigned r = 0; r < 32; r++) {
+        regs[r] = LaneU{};
+        for (unsigned l = 0; l < n; l++) regs[r][l] = static_cast<uint32_t>(lanes[l].cpu->regFile[r]);
+    }
+    for (unsigned l = 0; l < n; l++) {
+        pc[l] = lanes[l].cpu->PC;
+        live[l] = ~0u;
+    }
+    regs[0] = LaneU{};
+
+    bool budgets = false;
+    for (unsigned l = 0; l < n; l++) budgets |= lanes[l].maxInstructions != UINT64_MAX;
+
+    const DecodedInstr* code = program.code.data();
+    uint64_t issues = 0, divergent = 0;
+
+    // Per-issue operations; 'm' is the mask of the lanes being issued to.
+#define WRITE_RD(v) do { if (d->rd) regs[d->rd] = blend(m, (v), regs[d->rd]); } while (0)
+#define NEXT() do { pc += m & splat(4); retired += ones(m); at += 4; } while (0)
+// The lane leaves the group; its PC stays where it is.
+#define STOP_LANE(l, why) do {                                            \
+        reason[l] = (why); live[l] = 0; m[l] = 0; converged = false;      \
+    } while (0)
+// 'taken' lanes continue at 'target', the other issued lanes at at + 4.
+// A converged group stays converged if all of it went the same way to the
+// same place ('uniform' is the target when it is the same for every lane).
+// The budget is checked on taken transfers that land in the program, as
+// in runThreaded().
+#define TRANSFER(target, taken, uniform) do {                             \
+        LaneU target_ = (target), taken_ = (taken);                       \
+        uint32_t uniform_ = (uniform);                                    \
+        pc = blend(taken_, target_, blend(m, pc + splat(4), pc));         \
+        retired += ones(m);                                          \
+        if (converged) {                                                  \
+            if (sameLanes(taken_, LaneU{})) {                             \
+                at += 4;                                                  \
+            } else if (uniform_ != UINT32_MAX && sameLanes(taken_, m)) {  \
+                at = uniform_;                                            \
+            } else {                                                      \
+                converged = false;                                        \
+            }                                                             \
+        }                                                                 \
+        if (budgets) {                                                    \
+            for (unsigned l = 0; l < n; l++) {                            \
+                uint32_t t_ = target_[l];                                 \
+                if (taken_[l] && (t_ & 0x3) == 0 && ((t_ - base) >> 2) < count && \
+                    retired[l] >= lanes[l].maxInstructions) {             \
+                    STOP_LANE(l, ExitReason::InstructionLimit);           \
+                }                                                         \
+            }                                                             \
+        }                                                                 \
+    } while (0)
+// Memory accesses and division run lane by lane. A lane whose access hits
+// the stack guard stops at this instruction.
+#define LOAD(expr) do {                                                   \
+        LaneU addr_ = a + imm, value_ = {};                               \
+        for (unsigned l = 0; l < n; l++) {                                \
+            if (!m[l]) continue;                                          \
+            uint32_t x = addr_[l];                                        \
+            if (x - guardLo < guardSize) { STOP_LANE(l, ExitReason::StackOverflow); continue; } \
+            GuestMemory& mem = lanes[l].cpu->memory;                      \
+            value_[l] = (expr);                                           \
+        }                                                                 \
+        WRITE_RD(value_);                                                 \
+        NEXT();                                                           \
+    } while (0)
+#define STORE(size, write) do {                                           \
+        LaneU addr_ = a + imm, leaving_ = {};                             \
+        for (unsigned l = 0; l < n; l++) {                                \
+            if (!m[l]) continue;                                          \
+            uint32_t x = addr_[l];                                        \
+            uint32_t value = b[l] & static_cast<uint32_t>((1ull << (8 * (size))) - 1); \
+            if (x - guardLo < guardSize) { STOP_LANE(l, ExitReason::StackOverflow); continue; } \
+            GuestMemory& mem = lanes[l].cpu->memory;                      \
+            write;                                                        \
+            if (program.mayTouchText(x) && storeHitsText(program, x, (size))) { \
+                evicted[l] = {true, x, value, (size)};                    \
+                leaving_[l] = ~0u;                                        \
+            }                                                             \
+        }                                                                 \
+        NEXT();                                                           \
+        if (!sameLanes(leaving_, LaneU{})) {                              \
+            live &= ~leaving_;                                            \
+            converged = false;                                            \
+        }                                                                 \
+    } while (0)
+#define DIVIDE(fn) do {                                                   \
+        LaneU value_ = {};                                                \
+        for (unsigned l = 0; l < n; l++) {                                \
+            value_[l] = static_cast<uint32_t>(fn(static_cast<int32_t>(a[l]), static_cast<int32_t>(b[l]))); \
+        }                                                                 \
+        WRITE_RD(value_);                                                 \
+        NEXT();                                                           \
+    } while (0)
+
+    // While 'converged', every running lane is at 'at' and the next issue
+    // needs no search. Only control transfers can split the group; they and
+    // lanes leaving the group clear it.
+    uint32_t at = 0;
+    bool converged = false;
+    for (;;) {
+        LaneU m;
+        if (converged) {
+            m = live;
+        } else {
+            // Issue the lowest PC; the lanes at any other PC are masked off.
+            at = UINT32_MAX;
+            bool any = false;
+            for (unsigned l = 0; l < n; l++) {
+                if (live[l] && pc[l] <= at) {
+                    at = pc[l];
+                    any = true;
+                }
+            }
+            if (!any) break;
+            m = live & lanesWhere(pc == splat(at));
+            converged = sameLanes(m, live);
+            if (!converged) divergent++;
+        }
+        uint32_t index = (at - base) >> 2;
+        if ((at & 0x3) || index >= count || !code[index].valid) {
+            for (unsigned l = 0; l < n; l++) {
+                if (m[l]) reason[l] = ExitReason::EndOfProgram;
+            }
+            live &= ~m;
+            converged = false;
+            continue;
+        }
+        const DecodedInstr* d = code + index;
+        issues++;
+
+        const LaneU a = regs[d->rs1];
+        const LaneU b = regs[d->rs2];
+        const LaneU imm = splat(static_cast<uint32_t>(d->imm));
+        switch (d->op) {
+            // ---- R-type ----
+            case OP_ADD:  WRITE_RD(a + b); NEXT(); break;
+            case OP_SUB:  WRITE_RD(a - b); NEXT(); break;
+            case OP_SLL:  WRITE_RD(a << (b & splat(0x1F))); NEXT(); break;
+            case OP_SLT:  WRITE_RD(lanesWhere(asSigned(a) < asSigned(b)) & splat(1)); NEXT(); break;
+            case OP_SLTU: WRITE_RD(lanesWhere(a < b) & splat(1)); NEXT(); break;
+            case OP_XOR:  WRITE_RD(a ^ b); NEXT(); break;
+            case OP_SRL:  WRITE_RD(a >> (b & splat(0x1F))); NEXT(); break;
+            case OP_SRA:  WRITE_RD(asUnsigned(asSigned(a) >> asSigned(b & splat(0x1F)))); NEXT(); break;
+            case OP_OR:   WRITE_RD(a | b); NEXT(); break;
+            case OP_AND:  WRITE_RD(a & b); NEXT(); break;
+            case OP_MUL:  WRITE_RD(a * b); NEXT(); break;
+            case OP_DIV:  DIVIDE(signedDiv); break;
+            case OP_REM:  DIVIDE(signedRem); break;
+
+            // ---- I-type arithmetic ----
+            case OP_ADDI:  WRITE_RD(a + imm); NEXT(); break;
+            case OP_SLTI:  WRITE_RD(lanesWhere(asSigned(a) < asSigned(imm)) & splat(1)); NEXT(); break;
+            case OP_SLTIU: WRITE_RD(lanesWhere(a < imm) & splat(1)); NEXT(); break;
+            case OP_XORI:  WRITE_RD(a ^ imm); NEXT(); break;
+            case OP_ORI:   WRITE_RD(a | imm); NEXT(); break;
+            case OP_ANDI:  WRITE_RD(a & imm); NEXT(); break;
+            case OP_SLLI:  WRITE_RD(a << d->rs2); NEXT(); break;
+            case OP_SRLI:  WRITE_RD(a >> d->rs2); NEXT(); break;
+            case OP_SRAI:  WRITE_RD(asUnsigned(asSigned(a) >> d->rs2)); NEXT(); break;
+
+            // ---- Loads and stores ----
+            case OP_LB:  LOAD(static_cast<uint32_t>(static_cast<int8_t>(mem.read8(x)))); break;
+            case OP_LH:  LOAD(static_cast<uint32_t>(static_cast<int16_t>(mem.read16(x)))); break;
+            case OP_LW:  LOAD(mem.read32(x)); break;
+            case OP_LBU: LOAD(mem.read8(x)); break;
+            case OP_LHU: LOAD(mem.read16(x)); break;
+            case OP_SB:  STORE(1, mem.write8(x, value)); break;
+            case OP_SH:  STORE(2, mem.write16(x, value)); break;
+            case OP_SW:  STORE(4, mem.write32(x, value)); break;
+
+            // ---- Branches ----
+            case OP_BEQ:  TRANSFER(splat(at + d->imm), m & lanesWhere(a == b), at + d->imm); break;
+            case OP_BNE:  TRANSFER(splat(at + d->imm), m & lanesWhere(a != b), at + d->imm); break;
+            case OP_BLT:  TRANSFER(splat(at + d->imm), m & lanesWhere(asSigned(a) <  asSigned(b)), at + d->imm); break;
+            case OP_BGE:  TRANSFER(splat(at + d->imm), m & lanesWhere(asSigned(a) >= asSigned(b)), at + d->imm); break;
+            case OP_BLTU: TRANSFER(splat(at + d->imm), m & lanesWhere(a <  b), at + d->imm); break;
+            case OP_BGEU: TRANSFER(splat(at + d->imm), m & lanesWhere(a >= b), at + d->imm); break;
+
+            // ---- U-type and jumps ----
+            case OP_LUI:   WRITE_RD(imm); NEXT(); break;
+            case OP_AUIPC: WRITE_RD(splat(at + d->imm)); NEXT(); break;
+            case OP_JAL:
+                WRITE_RD(splat(at + 4));
+                TRANSFER(splat(at + d->imm), m, at + d->imm);
+                break;
+            case OP_JALR: {
+                LaneU target = (a + imm) & splat(~1u);   // read rs1 before writing rd
+                WRITE_RD(splat(at + 4));
+                TRANSFER(target, m, UINT32_MAX);
+                break;
+            }
+
+            // ---- Stops ----
+            case OP_HALT:
+                for (unsigned l = 0; l < n; l++) {
+                    if (m[l]) STOP_LANE(l, ExitReason::Halt);
+                }
+                break;
+            default:
+                for (unsigned l = 0; l < n; l++) {
+                    if (m[l]) STOP_LANE(l, ExitReason::Illegal);
+                }
+                break;
+        }
+    }
+
+#undef WRITE_RD
+#undef NEXT
+#undef STOP_LANE
+#undef TRANSFER
+#undef LOAD
+#undef STORE
+#undef DIVIDE
+
+    stats.issues += issues;
+    stats.divergentIssues += divergent;
+
+    for (unsigned l = 0; l < n; l++) {
+        CPU& cpu = *lanes[l].cpu;
+        for (unsigned r = 0; r < 32; r++) cpu.regFile[r] = static_cast<int32_t>(regs[r][l]);
+        cpu.PC = pc[l];
+        cpu.clock += retired[l];
+        lanes[l].reason = reason[l];
+        uint64_t before = cpu.clock;
+        if (evicted[l].left) {
+            stats.evicted++;
+            lanes[l].reason = finishAlone(program, lanes[l], stack, retired[l],
+                                          evicted[l].addr, evicted[l].value, evicted[l].size);
+        }
+        stats.laneInstructions += retired[l] + (cpu.clock - before);
+    }
+}
+
+#endif // RV_LANE_VECTORS
+
+} // namespace
+
+void runLockstep(const Program& program, std::vector<LockstepLane>& lanes,
+                 const StackConfig& stack, LockstepStats* statsOut) {
+    LockstepStats stats;
+#ifdef RV_LANE_VECTORS
+    for (size_t first = 0; first < lanes.size(); first += LOCKSTEP_LANES) {
+        unsigned n = static_cast<unsigned>(std::min<size_t>(LOCKSTEP_LANES, lanes.size() - first));
+        runGroup(program, &lanes[first], n, stack, stats);
+    }
+#else
+    for (LockstepLane& lane : lanes) {
+        uint64_t before = lane.cpu->clock;
+        lane.reason = finishAlone(program, lane, stack, 0);
+        stats.laneInstructions += lane.cpu->clock - before;
+    }
+#endif
+    if (statsOut) *statsOut = stats;
+}
@@ -0,0 +1,49 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <vector>
+#include "cpu.h"
+#include "simulator.h"
+
+// Lockstep (SIMD) engine: many instances of one program on one shared
+// predecoded instruction stream.
+//
+// Lanes run in groups of LOCKSTEP_LANES. A group keeps its register file
+// structure-of-arrays, one 8 x 32-bit vector per guest register, so an ALU
+// instruction is one vector operation for all lanes (a single AVX2
+// instruction when built with -mavx2). Each step issues the instruction at
+// the lowest PC among the group's running lanes, masked to the lanes that
+// are at that PC; lanes that branched elsewhere wait and rejoin the group
+// when the others reach their PC. Loads, stores and division run lane by
+// lane, each lane on its own CPU::memory.
+//
+// A store into the program text would give a lane its own instruction
+// stream, so such a lane leaves the group after the store and finishes on
+// the threaded engine with a private copy of the Program.
+//
+// The vector types are a GCC/Clang extension; other compilers run every
+// lane on the threaded engine instead.
+
+constexpr unsigned LOCKSTEP_LANES = 8;
+
+struct LockstepLane {
+    CPU* cpu = nullptr;                   // registers, PC and memory of this instance
+    uint64_t maxInstructions = UINT64_MAX; // budget, with runThreaded()'s semantics
+    ExitReason reason = ExitReason::EndOfProgram;  // set by runLockstep()
+};
+
+struct LockstepStats {
+    uint64_t issues = 0;            // instructions issued to a group
+    uint64_t laneInstructions = 0;  // instructions retired summed over lanes
+    uint64_t divergentIssues = 0;   // issues that left some running lane masked off
+    uint64_t evicted = 0;           // lanes that left lockstep after a text store
+};
+
+// Runs every lane to its stop. Registers, PC, clock and memory of each lane
+// end up as runThreaded() would leave them; lanes[i].reason is why lane i
+// stopped.
+void runLockstep(const Program& program, std::vector<LockstepLane>& lanes,
+                 const StackConfig& stack, LockstepStats* stats = nullptr);
+
+#endif
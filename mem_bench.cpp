@@ -0,0 +1,95 @@
+// Microbenchmark: guest memory accesses per second.
+//
+// Compares the old byte-per-node std::map segment against the paged and
+// flat (mmap) GuestMemory backends on the access patterns the simulators
+// generate: sequential word stores/loads over an array, and scattered word
+// loads.
+//
+// Build: g++ -O2 mem_bench.cpp guest_memory.cpp -o mem_bench
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include "guest_memory.h"
+
+// The original MemSegment from phase3Simulator.cpp (one map node per byte).
+class ByteMapMemory {
+public:
+    std::map<uint32_t, uint8_t> memory;
+
+    void writeWord(uint32_t address, int32_t value) {
+        for (int i = 0; i < 4; i++) {
+            memory[address + i] = static_cast<uint8_t>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    int32_t readWord(uint32_t address) const {
+        int32_t result = 0;
+        for (int i = 0; i < 4; i++) {
+            auto it = memory.find(address + i);
+            uint8_t b = (it != memory.end()) ? it->second : 0;
+            result |= (b << (8 * i));
+        }
+        return result;
+    }
+};
+
+// Adapters so every memory can run through the same benchmark loop.
+struct PagedMemory {
+    GuestMemory mem;
+    void writeWord(uint32_t address, int32_t value) { mem.write32(address, static_cast<uint32_t>(value)); }
+    int32_t readWord(uint32_t address) const { return static_cast<int32_t>(mem.read32(address)); }
+};
+
+struct FlatMemory : PagedMemory {
+    FlatMemory() {
+        if (!mem.useFlatBackend()) std::cout << "(mmap reservation failed, flat row is paged)\n";
+    }
+};
+
+static constexpr uint32_t BASE   = 0x10000000;
+static constexpr uint32_t WORDS  = 64 * 1024;   // 256 KiB working set
+static constexpr int      PASSES = 8;
+
+template <typename Mem>
+void runBench(const std::string &name) {
+    Mem mem;
+    uint64_t accesses = 0;
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int pass = 0; pass < PASSES; pass++) {
+        // Sequential store then load, like the array loop in input.asm.
+        for (uint32_t i = 0; i < WORDS; i++) {
+            mem.writeWord(BASE + 4 * i, static_cast<int32_t>(i + pass));
+        }
+        for (uint32_t i = 0; i < WORDS; i++) {
+            checksum += mem.readWord(BASE + 4 * i);
+        }
+        // Scattered loads (LCG over the working set).
+        uint32_t x = 12345u + pass;
+        for (uint32_t i = 0; i < WORDS; i++) {
+            x = x * 1664525u + 1013904223u;
+            checksum += mem.readWord(BASE + 4 * (x % WORDS));
+        }
+        accesses += 3ull * WORDS;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::left << std::setw(14) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(1)
+              << (accesses / secs / 1e6) << " M accesses/s"
+              << "   (" << accesses << " accesses in " << std::setprecision(3) << secs
+              << " s, checksum 0x" << std::hex << checksum << std::dec << ")\n";
+}
+
+int main() {
+    std::cout << "Guest memory microbenchmark: " << WORDS * 4 / 1024 << " KiB working set, "
+              << PASSES << " passes\n";
+    runBench<ByteMapMemory>("std::map byte");
+    runBench<PagedMemory>("paged");
+    runBench<FlatMemory>("flat (mmap)");
+    return 0;
+}
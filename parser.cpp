@@ -8,6 +8,7 @@
 #include "parser.h"
 #include "symbol_table.h"
 #include "converter.h"
+#include "isa.h"
 
 using namespace std;
 
@@ -44,30 +45,24 @@ void parseInstructionFields(const std::string& line, std::string& line_name,
     istringstream iss(line);
     iss >> opcode;  // Read the opcode first
 
-    // R-format instructions
-    if (opcode == "add" || opcode == "sub" || opcode == "xor" || 
-        opcode == "or"  || opcode == "and" || opcode == "sll" || 
-        opcode == "slt" || opcode == "sra" || opcode == "srl" ||
-        opcode == "mul" || opcode == "div" || opcode == "rem")
+    // Operand syntax follows the format in the ISA table (isa.h); an
+    // unknown mnemonic leaves the format empty.
+    const IsaEntry* entry = isaFind(opcode);
+    if (!entry)
+        return;
+    format = isaFormatName(entry->format);
+
+    // R-format instructions: "add rd, rs1, rs2"
+    if (entry->format == InstrFormat::R)
     {
-        format = "R";
         iss >> rd >> rs1 >> rs2;
         if (!rd.empty() && rd.back() == ',') rd.pop_back();
         if (!rs1.empty() && rs1.back() == ',') rs1.pop_back();
         if (!rs2.empty() && rs2.back() == ',') rs2.pop_back();
     }
-    // I-format for addi, andi, ori, and jalr (written as "jalr rd rs1 immediate")
-    else if (opcode == "addi" || opcode == "andi" || opcode == "ori" || opcode == "jalr")
-    {
-        format = "I";
-        iss >> rd >> rs1 >> immediate;
-        if (!rd.empty() && rd.back() == ',') rd.pop_back();
-        if (!rs1.empty() && rs1.back() == ',') rs1.pop_back();
-    }
     // I-format for load instructions with offset(rs1) syntax.
-    else if (opcode == "lb" || opcode == "lh" || opcode == "lw" || opcode == "ld")
+    else if (entry->format == InstrFormat::I && entry->latency == Latency::Load)
     {
-        format = "I";
         string rdStr, addressStr;
         iss >> rdStr >> addressStr;
         if (!rdStr.empty() && rdStr.back() == ',') rdStr.pop_back();
@@ -80,10 +75,16 @@ void parseInstructionFields(const std::string& line, std::string& line_name,
         }
         rd = rdStr;
     }
-    // S-format instructions: sb, sh, sw, sd (with offset(rs1) syntax).
-    else if (opcode == "sb" || opcode == "sh" || opcode == "sw" || opcode == "sd")
+    // Other I-format instructions, jalr included (written as "jalr rd rs1 immediate")
+    else if (entry->format == InstrFormat::I)
+    {
+        iss >> rd >> rs1 >> immediate;
+        if (!rd.empty() && rd.back() == ',') rd.pop_back();
+        if (!rs1.empty() && rs1.back() == ',') rs1.pop_back();
+    }
+    // S-format instructions (with offset(rs1) syntax).
+    else if (entry->format == InstrFormat::S)
     {
-        format = "S";
         string rs2Str, addressStr;
         iss >> rs2Str >> addressStr;
         if (!rs2Str.empty() && rs2Str.back() == ',') rs2Str.pop_back();
@@ -96,19 +97,17 @@ void parseInstructionFields(const std::string& line, std::string& line_name,
         }
         rs2 = rs2Str;
     }
-    // SB-format instructions: beq, bne, blt, bge (e.g., "beq rs1, rs2, label")
-    else if (opcode == "beq" || opcode == "bne" || opcode == "blt" || opcode == "bge")
+    // SB-format instructions (e.g., "beq rs1, rs2, label")
+    else if (entry->format == InstrFormat::SB)
     {
-        format = "SB";
         iss >> rs1 >> rs2 >> immediate;
         cout << "Immediate: " << immediate << endl;
         if (!rs1.empty() && rs1.back() == ',') rs1.pop_back();
         if (!rs2.empty() && rs2.back() == ',') rs2.pop_back();
     }
     // U-format instructions: lui, auipc.
-    else if (opcode == "lui" || opcode == "auipc")
+    else if (entry->format == InstrFormat::U)
     {
-        format = "U";
         iss >> rd >> immediate;
         if (immediate[1] != 'x')
         {
@@ -120,9 +119,8 @@ void parseInstructionFields(const std::string& line, std::string& line_name,
         if (!rd.empty() && rd.back() == ',') rd.pop_back();
     }
     // UJ-format instructions: jal.
-    else if (opcode == "jal")
+    else if (entry->format == InstrFormat::UJ)
     {
-        format = "UJ";
         iss >> rd >> immediate;
         if (!rd.empty() && rd.back() == ',') rd.pop_back();
     }
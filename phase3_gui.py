@@ -1,6 +1,5 @@
 import sys
-import json
-import subprocess
+import pipesim
 from PyQt5.QtWidgets import (
     QApplication, QWidget, QVBoxLayout, QHBoxLayout,
     QPushButton, QLabel, QTableWidget, QTableWidgetItem,
@@ -55,6 +54,9 @@ class MainWindow(QWidget):
         super().__init__()
         self.setWindowTitle("RISC-V Pipeline Simulator GUI")
         self.resize(1200, 800)
+        self.sim = None           # pipesim.PipelineSim, created on the first click
+        self.prev_state = None
+        self.prev_stats = None
         self._build_ui()
 
     def _build_ui(self):
@@ -168,37 +170,84 @@ class MainWindow(QWidget):
             pred = pht.get(pc_str, 0)
             self.btb_table.add_entry([pc_str, tgt_str, pred])
 
-    def _run_simulator(self):
-        exe = 'simulator3.exe' if sys.platform.startswith('win') else './simulator3'
-        try:
-            proc = subprocess.run(
-                [exe, 'output.mc', '--json'],
-                capture_output=True, text=True, check=True
-            )
-            lines = [l for l in proc.stdout.splitlines() if l.strip()]
-            return [json.loads(l) for l in lines]
-        except subprocess.CalledProcessError as e:
-            QMessageBox.critical(self, "Simulation Error", e.stderr)
-            return []
+    def _ensure_sim(self):
+        # One simulator in this process, advanced a cycle per Step.
+        if self.sim is None:
+            try:
+                self.sim = pipesim.PipelineSim('output.mc')
+            except (OSError, RuntimeError) as e:
+                QMessageBox.critical(self, "Simulation Error", str(e))
+                return False
+            self.prev_state = self.sim.state()
+            self.prev_stats = self.sim.stats()
+        return True
 
-    @pyqtSlot()
-    def on_step(self):
-        all_cycles = self._run_simulator()
-        if not all_cycles:
-            return
-        data = all_cycles[0]
+    @staticmethod
+    def _latch_text(latch):
+        return f"0x{latch.pc:x}: 0x{latch.ir:08x}" if latch.valid else '---'
+
+    def _snapshot(self):
+        # The state after the last cycle, in the shape the views expect.
+        state = self.sim.state()
+        stats = self.sim.stats()
+        latches = state.latches
+        pipeline = {
+            'IF': self._latch_text(latches[pipesim.IF_ID]),
+            'ID': self._latch_text(latches[pipesim.ID_EX]),
+            'EX': self._latch_text(latches[pipesim.EX_MEM]),
+            'MEM': self._latch_text(latches[pipesim.MEM_WB]),
+            # written back this cycle: what MEM/WB held after the previous one
+            'WB': self._latch_text(self.prev_state.latches[pipesim.MEM_WB]),
+        }
+
+        hazards = []
+        if stats.data_hazard_stalls > self.prev_stats.data_hazard_stalls:
+            hazards.append({'type': 'RAW', 'stage': 'ID'})
+        if stats.control_hazard_stalls > self.prev_stats.control_hazard_stalls:
+            hazards.append({'type': 'control', 'stage': 'ID'})
+
+        forwarding = []
+        fwd = state.forwarding
+        if fwd & (pipesim.FWD_RA_FROM_EX_MEM | pipesim.FWD_RB_FROM_EX_MEM | pipesim.FWD_RM_FROM_EX_MEM):
+            forwarding.append({'from': 'MEM', 'to': 'EX'})
+        if fwd & (pipesim.FWD_RA_FROM_MEM_WB | pipesim.FWD_RB_FROM_MEM_WB | pipesim.FWD_RM_FROM_MEM_WB):
+            forwarding.append({'from': 'WB', 'to': 'EX'})
+        if fwd & pipesim.FWD_EX_MEM_RM_FROM_MEM_WB:
+            forwarding.append({'from': 'WB', 'to': 'MEM'})
+
+        pht = {f"0x{pc:x}": int(taken) for pc, taken in self.sim.predictor()}
+        btb = {f"0x{pc:x}": f"0x{target:x}" for pc, target in self.sim.btb()}
+
+        self.prev_state = state
+        self.prev_stats = stats
+        return {
+            'pipeline': pipeline,
+            'hazards': hazards,
+            'forwarding': forwarding,
+            'predictor': {'PHT': pht, 'BTB': btb},
+        }
+
+    def _show(self, data):
         self._clear_forwarding()
         self._update_blocks_and_table(data)
         self._draw_forwarding(data['forwarding'])
         self._update_predictor(data)
 
+    @pyqtSlot()
+    def on_step(self):
+        if not self._ensure_sim():
+            return
+        if self.sim.step() == 0:
+            QMessageBox.information(self, "Simulation", "The pipeline has drained.")
+            return
+        self._show(self._snapshot())
+
     @pyqtSlot()
     def on_run(self):
-        for data in self._run_simulator():
-            self._clear_forwarding()
-            self._update_blocks_and_table(data)
-            self._draw_forwarding(data['forwarding'])
-            self._update_predictor(data)
+        if not self._ensure_sim():
+            return
+        while self.sim.step() == 1:
+            self._show(self._snapshot())
 
 
 if __name__ == '__main__':
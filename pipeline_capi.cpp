@@ -0,0 +1,192 @@
+#include "pipeline_capi.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+#include <vector>
+#include "pipeline_sim.h"
+
+// The handle behind the C interface: one PipelineSim. Every entry point
+// catches C++ exceptions so that none crosses into the caller's language.
+struct pipesim {
+    PipelineSim sim;
+};
+
+namespace {
+
+void copyLatch(pipesim_latch &out, uint32_t pc, uint32_t ir, bool valid,
+               const PipelineSim::DecodedInstr &d, int32_t a, int32_t b, int32_t c) {
+    out.pc = pc;
+    out.ir = ir;
+    out.values[0] = a;
+    out.values[1] = b;
+    out.values[2] = c;
+    out.valid = valid ? 1 : 0;
+    out.rd = static_cast<uint8_t>(d.rd);
+    out.reg_write = d.regWrite ? 1 : 0;
+    out.mem_read = d.memRead ? 1 : 0;
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t pipesim_abi_version(void) {
+    return PIPESIM_ABI_VERSION;
+}
+
+pipesim *pipesim_create(void) {
+    return new (std::nothrow) pipesim();
+}
+
+void pipesim_destroy(pipesim *sim) {
+    delete sim;
+}
+
+int pipesim_load(pipesim *sim, const char *mc_path) {
+    if (!sim || !mc_path) return -1;
+    try {
+        return sim->sim.load(mc_path) ? 0 : -1;
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << mc_path << ": " << e.what() << "\n";
+        return -1;
+    }
+}
+
+int pipesim_restore(pipesim *sim, const char *checkpoint_path) {
+    if (!sim || !checkpoint_path) return -1;
+    try {
+        uint64_t instructions;
+        if (!sim->sim.restoreCheckpoint(checkpoint_path, instructions)) return -1;
+        sim->sim.resetStats();
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << checkpoint_path << ": " << e.what() << "\n";
+        return -1;
+    }
+}
+
+int pipesim_set_knob(pipesim *sim, int knob, int value) {
+    if (!sim) return -1;
+    PipelineSim &s = sim->sim;
+    switch (knob) {
+        case 2: s.Knob2 = value != 0; return 0;
+        case 3: s.Knob3 = value != 0; return 0;
+        case 4: s.Knob4 = value != 0; return 0;
+        case 5:
+            s.Knob5 = value != 0;
+            s.Knob5InstructionNumber = value;
+            return 0;
+        case 6: s.Knob6 = value != 0; return 0;
+        case 7: s.Knob7 = value != 0; return 0;
+        default: return -1;
+    }
+}
+
+uint64_t pipesim_step(pipesim *sim, uint64_t cycles) {
+    if (!sim) return 0;
+    try {
+        return sim->sim.step(cycles);
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 0;
+    }
+}
+
+void pipesim_get_state(const pipesim *sim, pipesim_state *out) {
+    if (!sim || !out) return;
+    *out = pipesim_state();
+    PipelineState s;
+    try {
+        s = sim->sim.state();
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return;
+    }
+    out->cycle = s.cycle;
+    out->pc = s.pc;
+    out->halted = s.halted ? 1 : 0;
+    out->stall = s.stall ? 1 : 0;
+    for (int i = 0; i < PipelineSim::NUM_REGS; i++) {
+        out->regs[i] = s.regs[i];
+    }
+
+    const PipelineSim::ID_EX &ie = s.id_ex;
+    uint16_t fwd = 0;
+    if (ie.forwardRAFromEX_MEM) fwd |= PIPESIM_FWD_RA_FROM_EX_MEM;
+    if (ie.forwardRAFromMEM_WB) fwd |= PIPESIM_FWD_RA_FROM_MEM_WB;
+    if (ie.forwardRBFromEX_MEM) fwd |= PIPESIM_FWD_RB_FROM_EX_MEM;
+    if (ie.forwardRBFromMEM_WB) fwd |= PIPESIM_FWD_RB_FROM_MEM_WB;
+    if (ie.forwardRMFromEX_MEM) fwd |= PIPESIM_FWD_RM_FROM_EX_MEM;
+    if (ie.forwardRMFromMEM_WB) fwd |= PIPESIM_FWD_RM_FROM_MEM_WB;
+    if (s.ex_mem.forwardRMFromMEM_WB) fwd |= PIPESIM_FWD_EX_MEM_RM_FROM_MEM_WB;
+    out->forwarding = fwd;
+
+    // IF/ID has not been decoded yet: only PC and IR are meaningful.
+    copyLatch(out->latches[PIPESIM_IF_ID], s.if_id.PC, s.if_id.IR, s.if_id.valid,
+              PipelineSim::DecodedInstr{}, 0, 0, 0);
+    copyLatch(out->latches[PIPESIM_ID_EX], ie.PC, ie.IR, ie.valid, ie.d, ie.RA, ie.RB, ie.RM);
+    copyLatch(out->latches[PIPESIM_EX_MEM], s.ex_mem.PC, s.ex_mem.IR, s.ex_mem.valid, s.ex_mem.d,
+              s.ex_mem.RZ, s.ex_mem.RM, 0);
+    copyLatch(out->latches[PIPESIM_MEM_WB], s.mem_wb.PC, s.mem_wb.IR, s.mem_wb.valid, s.mem_wb.d,
+              s.mem_wb.RY, 0, 0);
+}
+
+void pipesim_get_stats(const pipesim *sim, pipesim_stats *out) {
+    if (!sim || !out) return;
+    PipelineStats s = sim->sim.stats();
+    out->cycles = s.cycles;
+    out->instructions = s.instructions;
+    out->data_transfer = s.dataTransfer;
+    out->alu = s.alu;
+    out->control = s.control;
+    out->stalls = s.stalls;
+    out->data_hazards = s.dataHazards;
+    out->control_hazards = s.controlHazards;
+    out->mispredictions = s.mispredictions;
+    out->data_hazard_stalls = s.dataHazardStalls;
+    out->control_hazard_stalls = s.controlHazardStalls;
+}
+
+size_t pipesim_get_predictor(const pipesim *sim, pipesim_predictor_entry *out, size_t capacity) {
+    if (!sim) return 0;
+    try {
+        const auto &table = sim->sim.predictorTable();
+        if (out && capacity > 0) {
+            std::vector<std::pair<uint32_t, bool>> entries(table.begin(), table.end());
+            std::sort(entries.begin(), entries.end());
+            size_t n = std::min(capacity, entries.size());
+            for (size_t i = 0; i < n; i++) {
+                out[i] = pipesim_predictor_entry();
+                out[i].pc = entries[i].first;
+                out[i].taken = entries[i].second ? 1 : 0;
+            }
+        }
+        return table.size();
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 0;
+    }
+}
+
+size_t pipesim_get_btb(const pipesim *sim, pipesim_btb_entry *out, size_t capacity) {
+    if (!sim) return 0;
+    const BranchTargetBuffer &btb = sim->sim.branchTargetBuffer();
+    try {
+        if (out && capacity > 0) {
+            std::vector<std::pair<uint32_t, uint32_t>> entries;
+            btb.forEach([&entries](uint32_t pc, uint32_t target) { entries.emplace_back(pc, target); });
+            std::sort(entries.begin(), entries.end());
+            size_t n = std::min(capacity, entries.size());
+            for (size_t i = 0; i < n; i++) {
+                out[i].pc = entries[i].first;
+                out[i].target = entries[i].second;
+            }
+        }
+        return btb.size();
+    } catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 0;
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,139 @@
+#ifndef PIPELINE_CAPI_H
+#define PIPELINE_CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of the pipelined simulator (PipelineSim), built as a shared
+ * library for front ends in other languages (pipesim.py, the Python
+ * wrapper used by phase3_gui.py):
+ *
+ *   g++ -std=c++17 -O2 -fPIC -shared pipeline_capi.cpp pipeline_sim.cpp \
+ *       branch_predictor.cpp checkpoint.cpp guest_memory.cpp -o libpipesim.so
+ *
+ * A pipesim handle owns one independent simulator. Nothing here throws or
+ * prints on success; failures return -1 (or NULL) and the reason is
+ * printed to stderr. The structs only ever grow at the end, and
+ * pipesim_abi_version() changes whenever their layout does.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define PIPESIM_API __declspec(dllexport)
+#else
+#define PIPESIM_API __attribute__((visibility("default")))
+#endif
+
+#define PIPESIM_ABI_VERSION 1
+
+typedef struct pipesim pipesim;
+
+/* Pipeline buffers, in pipesim_state.latches[] */
+enum {
+    PIPESIM_IF_ID = 0,
+    PIPESIM_ID_EX = 1,
+    PIPESIM_EX_MEM = 2,
+    PIPESIM_MEM_WB = 3
+};
+
+/* Forwarding paths selected for the instructions in ID/EX and EX/MEM */
+enum {
+    PIPESIM_FWD_RA_FROM_EX_MEM = 1 << 0,
+    PIPESIM_FWD_RA_FROM_MEM_WB = 1 << 1,
+    PIPESIM_FWD_RB_FROM_EX_MEM = 1 << 2,
+    PIPESIM_FWD_RB_FROM_MEM_WB = 1 << 3,
+    PIPESIM_FWD_RM_FROM_EX_MEM = 1 << 4,
+    PIPESIM_FWD_RM_FROM_MEM_WB = 1 << 5,
+    PIPESIM_FWD_EX_MEM_RM_FROM_MEM_WB = 1 << 6     /* store data of EX/MEM */
+};
+
+/* One pipeline buffer. values[] holds RA, RB, RM for ID/EX; RZ, RM for
+ * EX/MEM; RY for MEM/WB; unused entries are 0. */
+typedef struct {
+    uint32_t pc;
+    uint32_t ir;
+    int32_t values[3];
+    uint8_t valid;
+    uint8_t rd;
+    uint8_t reg_write;
+    uint8_t mem_read;
+} pipesim_latch;
+
+/* Machine state at the end of the last cycle */
+typedef struct {
+    uint64_t cycle;                 /* clock cycles run */
+    uint32_t pc;                    /* next fetch address */
+    uint8_t halted;                 /* the pipeline has drained */
+    uint8_t stall;                  /* stall signal carried into the next cycle */
+    uint16_t forwarding;            /* PIPESIM_FWD_* bits */
+    int32_t regs[32];
+    pipesim_latch latches[4];
+} pipesim_state;
+
+/* Counters Stat1..Stat12 of the command-line simulator */
+typedef struct {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t data_transfer;
+    uint64_t alu;
+    uint64_t control;
+    uint64_t stalls;
+    uint64_t data_hazards;
+    uint64_t control_hazards;
+    uint64_t mispredictions;
+    uint64_t data_hazard_stalls;
+    uint64_t control_hazard_stalls;
+} pipesim_stats;
+
+/* One entry of the branch prediction table */
+typedef struct {
+    uint32_t pc;
+    uint8_t taken;
+    uint8_t reserved[3];
+} pipesim_predictor_entry;
+
+/* One entry of the branch target buffer */
+typedef struct {
+    uint32_t pc;
+    uint32_t target;
+} pipesim_btb_entry;
+
+PIPESIM_API uint32_t pipesim_abi_version(void);
+
+/* A new simulator with an empty machine, or NULL if out of memory. */
+PIPESIM_API pipesim *pipesim_create(void);
+PIPESIM_API void pipesim_destroy(pipesim *sim);
+
+/* Replace the machine with an .mc program / a checkpoint (checkpoint.h);
+ * the counters start again from zero. Return 0, or -1 on an unreadable file. */
+PIPESIM_API int pipesim_load(pipesim *sim, const char *mc_path);
+PIPESIM_API int pipesim_restore(pipesim *sim, const char *checkpoint_path);
+
+/* Sets Knob2..Knob7 of the README; for knob 5 'value' is the instruction
+ * number to trace (0 turns it off). Returns -1 for an unknown knob. */
+PIPESIM_API int pipesim_set_knob(pipesim *sim, int knob, int value);
+
+/* Runs up to 'cycles' clock cycles; returns the number run (fewer once
+ * the pipeline drains). */
+PIPESIM_API uint64_t pipesim_step(pipesim *sim, uint64_t cycles);
+
+/* Fill 'out'; on failure the state is left zeroed. */
+PIPESIM_API void pipesim_get_state(const pipesim *sim, pipesim_state *out);
+PIPESIM_API void pipesim_get_stats(const pipesim *sim, pipesim_stats *out);
+
+/* Copies up to 'capacity' predictor entries, in PC order, to 'out' and
+ * returns the total number of entries (0 if the copy fails). */
+PIPESIM_API size_t pipesim_get_predictor(const pipesim *sim, pipesim_predictor_entry *out, size_t capacity);
+
+/* The same for the valid entries of the branch target buffer. */
+PIPESIM_API size_t pipesim_get_btb(const pipesim *sim, pipesim_btb_entry *out, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
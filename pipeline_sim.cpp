@@ -0,0 +1,1339 @@
+#include "pipeline_sim.h"
+#include <algorithm>  // for std::sort
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "checkpoint.h"
+#include "trace.h"
+
+namespace {
+
+// Helper: signExtend, getBits
+inline uint32_t getBits(uint32_t val, int hi, int lo) {
+    uint32_t mask = (1u << (hi - lo + 1)) - 1;
+    return (val >> lo) & mask;
+}
+
+inline int32_t signExtend(uint32_t value, int bitCount) {
+    int shift = 32 - bitCount;
+    return (int32_t)((int32_t)(value << shift) >> shift);
+}
+
+using DecodedInstr = PipelineSim::DecodedInstr;
+
+// Function to detect RAW hazards
+template <bool Verbose>
+bool detectRAWHazard(const DecodedInstr &decodedInstr, const PipelineSim::EX_MEM &ex_mem, const PipelineSim::MEM_WB &mem_wb) {
+    Trace<Verbose> trace;
+    // Check if source registers in decoded instruction (rs1, rs2) match destination registers in EX/MEM or MEM/WB
+    if (ex_mem.valid && ex_mem.d.regWrite && ex_mem.d.rd != 0) { // Check EX/MEM only if valid
+        if (decodedInstr.rs1 == ex_mem.d.rd) {
+            trace << "[RAW Hazard] Dependency detected with EX stage. rs1=" << decodedInstr.rs1
+                      << " matches rd=" << ex_mem.d.rd << "\n";
+            return true; // Hazard with EX stage
+        }
+        if (decodedInstr.rs2 == ex_mem.d.rd) {
+            trace << "[RAW Hazard] Dependency detected with EX stage. rs2=" << decodedInstr.rs2
+                      << " matches rd=" << ex_mem.d.rd << "\n";
+            return true; // Hazard with EX stage
+        }
+    }
+    if (mem_wb.valid && mem_wb.d.regWrite && mem_wb.d.rd != 0) { // Check MEM/WB only if valid
+        if (decodedInstr.rs1 == mem_wb.d.rd) {
+            trace << "[RAW Hazard] Dependency detected with MEM stage. rs1=" << decodedInstr.rs1
+                      << " matches rd=" << mem_wb.d.rd << "\n";
+            return true; // Hazard with MEM stage
+        }
+        if (decodedInstr.rs2 == mem_wb.d.rd) {
+            trace << "[RAW Hazard] Dependency detected with MEM stage. rs2=" << decodedInstr.rs2
+                      << " matches rd=" << mem_wb.d.rd << "\n";
+            return true; // Hazard with MEM stage
+        }
+    }
+    return false; // No hazard
+}
+
+// Control circuitry function: the control bundle of the instruction's ISA
+// table entry (isa.h); unknown instructions get all signals cleared.
+void controlCircuitry(const DecodedInstr &d, DecodedInstr &controlSignals) {
+    PipelineControl c = (d.isa == ISA_NONE) ? PipelineControl() : PIPELINE_CONTROLS[d.isa];
+    controlSignals.regWrite = c.regWrite;
+    controlSignals.memRead = c.memRead;
+    controlSignals.memWrite = c.memWrite;
+    controlSignals.branch = c.branch;
+    controlSignals.jump = c.jump;
+    controlSignals.memToReg = c.memToReg;
+    controlSignals.memSize = c.memSize;
+    controlSignals.memSignExtend = c.memSignExtend;
+    controlSignals.aluOp = c.aluOp;
+    controlSignals.halt = c.halt;
+}
+
+// ALU of the EX stage (also used by the functional fast-forward).
+// LUI/AUIPC pass their immediate through; branches compare RA and RB so that
+// a zero result means "taken".
+inline int32_t aluCompute(const DecodedInstr &d, uint32_t pc, int32_t RA, int32_t RB) {
+    switch (d.aluOp) {
+        case ALU_ADD: return RA + RB;
+        case ALU_SUB: return RA - RB;
+        case ALU_MUL: return RA * RB;
+        case ALU_DIV: return signedDiv(RA, RB);
+        case ALU_REM: return signedRem(RA, RB);
+        case ALU_AND: return RA & RB;
+        case ALU_OR:  return RA | RB;
+        case ALU_XOR: return RA ^ RB;
+        case ALU_SLL: return RA << (RB & 0x1F);
+        case ALU_SRL: return static_cast<int32_t>(static_cast<uint32_t>(RA) >> (RB & 0x1F));
+        case ALU_SRA: return RA >> (RB & 0x1F);
+        case ALU_SLT: return (RA < RB) ? 1 : 0;
+        case ALU_EQ:  return (RA == RB) ? 1 : 0;
+        case ALU_GE:  return (RA >= RB) ? 1 : 0;
+        case ALU_SLTU: return (static_cast<uint32_t>(RA) < static_cast<uint32_t>(RB)) ? 1 : 0;
+        case ALU_GEU:  return (static_cast<uint32_t>(RA) >= static_cast<uint32_t>(RB)) ? 1 : 0;
+        case ALU_PASS:
+            if (d.opcode == 0x17)     // AUIPC
+                return pc + d.imm;
+            return d.imm;             // LUI
+        default: return 0;
+    }
+}
+
+// isTerminationInstr
+bool isTerminationInstr(uint32_t instr) {
+    return (instr == 0x00000000);
+}
+
+// Function to print unresolved dependencies
+void printUnresolvedDependencies(const std::multiset<uint32_t> &dependencies) {
+    std::cout << "Unresolved Dependencies: ";
+    if (dependencies.empty()) {
+        std::cout << "None";
+    } else {
+        for (const auto &dep : dependencies) {
+            std::cout << "R[" << dep << "] ";
+        }
+    }
+    std::cout << "\n";
+}
+
+} // namespace
+
+// Dumping memory to an .mc file
+//   - Writes each 4-byte aligned address in ascending order
+//   - Only writes non-zero words from pages that have been allocated
+//   - Skips addresses outside the intended segment's range
+
+// Every cycle (or on HALT) you call these to write out the contents of each segment
+//and the instruction memory, four-byte aligned, into text files (data.mc, stack.mc, instruction.mc).
+void PipelineSim::dumpSegmentToFile(const std::string &filename,
+                                    const MemSegment &seg,
+                                    uint32_t startAddr,
+                                    uint32_t endAddr /* exclusive */)
+{
+    // Open file for overwrite
+    std::ofstream fout(filename);
+    if (!fout.is_open()) {
+        std::cerr << "ERROR: Could not open/create " << filename << "\n";
+        return;
+    }
+
+    // Write every non-zero word of the segment that lies inside
+    // [startAddr, endAddr). Pages that were never written are skipped.
+    uint32_t lo = std::max(startAddr, seg.startAddr);
+    uint32_t hi = seg.endAddr;
+    if (endAddr > startAddr) {
+        hi = std::min(hi, endAddr - 1);
+    }
+    seg.memory.forEachWord(lo, hi, [&](uint32_t addr, uint32_t wordVal) {
+        fout << std::hex << "0x"
+             << std::setw(8) << std::setfill('0') << addr << "  0x"
+             << std::setw(8) << std::setfill('0') << wordVal
+             << std::dec << "\n";
+    });
+
+    fout.close();
+}
+
+void PipelineSim::dumpMemory() const {
+    dumpSegmentToFile("data.mc",  dataSegment, 0x10000000,    STACK_THRESHOLD);
+    dumpSegmentToFile("stack.mc", stackSegment, STACK_THRESHOLD, 0xFFFFFFFF);
+}
+
+// Dumping the instruction memory (which is map<uint32_t, uint32_t>)
+// to instruction.mc; the map is already in address order.
+void PipelineSim::dumpInstructionMemory(const std::string &filename) const {
+    std::ofstream fout(filename);
+    if (!fout.is_open()) {
+        std::cerr << "ERROR: Could not open/create " << filename << "\n";
+        return;
+    }
+
+    for (const auto &kv : instrMemory) {
+        // each entry is already a full 32-bit instruction
+        fout << std::hex
+             << "0x" << std::setw(8) << std::setfill('0') << kv.first
+             << "  0x" << std::setw(8) << std::setfill('0') << kv.second
+             << std::dec << "\n";
+    }
+    fout.close();
+}
+
+// decode
+PipelineSim::DecodedInstr PipelineSim::decode(uint32_t instr) const {
+    DecodedInstr d{};
+    d.opcode = getBits(instr, 6, 0);
+    d.rd     = getBits(instr, 11, 7);
+    d.funct3 = getBits(instr, 14, 12);
+    d.rs1    = getBits(instr, 19, 15);
+
+    // Only R-, S- and SB-format instructions read rs2
+    InstrFormat format = ISA_FORMATS[d.opcode];
+    if(format == InstrFormat::R) d.funct7 = getBits(instr, 31, 25);
+    if(format == InstrFormat::R || format == InstrFormat::S || format == InstrFormat::SB) d.rs2 = getBits(instr, 24, 20);
+
+    // Default control signals
+    d.regWrite = false;
+    d.memRead = false;
+    d.memWrite = false;
+    d.branch = false;
+    d.jump = false;
+    d.aluOp = ALU_PASS;
+    d.memToReg = 0;
+    d.memSize = 2; // Default to word
+    d.memSignExtend = false;
+    d.zero = false;
+
+    // Decode immediate by the format of the opcode
+    switch (format) {
+        case InstrFormat::I: // I-type ALU, LOAD, JALR
+            d.imm = signExtend(getBits(instr, 31, 20), 12);
+            break;
+        case InstrFormat::S: { // S-type
+            uint32_t imm12 = (getBits(instr, 31, 25) << 5) | getBits(instr, 11, 7);
+            d.imm = signExtend(imm12, 12);
+        } break;
+        case InstrFormat::SB: { // SB-type
+            uint32_t immAll = (getBits(instr, 31, 31) << 12) | (getBits(instr, 7, 7) << 11)
+                            | (getBits(instr, 30, 25) << 5) | (getBits(instr, 11, 8) << 1);
+            d.imm = signExtend(immAll, 13);
+        } break;
+        case InstrFormat::U: // LUI, AUIPC
+            d.imm = (int32_t)(getBits(instr, 31, 12) << 12);
+            break;
+        case InstrFormat::UJ: { // UJ-type (JAL)
+            uint32_t immAll = (getBits(instr, 31, 31) << 20) | (getBits(instr, 19, 12) << 12)
+                            | (getBits(instr, 20, 20) << 11) | (getBits(instr, 30, 21) << 1);
+            d.imm = signExtend(immAll, 21);
+        } break;
+        default:
+            d.imm = 0;
+            break;
+    }
+    d.aluSrcImm = (format == InstrFormat::I || format == InstrFormat::S);
+    d.isa = ISA_DECODE[isaKey(d.opcode, d.funct3, getBits(instr, 31, 25))];
+
+    // Set RA, RB, RM based on the instruction type
+    d.RA = R[d.rs1];
+    d.RB = d.aluSrcImm ? d.imm : R[d.rs2];
+    d.RM = R[d.rs2];
+
+    return d;
+}
+
+// storeInitialWord: put one word of a loaded file where it belongs
+void PipelineSim::storeInitialWord(uint32_t address, uint32_t word) {
+    if (address < 0x10000000) {
+        // instructions
+        instrMemory[address] = word;
+    }
+    else if (address < STACK_THRESHOLD) {
+        // data
+        dataSegment.writeWord(address, static_cast<int32_t>(word));
+    }
+    else {
+        // stack
+        // (we'll treat address >= 0x7FFFFFFF as stack region)
+        stackSegment.writeWord(address, static_cast<int32_t>(word));
+    }
+}
+
+// load: read addresses from the .mc file and distribute them
+//   - <0x10000000 => instrMemory
+//   - [0x10000000, 0x7FFFFFFF) => dataSegment
+//   - >=0x7FFFFFFF => stackSegment
+bool PipelineSim::load(const std::string &filename) {
+    std::ifstream fin(filename);
+    if (!fin.is_open()) {
+        std::cerr << "ERROR: Could not open " << filename << "\n";
+        return false;
+    }
+
+    // Start from a fresh machine
+    instrMemory.clear();
+    guestMemory.clear();
+    predictor->reset();
+    btb.reset();
+    ras.reset();
+    branchPredictionTable.clear();
+    branchPredictionTableStale = false;
+    MDR = 0;
+    MAR = 0;
+    clockCycle = 0;
+    resetStats();
+
+    std::string line;
+    while (std::getline(fin, line)) {
+        // remove comments
+        size_t cpos = line.find('#');
+        if (cpos != std::string::npos) {
+            line = line.substr(0, cpos);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        std::stringstream ss(line);
+        std::string addrStr, dataStr;
+        ss >> addrStr >> dataStr;
+        if(dataStr[0] == '<' || dataStr[0] == 't')continue;
+        if (addrStr.empty() || dataStr.empty()) {
+            continue;
+        }
+
+        // remove trailing comma
+        size_t commaPos = dataStr.find(',');
+        if (commaPos != std::string::npos) {
+            dataStr = dataStr.substr(0, commaPos);
+        }
+
+        try {
+            uint32_t address = std::stoul(addrStr, nullptr, 16);
+            uint32_t word    = std::stoul(dataStr, nullptr, 16);
+            storeInitialWord(address, word);
+        }
+        catch (...) {
+            std::cerr << "Parsing error on line: " << line << "\n";
+            continue;
+        }
+    }
+    fin.close();
+
+    // Initialize registers
+    for (int i = 0; i < NUM_REGS; i++) {
+        R[i] = 0;
+    }
+    R[2] = STACK_BASE;   // x2 = SP
+    PC = 0;
+    fastForwardStale = true;
+    enterPipeline();
+    return true;
+}
+
+// Updated Memory Processor Interface
+//   Data and stack share guestMemory, so once an address is known not to be
+//   instruction memory (below dataSegment, not accessible) the access goes
+//   straight to guestMemory and its software TLB; no per-access segment
+//   dispatch is needed.
+void PipelineSim::memoryProcessorInterface(uint32_t &MAR, int32_t &MDR, int32_t RM, bool memRead, bool memWrite, uint8_t memSize, bool memSignExtend) {
+    if (MAR < dataSegment.startAddr) return; // Instruction memory: not accessible
+    GuestMemory* mem = &guestMemory;
+
+    if (memRead) {
+        // Perform memory read based on size and store the result in MDR
+        switch (memSize) {
+            case 0: // Byte
+                MDR = memSignExtend
+                      ? static_cast<int8_t>(mem->read8(MAR))
+                      : static_cast<uint8_t>(mem->read8(MAR));
+                break;
+            case 1: // Halfword
+                MDR = memSignExtend
+                      ? static_cast<int16_t>(mem->read16(MAR))
+                      : static_cast<uint16_t>(mem->read16(MAR));
+                break;
+            case 2: // Word
+                MDR = static_cast<int32_t>(mem->read32(MAR));
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (memWrite) {
+        // Perform memory write using RM
+        switch (memSize) {
+            case 0: // Byte
+                mem->write8(MAR, RM & 0xFF);
+                break;
+            case 1: // Halfword
+                mem->write16(MAR, RM & 0xFFFF);
+                break;
+            case 2: // Word
+                mem->write32(MAR, static_cast<uint32_t>(RM));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void PipelineSim::setPredictor(const BranchPredictorConfig &config) {
+    predictor = BranchPredictor::create(config);
+    branchPredictionTable.clear();
+    branchPredictionTableStale = false;
+}
+
+void PipelineSim::setBranchTargets(const BranchTargetConfig &config) {
+    btb = BranchTargetBuffer(config.btbEntries, config.btbWays);
+    ras = ReturnAddressStack(config.rasEntries);
+}
+
+// Drops the instruction in IF/ID, fetched down a wrong path, and undoes
+// what its fetch did to the return address stack.
+void PipelineSim::flushFetched() {
+    if (if_id.valid && if_id.targetSource != TARGET_NONE) {
+        ras.restore(if_id.ras);
+    }
+    if_id.valid = false;
+}
+
+// Function to predict branch outcome
+BranchPrediction PipelineSim::predictBranch(uint32_t pc) const {
+    return predictor->predict(pc);
+}
+
+// Function to update branch prediction table
+void PipelineSim::updateBranchPrediction(uint32_t pc, bool actualOutcome, const BranchPrediction &prediction) {
+    predictor->update(pc, actualOutcome, prediction); // Train with the actual outcome
+    branchPredictionTable.emplace(pc, false);
+    branchPredictionTableStale = true;
+}
+
+// A global history or aliasing can change the prediction of any branch, so
+// the whole table is recomputed, and only when someone looks at it.
+const std::unordered_map<uint32_t, bool> &PipelineSim::predictorTable() const {
+    if (branchPredictionTableStale) {
+        for (auto &entry : branchPredictionTable) {
+            entry.second = predictor->predict(entry.first).taken;
+        }
+        branchPredictionTableStale = false;
+    }
+    return branchPredictionTable;
+}
+
+// Updated Print Registers
+void PipelineSim::printRegisters() const {
+    std::cout << "Register File:\n";
+    for (int i = 0; i < NUM_REGS; i++) {
+        std::cout << "R[" << std::dec << i << "]=" << std::dec << R[i] << "   "; // Register number in decimal
+        if ((i + 1) % 4 == 0) std::cout << "\n";
+    }
+    std::cout << "-------------------------------------\n";
+    std::cout << "PC = 0x" << std::hex << PC
+              << "  RA=0x" << RA << "  RB=0x" << RB << "  RM=0x" << RM << "\n";
+    std::cout << "RZ=0x" << RZ << "  RY=0x" << RY << "  MDR=0x" << MDR << "\n";
+    std::cout << "===========================================\n";
+}
+
+// Function to print the contents of pipeline buffers
+void PipelineSim::printPipelineBuffers() const {
+    std::cout << "================ Pipeline Buffers ================\n";
+
+    // IF/ID Buffer
+    if (if_id.valid) {
+        std::cout << "IF/ID: PC=0x" << std::hex << if_id.PC << " IR=0x" << if_id.IR
+                  << " Valid=1\n";
+    } else if (if_id.PC == 0 && if_id.IR == 0) {
+        std::cout << "IF/ID: Empty\n";
+    } else {
+        std::cout << "IF/ID: Bubble (Valid=0)\n";
+    }
+
+    // ID/EX Buffer
+    if (id_ex.valid) {
+        std::cout << "ID/EX: PC=0x" << std::hex << id_ex.PC << " IR=0x" << id_ex.IR
+                  << " RA=" << id_ex.RA << " RB=" << id_ex.RB << " RM=" << id_ex.RM
+                  << " Valid=1\n";
+    } else if (id_ex.PC == 0 && id_ex.IR == 0) {
+        std::cout << "ID/EX: Empty\n";
+    } else {
+        std::cout << "ID/EX: Bubble (Valid=0)\n";
+    }
+
+    // EX/MEM Buffer
+    if (ex_mem.valid) {
+        std::cout << "EX/MEM: PC=0x" << std::hex << ex_mem.PC << " IR=0x" << ex_mem.IR
+                  << " RZ=" << ex_mem.RZ << " RM=" << ex_mem.RM
+                  << " Valid=1\n";
+    } else if (ex_mem.PC == 0 && ex_mem.IR == 0) {
+        std::cout << "EX/MEM: Empty\n";
+    } else {
+        std::cout << "EX/MEM: Bubble (Valid=0)\n";
+    }
+
+    // MEM/WB Buffer
+    if (mem_wb.valid) {
+        std::cout << "MEM/WB: PC=0x" << std::hex << mem_wb.PC << " IR=0x" << mem_wb.IR
+                  << " RY=" << mem_wb.RY
+                  << " Valid=1\n";
+    } else if (mem_wb.PC == 0 && mem_wb.IR == 0) {
+        std::cout << "MEM/WB: Empty\n";
+    } else {
+        std::cout << "MEM/WB: Bubble (Valid=0)\n";
+    }
+
+    std::cout << "=================================================\n";
+}
+
+// Function to print branch prediction unit content.
+// Also counts every "taken" entry as a misprediction (Stat10), so the silent
+// instantiation still walks the table.
+template <bool Verbose>
+void PipelineSim::printBranchPredictionUnit() {
+    Trace<Verbose> trace;
+    trace << "Branch Prediction Unit:\n";
+    for (const auto &entry : predictorTable()) {
+        trace << "PC=0x" << std::hex << entry.first
+                  << " Prediction=" << (entry.second ? "Taken" : "Not Taken") << "\n";
+        if(entry.second) {
+            branchMispredictions++; // Increment mispredictions if prediction was taken
+            trace << "No of branch mispredictions till now: " << branchMispredictions << "\n";
+        }
+    }
+    if constexpr (Verbose) {
+        btb.forEach([&](uint32_t pc, uint32_t target) {
+            trace << "BTB PC=0x" << std::hex << pc << " Target=0x" << target << "\n";
+        });
+    }
+    trace << "-------------------------------------\n";
+}
+
+// Pre-update dependencies before any stage begins
+template <bool Verbose>
+void PipelineSim::preUpdateDependencies() {
+    Trace<Verbose> trace;
+    // Update ID/EX values from EX/MEM or MEM/WB
+    if (id_ex.valid) {
+        // A jump in EX/MEM writes its return address, not the ALU result
+        int32_t exMemResult = (ex_mem.d.memToReg == 2) ? static_cast<int32_t>(ex_mem.PC + 4) : ex_mem.RZ;
+        id_ex.RA = id_ex.d.RA; // Default to original RA
+        id_ex.RB = id_ex.d.RB; // Default to original RB
+        id_ex.RM = id_ex.d.RM; // Default to original RM
+
+        if (id_ex.forwardRAFromEX_MEM) {
+            id_ex.RA = exMemResult; // Forward RA from EX/MEM
+            trace << "[Forwarding] RZ = " << exMemResult << " to RA\n";
+        }  if (id_ex.forwardRAFromMEM_WB) {
+            id_ex.RA = mem_wb.RY; // Forward RA from MEM/WB
+            trace << "[Forwarding] RY = " << mem_wb.RY << " to RA\n";
+        }
+
+        if (id_ex.forwardRBFromEX_MEM) {
+            id_ex.RB = exMemResult; // Forward RB from EX/MEM
+            trace << "[Forwarding] RZ = " << exMemResult << " to RB\n";
+        }  if (id_ex.forwardRBFromMEM_WB) {
+            id_ex.RB = mem_wb.RY; // Forward RB from MEM/WB
+            trace << "[Forwarding] RY = " << mem_wb.RY << " to RB\n";
+        }
+
+        if (id_ex.forwardRMFromEX_MEM) {
+            id_ex.RM = exMemResult; // Forward RM from EX/MEM
+        }  if (id_ex.forwardRMFromMEM_WB) {
+            id_ex.RM = mem_wb.RY; // Forward RM from MEM/WB
+        }
+    }
+
+    // Update EX/MEM values from MEM/WB
+    if (ex_mem.valid) {
+        if (ex_mem.forwardRMFromMEM_WB) {
+            ex_mem.RM = mem_wb.RY; // Forward RM from MEM/WB
+        }
+    }
+}
+
+/*
+ * ===== One pipeline cycle. =====
+ *
+ * Instantiated twice: Verbose = true prints every stage, the pipeline
+ * buffers, the register file and dumps data.mc/stack.mc (the GUI reads
+ * these); Verbose = false has all of that compiled out (trace.h) and only
+ * updates state and statistics. The loops that run cycles (step, runUntil,
+ * runToRetire) pick the instantiation from setVerbose().
+ */
+template <bool Verbose>
+void PipelineSim::cycle() {
+    Trace<Verbose> trace;
+
+    // Function to check if all dependencies are resolved
+    auto areDependenciesResolved = [&]() {
+        return unresolvedDependencies.empty();
+    };
+
+    trace << "Clock Cycle: " << std::dec << clockCycle << "\n"; // Cycle number in decimal
+
+    // Increment total cycles
+    totalCycles++;
+
+    // Pre-update dependencies before any stage begins
+    preUpdateDependencies<Verbose>();
+
+    // Print branch prediction unit if Knob6 is enabled
+    if (Knob6) {
+        printBranchPredictionUnit<Verbose>();
+    }
+
+    // Print unresolved dependencies
+    if constexpr (Verbose) {
+        printUnresolvedDependencies(unresolvedDependencies);
+    }
+
+    // Write Back (MEM_WB)
+    if (mem_wb.valid) { // Write Back only if MEM_WB is valid
+        totalInstructions++; // Increment total instructions executed
+        if (mem_wb.d.memRead || mem_wb.d.memWrite) {
+            dataTransferInstructions++; // Increment data-transfer instructions
+        } else if (mem_wb.d.branch || mem_wb.d.jump) {
+            controlInstructions++; // Increment control instructions
+        } else {
+            aluInstructions++; // Increment ALU instructions
+        }
+
+        if (mem_wb.d.regWrite) {
+            trace << "[Write Back] Writing R[" << std::dec << mem_wb.d.rd << "] = " << mem_wb.RY << "\n"; // Register number in decimal
+            R[mem_wb.d.rd] = mem_wb.RY;
+            R[0] = 0; // Ensure x0 is always 0
+
+            // Remove resolved dependency
+            unresolvedDependencies.erase(mem_wb.d.rd);
+        }
+        if constexpr (Verbose) {
+            printUnresolvedDependencies(unresolvedDependencies); // Print unresolved dependencies after write-back
+        }
+
+        trace << "[Write Back] PC=0x" << std::hex << mem_wb.PC << " IR=0x" << mem_wb.IR << "\n";
+
+        // Check if all dependencies are resolved
+        if (stallSignal && areDependenciesResolved()) {
+            stallSignal = false; // Clear stall signal
+            trace << "[Write Back] All dependencies resolved. Resuming pipeline.\n";
+        }
+    } else if (mem_wb.IR == 0 && !mem_wb.valid) {
+        trace << "[Write Back] Bubble detected in MEM/WB.\n";
+    }
+
+    bool finalStallSignal = false;
+
+    // Memory Access (EX_MEM -> MEM_WB)
+    if (ex_mem.valid) { // Memory Access only if EX_MEM is valid
+        mem_wb.PC = ex_mem.PC;
+        mem_wb.IR = ex_mem.IR;
+        mem_wb.d = ex_mem.d;
+        mem_wb.valid = true;
+
+        // Set MAR to the address calculated by the ALU (RZ)
+        MAR = ex_mem.RZ;
+
+        // Use memoryProcessorInterface to handle LOAD/STORE
+        memoryProcessorInterface(MAR, MDR, ex_mem.RM, ex_mem.d.memRead, ex_mem.d.memWrite, ex_mem.d.memSize, ex_mem.d.memSignExtend);
+
+        // Ensure memRead is correctly used
+        if (ex_mem.d.memRead) {
+            trace << "[Memory Access] LOAD instruction: Reading data into MDR.\n";
+        }
+
+        // Determine the value of RY based on control signals
+        if (ex_mem.d.memToReg == 1) {
+            mem_wb.RY = MDR; // Load: Use data from memory
+        } else if (ex_mem.d.memToReg == 2) {
+            mem_wb.RY = ex_mem.PC + 4; // JAL/JALR: Use return address
+        } else {
+            mem_wb.RY = ex_mem.RZ; // Default: Use ALU result
+        }
+
+        trace << "[Memory Access] MAR=0x" << std::hex << MAR << " MDR=" << MDR << " RY=" << mem_wb.RY << "\n";
+    } else {
+        mem_wb.valid = false; // No valid instruction to access memory
+    }
+
+    bool updatePC_ex_mem = false; // Flag to indicate if PC should be updated
+    bool updatePC_id_ex = false; // Flag to indicate if PC should be updated in ID_EX
+    bool redirectFromDecode = false; // Branch resolved in decode was mispredicted (Knob7)
+    uint32_t decodeTarget = 0;       // Its correct next PC
+
+    // Execute (ID_EX -> EX_MEM)
+    if (id_ex.valid) { // Execute only if ID_EX is valid
+        ex_mem.PC = id_ex.PC;
+        ex_mem.IR = id_ex.IR;
+        ex_mem.d = id_ex.d;
+        ex_mem.valid = true;
+
+        // Perform ALU operation
+        ex_mem.RZ = aluCompute(id_ex.d, id_ex.PC, id_ex.RA, id_ex.RB);
+        ex_mem.RM = id_ex.RM;
+
+        // Restore zero signal functionality
+        id_ex.d.zero = (ex_mem.RZ == 0); // Set zero signal if ALU result is zero
+
+        // Resolve branch decision (unless decode already did)
+        if (id_ex.d.branch && !id_ex.d.jump && !id_ex.branchResolved) {
+            chdu.resolveBranch(id_ex.d.zero, id_ex.d); // Use zero signal for branch resolution
+            bool actualOutcome = chdu.branchTaken; // Actual branch outcome
+            bool predictedOutcome = id_ex.prediction.taken; // Predicted at fetch
+            branchLookups++;
+
+            if (actualOutcome == predictedOutcome) {
+                trace << "[Execute] Branch prediction was correct. Continuing pipeline.\n";
+            } else {
+                branchPredictorMisses++;
+                trace << "[Execute] Branch prediction was incorrect. Flushing the next instruction.\n";
+                flushFetched(); // Flush the instruction in IF/ID (next instruction)
+                PC = id_ex.PC + (actualOutcome ? id_ex.d.imm : 4); // Correct PC
+            }
+
+            // Update branch prediction table with the actual outcome
+            updateBranchPrediction(id_ex.PC, actualOutcome, id_ex.prediction);
+        }
+
+        // Check the target fetch took for a jump (JAL, JALR) and train the BTB
+        if (id_ex.d.jump) {
+            uint32_t target = (id_ex.d.opcode == 0x6F) ? id_ex.PC + id_ex.d.imm : (id_ex.RA + id_ex.d.imm) & ~1U;
+            jumpsResolved++;
+            if (id_ex.targetSource == TARGET_RAS) {
+                rasPredictions++;
+                if (id_ex.predictedPC == target) rasCorrect++;
+            } else {
+                btbLookups++;
+                if (id_ex.targetSource == TARGET_BTB) btbHits++;
+            }
+
+            if (id_ex.predictedPC == target) {
+                trace << "[Execute] Jump target was predicted. Continuing pipeline.\n";
+            } else {
+                jumpTargetMisses++;
+                trace << "[Execute] Jump target was mispredicted. Flushing the next instruction.\n";
+                flushFetched();
+                PC = target;
+            }
+            // Returns the RAS predicted stay out of the BTB's way.
+            if (id_ex.targetSource != TARGET_RAS) {
+                btb.update(id_ex.PC, target);
+            }
+        }
+
+        trace << "[Execute] RZ=" << ex_mem.RZ << " RM=" << ex_mem.RM << " Zero=" << id_ex.d.zero << "\n";
+    } else {
+        ex_mem.valid = false; // No valid instruction to execute
+    }
+
+    // Decode (IF_ID -> ID_EX)
+    if (!stallSignal && if_id.IR != 0 && if_id.valid) { // Decode only if no stall signal, IF_ID is valid, and IR is not empty
+        id_ex.PC = if_id.PC;
+        id_ex.IR = if_id.IR;
+        id_ex.prediction = if_id.prediction;
+        id_ex.predictedPC = if_id.predictedPC;
+        id_ex.targetSource = if_id.targetSource;
+        id_ex.branchResolved = false;
+        id_ex.d = decode(if_id.IR);
+
+        // Generate control signals using control circuitry
+        controlCircuitry(id_ex.d, id_ex.d);
+
+        // Ensure memRead is correctly toggled for LOAD instructions
+        if (id_ex.d.memRead) {
+            trace << "[Decode] LOAD instruction detected. memRead enabled.\n";
+        }
+
+        // Default forwarding control signals
+        id_ex.forwardRAFromEX_MEM = false;
+        id_ex.forwardRAFromMEM_WB = false;
+        id_ex.forwardRBFromEX_MEM = false;
+        id_ex.forwardRBFromMEM_WB = false;
+        id_ex.forwardRMFromEX_MEM = false;
+        id_ex.forwardRMFromMEM_WB = false;
+
+        // Check for RAW hazards (data dependencies)
+        bool rawHazard = detectRAWHazard<Verbose>(id_ex.d, ex_mem, mem_wb);
+
+        if (id_ex.d.halt) {
+            // Everything older has already been through EX, so nothing can
+            // redirect fetch any more: stop it here and let the rest drain.
+            haltDecoded = true;
+            PC = if_id.PC; // The final PC is the HALT's, as in the functional simulator
+            if_id.valid = false;
+            id_ex.valid = false; // HALT does not retire
+            trace << "[Decode] HALT instruction. Fetch stopped; draining the pipeline.\n";
+        } else if (Knob7 && id_ex.d.branch && !id_ex.d.jump && (Knob2 || !rawHazard)) {
+            // Early compare: a comparator in decode resolves the branch.
+            // Operands come from the register file (written back this
+            // cycle) or, with forwarding, from the instruction in MEM/WB.
+            // A result still in EX, or a load still reading memory, holds
+            // the branch in decode.
+            auto compareOperand = [&](uint32_t rs, int32_t &value) {
+                if (rs == 0) return true;
+                if (ex_mem.valid && ex_mem.d.regWrite && ex_mem.d.rd == rs) return false;
+                if (mem_wb.valid && mem_wb.d.regWrite && mem_wb.d.rd == rs) {
+                    if (mem_wb.d.memRead) return false;
+                    value = mem_wb.RY;
+                    trace << "[Forwarding] MEM/WB -> ID: Forwarding RY=" << mem_wb.RY << " to the branch comparator\n";
+                }
+                return true;
+            };
+            int32_t a = id_ex.d.RA;
+            int32_t b = id_ex.d.RB;
+            if (!compareOperand(id_ex.d.rs1, a) || !compareOperand(id_ex.d.rs2, b)) {
+                dataHazardStalls++; // Increment stalls due to data hazards
+                pipelineStalls++; // Increment pipeline stalls
+                branchOperandStalls++;
+                stallSignal = true; // Hold fetch; decode tries again next cycle
+                id_ex.valid = false; // Create a bubble in ID/EX
+                trace << "[Stall] Branch operands not ready for the decode comparator. Stalling Decode stage.\n";
+            } else {
+                bool actualOutcome = aluCompute(id_ex.d, id_ex.PC, a, b) == 0;
+                chdu.resolveBranch(actualOutcome, id_ex.d); // The comparator's result replaces the zero signal
+                branchLookups++;
+                if (actualOutcome == id_ex.prediction.taken) {
+                    trace << "[Decode] Branch resolved, prediction was correct. Continuing pipeline.\n";
+                } else {
+                    branchPredictorMisses++;
+                    controlHazards++; // Increment control hazards
+                    controlHazardStalls++; // Increment stalls due to control hazards
+                    pipelineStalls++; // Increment pipeline stalls
+                    redirectFromDecode = true; // Flush what fetch brings in this cycle
+                    decodeTarget = id_ex.PC + (actualOutcome ? id_ex.d.imm : 4);
+                    trace << "[Decode] Branch resolved, prediction was incorrect. Redirecting fetch.\n";
+                }
+                updateBranchPrediction(id_ex.PC, actualOutcome, id_ex.prediction);
+
+                id_ex.RA = a;
+                id_ex.RB = b;
+                id_ex.RM = id_ex.d.RM;
+                id_ex.branchResolved = true;
+                id_ex.valid = true; // Mark ID_EX as valid
+            }
+        } else if (rawHazard) {
+            if (Knob2) { // Data forwarding enabled
+                // Pick the youngest producer of each operand: EX/MEM holds the
+                // instruction one ahead, MEM/WB the one two ahead. RB takes a
+                // register only when the instruction has no immediate; a
+                // store's rs2 goes to RM instead.
+                auto inExMem = [&](uint32_t rs) {
+                    return rs != 0 && ex_mem.valid && ex_mem.d.regWrite && ex_mem.d.rd == rs;
+                };
+                auto inMemWb = [&](uint32_t rs) {
+                    return rs != 0 && mem_wb.valid && mem_wb.d.regWrite && mem_wb.d.rd == rs;
+                };
+
+                if (inExMem(id_ex.d.rs1)) {
+                    id_ex.forwardRAFromEX_MEM = true; // Signal to forward RA from EX/MEM
+                    trace << "[Forwarding] EX/MEM -> ID/EX: Forwarding RZ=" << ex_mem.RZ << " to RA\n";
+                } else if (inMemWb(id_ex.d.rs1)) {
+                    id_ex.forwardRAFromMEM_WB = true; // Signal to forward RA from MEM/WB
+                    trace << "[Forwarding] MEM/WB -> ID/EX: Forwarding RY=" << mem_wb.RY << " to RA\n";
+                }
+
+                if (!id_ex.d.aluSrcImm) {
+                    if (inExMem(id_ex.d.rs2)) {
+                        id_ex.forwardRBFromEX_MEM = true; // Signal to forward RB from EX/MEM
+                        trace << "[Forwarding] EX/MEM -> ID/EX: Forwarding RZ=" << ex_mem.RZ << " to RB\n";
+                    } else if (inMemWb(id_ex.d.rs2)) {
+                        id_ex.forwardRBFromMEM_WB = true; // Signal to forward RB from MEM/WB
+                        trace << "[Forwarding] MEM/WB -> ID/EX: Forwarding RY=" << mem_wb.RY << " to RB\n";
+                    }
+                }
+
+                // Forward RM for store instructions
+                if (id_ex.d.memWrite) {
+                    if (inExMem(id_ex.d.rs2)) {
+                        id_ex.forwardRMFromEX_MEM = true; // Signal to forward RM from EX/MEM
+                        trace << "[Forwarding] EX/MEM -> ID/EX: Forwarding RZ=" << ex_mem.RZ << " to RM\n";
+                    } else if (inMemWb(id_ex.d.rs2)) {
+                        id_ex.forwardRMFromMEM_WB = true; // Signal to forward RM from MEM/WB
+                        trace << "[Forwarding] MEM/WB -> ID/EX: Forwarding RY=" << mem_wb.RY << " to RM\n";
+                    }
+                }
+
+                // Handle load-use hazard (stall for one cycle)
+                // The loaded value only exists after MEM, so the consumer
+                // waits a cycle and then takes it from MEM/WB.
+                if (ex_mem.d.memRead && (inExMem(id_ex.d.rs1) || inExMem(id_ex.d.rs2))) {
+                    dataHazardStalls++; // Increment stalls due to data hazards
+                    pipelineStalls++; // Increment pipeline stalls
+                    stallSignal = true; // Stall the pipeline for one cycle
+                    finalStallSignal = true; // Set final stall signal
+                    id_ex.valid = false; // Create a bubble in ID/EX
+                    trace << "[Stall] Load-use hazard detected. Stalling pipeline for one cycle.\n";
+                } else {
+                    id_ex.valid = true; // Mark ID_EX as valid
+                }
+            } else { // Data forwarding disabled
+                dataHazards++; // Increment data hazards
+                dataHazardStalls++; // Increment stalls due to data hazards
+                pipelineStalls++; // Increment pipeline stalls
+                id_ex.valid = false; // Stall the decode stage
+                stallSignal = true; // Set stall signal
+                finalStallSignal = true; // Set final stall signal
+
+                // Add unresolved dependencies
+                if (ex_mem.valid && ex_mem.d.regWrite && ex_mem.d.rd != 0) {
+                    if (id_ex.d.rs1 == ex_mem.d.rd || id_ex.d.rs2 == ex_mem.d.rd) {
+                        unresolvedDependencies.insert(ex_mem.d.rd);
+                    }
+                }
+                if (mem_wb.valid && mem_wb.d.regWrite && mem_wb.d.rd != 0) {
+                    if (id_ex.d.rs1 == mem_wb.d.rd || id_ex.d.rs2 == mem_wb.d.rd) {
+                        unresolvedDependencies.insert(mem_wb.d.rd);
+                    }
+                }
+
+                trace << "[Stall] RAW hazard detected. Stalling Decode stage.\n";
+            }
+            trace << "RA:" << id_ex.RA << " RB:" << id_ex.RB << " RM:" << id_ex.RM << "\n";
+        } else {
+            chdu.checkControlHazard(id_ex.d);
+
+            if (chdu.stallPipeline) {
+                controlHazards++; // Increment control hazards
+                controlHazardStalls++; // Increment stalls due to control hazards
+                pipelineStalls++; // Increment pipeline stalls
+
+                // Forward branch data to ID/EX buffer
+                id_ex.RA = id_ex.d.RA;
+                id_ex.RB = id_ex.d.RB;
+                id_ex.RM = id_ex.d.RM;
+                id_ex.valid = true; // Mark ID_EX as valid
+                // stallSignal = true; // Set stall signal
+                finalStallSignal = true; // Set final stall signal
+                trace << "[Decode] Control hazard detected for conditional branch. Waiting for EX stage.\n";
+            } else if (chdu.flushPipeline && !id_ex.d.jump) { // Do not flush for JAL or JALR
+                branchMispredictions++; // Increment branch mispredictions
+                trace << "No of branch mispredictions: " << branchMispredictions << "\n";
+                trace << "[Decode] Flushing pipeline due to branch misprediction.\n";
+                id_ex.RA = id_ex.d.RA;
+                id_ex.RB = id_ex.d.RB;
+                id_ex.RM = id_ex.d.RM;
+                id_ex.valid = true; // Mark ID_EX as valid
+                if_id.valid = false; // Flush IF/ID
+                if (id_ex.d.branch) updatePC_id_ex = true; // Set flag to update PC
+            } else {
+                // Forward RA, RB, RM to ID_EX buffer if no stall or flush
+                id_ex.RA = id_ex.d.RA;
+                id_ex.RB = id_ex.d.RB;
+                id_ex.RM = id_ex.d.RM;
+                id_ex.valid = true; // Mark ID_EX as valid
+            }
+        }
+
+    } else if (stallSignal) {
+        // pipelineStalls++; // Increment pipeline stalls
+        // finalStallSignal = true; // Set final stall signal
+        trace << "[Decode] Stalled due to stall signal. Bubble created in ID_EX.\n";
+        id_ex.valid = false; // Create a bubble in ID_EX
+    } else {
+        id_ex.valid = false; // No valid instruction to decode
+    }
+
+    // Fetch (PC -> IF_ID) with Control Instruction Signal and Prediction
+    if (haltDecoded) {
+        trace << "[Fetch] Stopped by HALT.\n";
+    } else if (!stallSignal) { // Fetch only if no stall signal is detected
+        if(chdu.stallPipeline) {
+            stallSignal = true; // Set stall signal if control hazard detected
+            finalStallSignal = true; // Set final stall signal
+        }
+        auto it = instrMemory.find(PC);
+        if (it != instrMemory.end()) {
+            if_id.PC = PC;
+            if_id.IR = it->second;
+            if_id.valid = true; // Mark IF_ID as valid
+            if_id.targetSource = TARGET_NONE;
+
+            // Decode opcode to determine if the instruction is a control instruction
+            uint32_t opcode = getBits(if_id.IR, 6, 0);
+            if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) { // Branch, JAL, JALR
+                if_id.isControlInstr = true;
+
+                if (opcode == 0x6F || opcode == 0x67) { // JAL or JALR
+                    // A return takes its target from the RAS, any other
+                    // jump from the BTB; on a miss fetch goes on at PC + 4.
+                    DecodedInstr j = decode(if_id.IR);
+                    uint32_t target = PC + 4;
+                    if_id.ras = ras.snapshot();
+                    bool isReturn = opcode == 0x67 && j.rd == 0 && j.rs1 == 1 && j.imm == 0; // jalr x0, 0(ra)
+                    if (isReturn && ras.pop(target)) {
+                        if_id.targetSource = TARGET_RAS;
+                    } else if (btb.lookup(PC, target)) {
+                        if_id.targetSource = TARGET_BTB;
+                    } else {
+                        if_id.targetSource = TARGET_FALLTHROUGH;
+                    }
+                    if (j.rd == 1) {
+                        ras.push(PC + 4); // Call: jal ra / jalr ra
+                    }
+                    if_id.predictedPC = target;
+                    PC = target;
+                    trace << "[Fetch] Jump detected. PC predicted as 0x" << std::hex << PC << "\n";
+                } else if (opcode == 0x63) { // Conditional branch
+                    // Predict branch outcome
+                    if_id.prediction = predictBranch(PC);
+                    if (if_id.prediction.taken) {
+                        PC += decode(if_id.IR).imm; // Predicted taken: Update PC with offset
+                        trace << "[Fetch] Branch predicted taken. PC updated to 0x" << std::hex << PC << "\n";
+                    } else {
+                        PC += 4; // Predicted not taken: Increment PC
+                        trace << "[Fetch] Branch predicted not taken. PC updated to 0x" << std::hex << PC << "\n";
+                    }
+                }
+            } else {
+                if_id.isControlInstr = false; // Not a control instruction
+                PC += 4; // Increment PC for next instruction fetch
+            }
+
+            trace << "[Fetch] PC=0x" << std::hex << if_id.PC << " IR=0x" << if_id.IR
+                      << " isControlInstr=" << if_id.isControlInstr << "\n";
+        } else {
+            trace << "[Fetch] No valid instruction to fetch. IF_ID retains its content.\n";
+        }
+    } else {
+        trace << "[Fetch] Stalled due to stall signal. IF_ID retains its content.\n";
+    }
+
+    if (redirectFromDecode) {
+        flushFetched(); // The wrong-path instruction fetched this cycle
+        PC = decodeTarget;
+        trace << "[Decode] PC redirected to 0x" << std::hex << PC << "\n";
+    }
+
+    if(updatePC_ex_mem) {
+        if(ex_mem.d.branch) PC = ex_mem.PC + ex_mem.d.imm; // Update PC using EX_MEM
+        else PC = ex_mem.RZ; // Update PC using EX_MEM
+        if_id.valid = false; // Flush IF/ID
+    }
+    else if(updatePC_id_ex) {
+        PC = id_ex.PC + id_ex.d.imm; // Update PC using ID_EX
+        if_id.valid = false; // Flush IF/ID
+    }
+
+    stallSignal = finalStallSignal; // Update stall signal for the next cycle
+
+    // Check for termination condition
+    if ((if_id.IR == 0 || haltDecoded) && !id_ex.valid && !ex_mem.valid && !mem_wb.valid) {
+        trace << "[Termination] All pipeline buffers are empty. Halting simulation.\n";
+        currentState = HALT;
+    }
+
+    if constexpr (Verbose) {
+        // Dump memory segments to files every cycle
+        dumpMemory();
+
+        // Print pipeline buffers at the end of the cycle if Knob4 is enabled
+        if (Knob4) {
+            printPipelineBuffers();
+        }
+    }
+
+    // Print pipeline buffers for a specific instruction if Knob5 is enabled
+    if (Knob5) {
+        uint32_t targetPC = (Knob5InstructionNumber - 1) * 4; // Calculate PC for the specified instruction number
+
+        // Check IF/ID buffer
+        if (if_id.valid && if_id.PC == targetPC) {
+            trace << "[Knob5] Tracing IF/ID buffer for instruction number " << Knob5InstructionNumber << ":\n";
+            trace << "IF/ID: PC=0x" << std::hex << if_id.PC << " IR=0x" << if_id.IR << " Valid=1\n";
+        }
+
+        // Check ID/EX buffer
+        if (id_ex.valid && id_ex.PC == targetPC) {
+            trace << "[Knob5] Tracing ID/EX buffer for instruction number " << Knob5InstructionNumber << ":\n";
+            trace << "ID/EX: PC=0x" << std::hex << id_ex.PC << " IR=0x" << id_ex.IR
+                      << " RA=" << id_ex.RA << " RB=" << id_ex.RB << " RM=" << id_ex.RM << " Valid=1\n";
+        }
+
+        // Check EX/MEM buffer
+        if (ex_mem.valid && ex_mem.PC == targetPC) {
+            trace << "[Knob5] Tracing EX/MEM buffer for instruction number " << Knob5InstructionNumber << ":\n";
+            trace << "EX/MEM: PC=0x" << std::hex << ex_mem.PC << " IR=0x" << ex_mem.IR
+                      << " RZ=" << ex_mem.RZ << " RM=" << ex_mem.RM << " Valid=1\n";
+        }
+
+        // Check MEM/WB buffer
+        if (mem_wb.valid && mem_wb.PC == targetPC) {
+            trace << "[Knob5] Tracing MEM/WB buffer for instruction number " << Knob5InstructionNumber << ":\n";
+            trace << "MEM/WB: PC=0x" << std::hex << mem_wb.PC << " IR=0x" << mem_wb.IR
+                      << " RY=" << mem_wb.RY << " Valid=1\n";
+        }
+    }
+
+    // Print register file if Knob3 is enabled
+    if constexpr (Verbose) {
+        if (Knob3) {
+            printRegisters();
+        }
+    }
+
+    clockCycle++;
+}
+
+template void PipelineSim::cycle<true>();
+template void PipelineSim::cycle<false>();
+
+uint64_t PipelineSim::step(uint64_t cycles) {
+    uint64_t run = 0;
+    while (run < cycles && currentState != HALT) {
+        if (verbose) cycle<true>(); else cycle<false>();
+        run++;
+    }
+    return run;
+}
+
+void PipelineSim::runToRetire(uint64_t retireLimit) {
+    if (verbose) {
+        while (currentState != HALT && totalInstructions < retireLimit) cycle<true>();
+    } else {
+        while (currentState != HALT && totalInstructions < retireLimit) cycle<false>();
+    }
+}
+
+/*
+ * ===== Functional fast-forward. =====
+ *
+ * Executes instructions architecturally (registers, PC and guestMemory, no
+ * timing) with the same decode and ALU as the pipeline, so that sampled and
+ * checkpointed runs can skip the parts of a program they do not time.
+ */
+void PipelineSim::buildFastForwardText() {
+    FastForwardText &text = fastForwardText;
+    text = FastForwardText();
+    fastForwardStale = false;
+    if (instrMemory.empty()) return;
+    text.base = instrMemory.begin()->first & ~3U;
+    size_t size = ((instrMemory.rbegin()->first - text.base) >> 2) + 1;
+    text.code.resize(size);
+    text.valid.assign(size, false);
+    for (const auto &kv : instrMemory) {
+        if ((kv.first & 3) || isTerminationInstr(kv.second)) continue;
+        size_t index = (kv.first - text.base) >> 2;
+        text.code[index] = decode(kv.second);
+        controlCircuitry(text.code[index], text.code[index]);
+        text.valid[index] = !text.code[index].halt; // HALT ends the fast-forward like a zero word
+    }
+}
+
+uint64_t PipelineSim::fastForward(uint64_t count, bool &ended) {
+    if (fastForwardStale) {
+        buildFastForwardText();
+    }
+    const FastForwardText &text = fastForwardText;
+    uint64_t executed = 0;
+    while (executed < count) {
+        uint32_t offset = PC - text.base;
+        if ((offset & 3) || (offset >> 2) >= text.code.size() || !text.valid[offset >> 2]) {
+            ended = true;
+            break;
+        }
+        const DecodedInstr &in = text.code[offset >> 2];
+        int32_t a = R[in.rs1];
+        int32_t b = in.aluSrcImm ? in.imm : R[in.rs2];
+        uint32_t next = PC + 4;
+        int32_t result;
+
+        switch (in.opcode) {
+            case 0x6F: // JAL
+                result = PC + 4;
+                next = PC + in.imm;
+                break;
+            case 0x67: // JALR
+                result = PC + 4;
+                next = (a + in.imm) & ~1U;
+                break;
+            case 0x63: // BRANCH: taken when the ALU result is zero
+                result = 0;
+                if (aluCompute(in, PC, a, b) == 0) next = PC + in.imm;
+                break;
+            default:
+                result = aluCompute(in, PC, a, b);
+                break;
+        }
+
+        if (in.memRead || in.memWrite) {
+            MAR = result;
+            memoryProcessorInterface(MAR, MDR, R[in.rs2], in.memRead, in.memWrite, in.memSize, in.memSignExtend);
+            if (in.memRead) result = MDR;
+        }
+        if (in.regWrite) {
+            R[in.rd] = result;
+            R[0] = 0;
+        }
+        PC = next;
+        executed++;
+    }
+    return executed;
+}
+
+void PipelineSim::enterPipeline() {
+    if_id = IF_ID{};
+    id_ex = ID_EX{};
+    ex_mem = EX_MEM{};
+    mem_wb = MEM_WB{};
+    chdu = ControlHazardDetectionUnit();
+    stallSignal = false;
+    haltDecoded = false;
+    unresolvedDependencies.clear();
+    currentState = FETCH;
+}
+
+// The instruction in MEM/WB has done its memory access, so its write-back
+// is completed; the younger ones have not changed registers or memory yet,
+// so they are dropped and PC is set to the oldest of them.
+uint64_t PipelineSim::leavePipeline() {
+    uint64_t completed = 0;
+    if (mem_wb.valid) {
+        if (mem_wb.d.regWrite) {
+            R[mem_wb.d.rd] = mem_wb.RY;
+            R[0] = 0;
+        }
+        completed = 1;
+    }
+    if (ex_mem.valid) {
+        PC = ex_mem.PC;
+    } else if (id_ex.valid) {
+        PC = id_ex.PC;
+    } else if (if_id.valid) {
+        PC = if_id.PC;
+    }
+    enterPipeline();
+    return completed;
+}
+
+// The pipeline stops one instruction short, so that completing MEM/WB
+// cannot overshoot; the fast-forward makes up any rest.
+uint64_t PipelineSim::runToInstruction(uint64_t count) {
+    uint64_t start = totalInstructions;
+    if (count > 1) {
+        runToRetire(start + count - 1);
+    }
+    uint64_t done = totalInstructions - start;
+    if (currentState == HALT) {
+        return done;
+    }
+    done += leavePipeline();
+    if (done < count) {
+        bool ended = false;
+        done += fastForward(count - done, ended);
+    }
+    return done;
+}
+
+/*
+ * ===== Checkpoints (checkpoint.h). =====
+ *
+ * A checkpoint holds the instruction memory, PC, registers, guest memory
+ * and the branch prediction table (0 = not taken, 1 = taken). That is one
+ * bit per branch whatever the predictor: restoring seeds each branch's
+ * entries with it and starts with an empty history. Checkpoints of the
+ * functional simulator carry no predictor state; restoring one starts with
+ * an untrained predictor.
+ */
+bool PipelineSim::saveCheckpoint(const std::string &filename, uint64_t instructions) const {
+    Checkpoint state;
+    state.instructions = instructions;
+    state.pc = PC;
+    for (int i = 0; i < NUM_REGS; i++) {
+        state.regs[i] = R[i];
+    }
+    state.text = instrMemory;
+    for (const auto &entry : predictorTable()) {
+        state.predictor.emplace_back(entry.first, entry.second ? 1 : 0);
+    }
+    std::sort(state.predictor.begin(), state.predictor.end());
+    return ::saveCheckpoint(filename, state, guestMemory);
+}
+
+bool PipelineSim::restoreCheckpoint(const std::string &filename, uint64_t &instructions) {
+    Checkpoint state;
+    if (!loadCheckpoint(filename, state, guestMemory)) {
+        return false;
+    }
+    instrMemory = state.text;
+    fastForwardStale = true;
+    for (int i = 0; i < NUM_REGS; i++) {
+        R[i] = state.regs[i];
+    }
+    PC = state.pc;
+    predictor->reset();
+    btb.reset();
+    ras.reset();
+    branchPredictionTable.clear();
+    for (const auto &entry : state.predictor) {
+        predictor->seed(entry.first, entry.second != 0);
+        branchPredictionTable[entry.first] = entry.second != 0;
+    }
+    branchPredictionTableStale = true;
+    instructions = state.instructions;
+    enterPipeline();
+    return true;
+}
+
+PipelineState PipelineSim::state() const {
+    PipelineState s;
+    s.pc = PC;
+    for (int i = 0; i < NUM_REGS; i++) {
+        s.regs[i] = R[i];
+    }
+    s.cycle = clockCycle;
+    s.halted = currentState == HALT;
+    s.stall = stallSignal;
+    s.if_id = if_id;
+    s.id_ex = id_ex;
+    s.ex_mem = ex_mem;
+    s.mem_wb = mem_wb;
+    return s;
+}
+
+void PipelineSim::resetStats() {
+    totalCycles = 0;
+    totalInstructions = 0;
+    dataTransferInstructions = 0;
+    aluInstructions = 0;
+    controlInstructions = 0;
+    pipelineStalls = 0;
+    dataHazards = 0;
+    controlHazards = 0;
+    branchMispredictions = 0;
+    dataHazardStalls = 0;
+    controlHazardStalls = 0;
+    branchLookups = 0;
+    branchPredictorMisses = 0;
+    jumpsResolved = 0;
+    jumpTargetMisses = 0;
+    btbLookups = 0;
+    btbHits = 0;
+    rasPredictions = 0;
+    rasCorrect = 0;
+    branchOperandStalls = 0;
+}
+
+PipelineStats PipelineSim::stats() const {
+    PipelineStats s;
+    s.cycles = totalCycles;
+    s.instructions = totalInstructions;
+    s.dataTransfer = dataTransferInstructions;
+    s.alu = aluInstructions;
+    s.control = controlInstructions;
+    s.stalls = pipelineStalls;
+    s.dataHazards = dataHazards;
+    s.controlHazards = controlHazards;
+    s.mispredictions = branchMispredictions;
+    s.dataHazardStalls = dataHazardStalls;
+    s.controlHazardStalls = controlHazardStalls;
+    s.branches = branchLookups;
+    s.branchMisses = branchPredictorMisses;
+    s.jumps = jumpsResolved;
+    s.jumpMisses = jumpTargetMisses;
+    s.btbLookups = btbLookups;
+    s.btbHits = btbHits;
+    s.rasPredictions = rasPredictions;
+    s.rasCorrect = rasCorrect;
+    s.branchOperandStalls = branchOperandStalls;
+    return s;
+}
@@ -0,0 +1,448 @@
+#ifndef PIPELINE_SIM_H
+#define PIPELINE_SIM_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "branch_predictor.h"
+#include "guest_memory.h"
+#include "isa.h"
+
+// The five-stage pipeline simulator as a library.
+//
+// Everything one simulated machine needs (registers, pipeline buffers,
+// hazard state, branch predictor, instruction and guest memory, knobs and
+// statistics) lives in a PipelineSim object, so a process can hold any
+// number of independent simulators and drive them cycle by cycle:
+//
+//   PipelineSim sim;
+//   sim.load("output.mc");
+//   sim.step(100);                                     // 100 clock cycles
+//   sim.runUntil([](const PipelineSim &s) { return s.pc() == 0x40; });
+//   PipelineStats counters = sim.stats();
+//
+// phase3Simulator.cpp is the command-line front end on top of it. Tracing
+// (the per-cycle output of the interactive run, which also rewrites
+// data.mc/stack.mc every cycle for the GUI) is off until setVerbose(true);
+// the silent cycle has all of it compiled out (trace.h).
+
+// ─── Stack region split-point & base
+constexpr uint32_t STACK_THRESHOLD = 0x7FFF'FFFC;  // any addr ≥ this is stack
+constexpr uint32_t STACK_BASE      = STACK_THRESHOLD + 4; // initial SP = 0x8000_0000
+
+// Counters of a run, as printed by the simulator's Stat1..Stat12 and
+// Stat15..Stat19.
+struct PipelineStats {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t dataTransfer = 0;
+    uint64_t alu = 0;
+    uint64_t control = 0;
+    uint64_t stalls = 0;
+    uint64_t dataHazards = 0;
+    uint64_t controlHazards = 0;
+    uint64_t mispredictions = 0;
+    uint64_t dataHazardStalls = 0;
+    uint64_t controlHazardStalls = 0;
+    uint64_t branches = 0;          // conditional branches resolved
+    uint64_t branchMisses = 0;      // of those, predicted wrong at fetch
+    uint64_t jumps = 0;             // jal/jalr resolved in EX
+    uint64_t jumpMisses = 0;        // of those, fetched from the wrong target
+    uint64_t btbLookups = 0;        // jumps whose target came from the BTB
+    uint64_t btbHits = 0;
+    uint64_t rasPredictions = 0;    // returns whose target came from the RAS
+    uint64_t rasCorrect = 0;
+    uint64_t branchOperandStalls = 0; // decode waiting for a branch's operands (Knob7)
+};
+
+struct PipelineState;
+
+class PipelineSim {
+public:
+    static const int NUM_REGS = 32;
+
+    // DecodedInstr
+    struct DecodedInstr {
+        uint32_t opcode;
+        uint32_t rd;
+        uint32_t rs1;
+        uint32_t rs2;
+        uint32_t funct3;
+        uint32_t funct7;
+        int32_t  imm;
+        uint8_t  isa;       // ISA table index (isa.h), ISA_NONE if unknown
+
+        int32_t RA, RB, RM; // Operands
+
+        // Control signals
+        bool regWrite;      // Enable register write
+        bool memRead;       // Enable memory read
+        bool memWrite;      // Enable memory write
+        bool branch;        // Enable branch
+        bool jump;          // Enable jump
+        ALUOpType aluOp;    // ALU operation type
+        uint8_t memToReg;   // Select memory or ALU result for write-back
+        uint8_t memSize;    // Memory access size: 0=byte, 1=halfword, 2=word
+        bool memSignExtend; // Sign-extend memory read data
+        bool halt;          // Custom HALT: stop fetch and drain
+        bool aluSrcImm;     // ALU operand B is the immediate (I- and S-format)
+        bool zero;          // ALU zero signal (result is 0)
+    };
+
+    // Where fetch took the next PC of a jump from
+    enum TargetSource : uint8_t {
+        TARGET_NONE,        // not a jump
+        TARGET_FALLTHROUGH, // BTB miss: PC + 4
+        TARGET_BTB,
+        TARGET_RAS
+    };
+
+    // Pipeline registers
+    struct IF_ID {
+        uint32_t PC = 0;
+        uint32_t IR = 0;
+        bool valid = false;
+        bool isControlInstr = false; // New signal to indicate if the instruction is a control instruction
+        BranchPrediction prediction; // Made at fetch for a conditional branch
+        uint32_t predictedPC = 0;    // Where fetch went next for a jump
+        uint8_t targetSource = TARGET_NONE; // What predicted it
+        ReturnAddressStack::Snapshot ras; // RAS before this fetch, to undo a flush
+    };
+
+    struct ID_EX {
+        uint32_t PC = 0;
+        uint32_t IR = 0;
+        int32_t RA = 0, RB = 0, RM = 0;
+        DecodedInstr d{};
+        bool valid = false;
+        BranchPrediction prediction; // Checked and trained in EX
+        uint32_t predictedPC = 0;
+        uint8_t targetSource = TARGET_NONE;
+        bool branchResolved = false; // Conditional branch already resolved in decode (Knob7)
+        bool forwardRAFromEX_MEM = false; // Forward RA from EX/MEM
+        bool forwardRAFromMEM_WB = false; // Forward RA from MEM/WB
+        bool forwardRBFromEX_MEM = false; // Forward RB from EX/MEM
+        bool forwardRBFromMEM_WB = false; // Forward RB from MEM/WB
+        bool forwardRMFromEX_MEM = false; // Forward RM from EX/MEM
+        bool forwardRMFromMEM_WB = false; // Forward RM from MEM/WB
+    };
+
+    struct EX_MEM {
+        uint32_t PC = 0;
+        uint32_t IR = 0;
+        int32_t RZ = 0, RM = 0;
+        DecodedInstr d{};
+        bool valid = false;
+        bool forwardRMFromMEM_WB = false; // Forward RM from MEM/WB
+    };
+
+    struct MEM_WB {
+        uint32_t PC = 0;
+        uint32_t IR = 0;
+        int32_t RY = 0;
+        DecodedInstr d{};
+        bool valid = false;
+    };
+
+    PipelineSim() = default;
+    PipelineSim(const PipelineSim&) = delete;
+    PipelineSim& operator=(const PipelineSim&) = delete;
+
+    // ===== Loading =====
+
+    // Replaces the machine with the program of an .mc file (instructions
+    // below 0x10000000, data and stack above): SP = STACK_BASE, the other
+    // registers and PC 0, an empty pipeline and predictor, counters at 0.
+    // Prints the problem and returns false if the file cannot be opened.
+    bool load(const std::string &mcFile);
+
+    // Replaces the branch predictor with a new, untrained one
+    // (branch_predictor.h); the default is the 1-bit predictor.
+    void setPredictor(const BranchPredictorConfig &config);
+
+    // Replaces the branch target buffer and return address stack with
+    // empty ones; by default 64 entries 4-way and 8 entries.
+    void setBranchTargets(const BranchTargetConfig &config);
+
+    // Writes PC, registers, instruction memory, guest memory and the branch
+    // prediction table to a checkpoint (checkpoint.h) taken after
+    // 'instructions' instructions.
+    bool saveCheckpoint(const std::string &filename, uint64_t instructions) const;
+
+    // Replaces the whole machine state with a checkpoint and empties the
+    // pipeline; counters and knobs are kept. 'instructions' receives the
+    // count the checkpoint was taken at.
+    bool restoreCheckpoint(const std::string &filename, uint64_t &instructions);
+
+    // ===== Running =====
+
+    // Runs up to 'cycles' clock cycles, stopping early when the pipeline
+    // drains. Returns the number of cycles run.
+    uint64_t step(uint64_t cycles = 1);
+
+    // Runs cycles until done(*this) holds at the end of one, or the
+    // pipeline drains. Returns the number of cycles run.
+    template <typename Predicate>
+    uint64_t runUntil(Predicate done);
+
+    // Runs cycles until a total of 'retireLimit' instructions have retired
+    // (stopping at the end of that cycle) or the pipeline drains.
+    void runToRetire(uint64_t retireLimit = UINT64_MAX);
+
+    // Runs until 'count' more instructions are done and leaves the machine
+    // at a precise point (see leavePipeline). Returns the number done (less
+    // than 'count' if the program ends first).
+    uint64_t runToInstruction(uint64_t count);
+
+    // Executes up to 'count' instructions from PC architecturally, without
+    // timing, on an empty pipeline. Sets 'ended' when the program runs out
+    // of instructions. Returns the number executed.
+    uint64_t fastForward(uint64_t count, bool &ended);
+
+    // Empties the pipeline buffers so that the next cycle fetches at PC.
+    void enterPipeline();
+
+    // Brings a pipeline stopped at the end of a cycle to a precise state and
+    // empties it. Returns the number of instructions completed (0 or 1).
+    uint64_t leavePipeline();
+
+    // ===== Inspection =====
+    PipelineState state() const;
+    PipelineStats stats() const;
+    void resetStats();
+    bool halted() const { return currentState == HALT; }
+    uint32_t pc() const { return PC; }
+    uint64_t retired() const { return totalInstructions; }
+    // The registers and pipeline buffers in place, for readers that look at
+    // every cycle and cannot afford the copy state() makes.
+    uint64_t cycles() const { return clockCycle; }
+    const int32_t *registers() const { return R; }
+    const IF_ID &ifId() const { return if_id; }
+    const ID_EX &idEx() const { return id_ex; }
+    const EX_MEM &exMem() const { return ex_mem; }
+    const MEM_WB &memWb() const { return mem_wb; }
+    // Branch PC -> predicted taken, for every conditional branch resolved
+    // so far, as the predictor would predict it now
+    const std::unordered_map<uint32_t, bool> &predictorTable() const;
+    std::string predictorDescription() const { return predictor->describe(); }
+    const BranchTargetBuffer &branchTargetBuffer() const { return btb; }
+    unsigned returnStackEntries() const { return ras.capacity(); }
+    GuestMemory &memory() { return guestMemory; }
+    const GuestMemory &memory() const { return guestMemory; }
+
+    // ===== Output =====
+
+    // Trace every cycle to std::cout (and dump data.mc/stack.mc) or not.
+    void setVerbose(bool on) { verbose = on; }
+    void printRegisters() const;
+    void dumpInstructionMemory(const std::string &filename) const;
+    // Writes data.mc and stack.mc.
+    void dumpMemory() const;
+
+    // Knobs
+    bool Knob2 = false; // Enable/disable data forwarding
+    bool Knob3 = true; // Enable/disable printing all the register file content at the end of each cycle
+    bool Knob4 = true; // Enable/disable printing pipeline registers at the end of each cycle
+    bool Knob5 = false; // Enable/disable tracing for a specific instruction
+    int Knob5InstructionNumber = 0; // Instruction number to trace if Knob5 is enabled
+    bool Knob6 = true; // Enable/disable printing branch prediction unit content
+    bool Knob7 = false; // Resolve conditional branches in decode instead of execute
+
+private:
+    // MemSegment: a window onto the shared paged guest memory.
+    // Data memory and stack memory used to be two separate byte maps; they now
+    // share one GuestMemory and only differ in the address range they cover.
+    class MemSegment {
+    public:
+        MemSegment(GuestMemory &mem, uint32_t start, uint32_t end)
+            : memory(mem), startAddr(start), endAddr(end) {}
+
+        GuestMemory &memory;
+        uint32_t startAddr; // first address of the segment
+        uint32_t endAddr;   // last address of the segment (inclusive)
+
+        bool contains(uint32_t address) const {
+            return address >= startAddr && address <= endAddr;
+        }
+
+        void writeWord(uint32_t address, int32_t value) {
+            memory.write32(address, static_cast<uint32_t>(value));
+        }
+    };
+
+    // Control Hazard Detection Unit (CHDU)
+    class ControlHazardDetectionUnit {
+    public:
+        bool stallPipeline = false; // Indicates if the pipeline should be stalled
+        bool flushPipeline = false; // Indicates if the pipeline should be flushed
+        bool branchTaken = false;   // Indicates if the branch condition is satisfied
+
+        // Check for control hazards during decode
+        void checkControlHazard(const DecodedInstr &d) {
+            if (d.branch && !d.jump) {
+                stallPipeline = true; // Stall pipeline if branch instruction is detected
+            }
+            else if (d.jump) {
+                flushPipeline = true; // Flush pipeline if jump instruction is detected
+            }
+            else {
+                stallPipeline = false; // Clear stall if no branch or jump
+                flushPipeline = false; // Clear flush if no branch or jump
+            }
+        }
+
+        // Resolve branch decision during execute
+        void resolveBranch(bool zero, const DecodedInstr &d) {
+            if (d.branch) {
+                branchTaken = zero; // Branch is taken if ALU zero signal is true
+                flushPipeline = branchTaken; // Flush pipeline if branch is taken
+            }
+            stallPipeline = false; // Clear stall after branch resolution
+        }
+    };
+
+    // Define states for the multi-cycle implementation
+    enum State {
+        FETCH,
+        DECODE,
+        EXECUTE,
+        MEMORY_ACCESS,
+        WRITE_BACK,
+        HALT
+    };
+
+    // Instruction memory decoded once for the fast-forward; code[(pc - base) / 4].
+    struct FastForwardText {
+        uint32_t base = 0;
+        std::vector<DecodedInstr> code;
+        std::vector<bool> valid;    // false: no instruction, or the 0x0 terminator
+    };
+
+    // One clock cycle; Verbose traces it (trace.h).
+    template <bool Verbose>
+    void cycle();
+    template <bool Verbose>
+    void preUpdateDependencies();
+    template <bool Verbose>
+    void printBranchPredictionUnit();
+    void printPipelineBuffers() const;
+
+    DecodedInstr decode(uint32_t instr) const;
+    void storeInitialWord(uint32_t address, uint32_t word);
+    void memoryProcessorInterface(uint32_t &MAR, int32_t &MDR, int32_t RM, bool memRead, bool memWrite, uint8_t memSize, bool memSignExtend);
+    BranchPrediction predictBranch(uint32_t pc) const;
+    void updateBranchPrediction(uint32_t pc, bool actualOutcome, const BranchPrediction &prediction);
+    void buildFastForwardText();
+    void flushFetched();
+    static void dumpSegmentToFile(const std::string &filename, const MemSegment &seg,
+                                  uint32_t startAddr, uint32_t endAddr);
+
+    // CPU State
+    int32_t R[NUM_REGS] = {};  // Register file
+    uint32_t PC = 0;           // Program Counter
+    int32_t  RA = 0;           // Operand A   ra rb alu inputs
+    int32_t  RB = 0;           // Operand B
+    int32_t  RM = 0;           // Used for store data
+    int32_t  RZ = 0;           // ALU output    ///rz is the alu result
+    int32_t  RY = 0;           // Write-back data     this is written back
+    int32_t  MDR= 0;           // Memory data register
+    uint32_t MAR = 0;          // Memory Address Register
+    uint64_t clockCycle = 0;   // Cycle counter
+
+    // Instruction Memory (< 0x10000000)
+    std::map<uint32_t, uint32_t> instrMemory;
+
+    // Data and stack share one sparse paged memory
+    GuestMemory guestMemory;
+    MemSegment dataSegment{guestMemory, 0x10000000, STACK_THRESHOLD - 1};  // [0x10000000, 0x7FFFFFFC)
+    MemSegment stackSegment{guestMemory, STACK_THRESHOLD, 0xFFFFFFFF};     // >= 0x7FFFFFFC
+
+    IF_ID if_id{};
+    ID_EX id_ex{};
+    EX_MEM ex_mem{};
+    MEM_WB mem_wb{};
+    ControlHazardDetectionUnit chdu;
+    State currentState = FETCH;
+
+    // Stall state carried from one cycle to the next, so that a run stopped
+    // at a retire limit resumes exactly.
+    bool stallSignal = false;
+    // A HALT reached decode: nothing more is fetched, and the machine halts
+    // once the older instructions have left the pipeline.
+    bool haltDecoded = false;
+    // Track dependencies for RAW hazards
+    std::multiset<uint32_t> unresolvedDependencies;
+
+    // Branch direction predictor, and the branches it has seen with their
+    // current prediction (refreshed on access after an update)
+    std::unique_ptr<BranchPredictor> predictor = BranchPredictor::create(BranchPredictorConfig());
+    mutable std::unordered_map<uint32_t, bool> branchPredictionTable; // Maps PC to prediction (true = taken, false = not taken)
+    mutable bool branchPredictionTableStale = false;
+
+    // Jump targets at fetch: calls push, returns pop
+    BranchTargetBuffer btb{BranchTargetConfig().btbEntries, BranchTargetConfig().btbWays};
+    ReturnAddressStack ras{BranchTargetConfig().rasEntries};
+
+    // Rebuilt on first use after the instruction memory changes.
+    FastForwardText fastForwardText;
+    bool fastForwardStale = true;
+
+    bool verbose = false;
+
+    // Statistics tracking variables
+    uint64_t totalCycles = 0;
+    uint64_t totalInstructions = 0;
+    uint64_t dataTransferInstructions = 0;
+    uint64_t aluInstructions = 0;
+    uint64_t controlInstructions = 0;
+    uint64_t pipelineStalls = 0;
+    uint64_t dataHazards = 0;
+    uint64_t controlHazards = 0;
+    uint64_t branchMispredictions = 0;
+    uint64_t dataHazardStalls = 0;
+    uint64_t controlHazardStalls = 0;
+    uint64_t branchLookups = 0;
+    uint64_t branchPredictorMisses = 0;
+    uint64_t jumpsResolved = 0;
+    uint64_t jumpTargetMisses = 0;
+    uint64_t btbLookups = 0;
+    uint64_t btbHits = 0;
+    uint64_t rasPredictions = 0;
+    uint64_t rasCorrect = 0;
+    uint64_t branchOperandStalls = 0;
+};
+
+// A copy of the machine state at the end of a cycle.
+struct PipelineState {
+    uint32_t pc = 0;
+    std::array<int32_t, PipelineSim::NUM_REGS> regs{};
+    uint64_t cycle = 0;         // clock cycles run
+    bool halted = false;
+    bool stall = false;         // stall signal carried into the next cycle
+    PipelineSim::IF_ID if_id;
+    PipelineSim::ID_EX id_ex;
+    PipelineSim::EX_MEM ex_mem;
+    PipelineSim::MEM_WB mem_wb;
+};
+
+// The cycle is compiled once, in pipeline_sim.cpp.
+extern template void PipelineSim::cycle<true>();
+extern template void PipelineSim::cycle<false>();
+
+template <typename Predicate>
+uint64_t PipelineSim::runUntil(Predicate done) {
+    uint64_t cycles = 0;
+    while (currentState != HALT) {
+        if (verbose) cycle<true>(); else cycle<false>();
+        cycles++;
+        if (done(static_cast<const PipelineSim &>(*this))) break;
+    }
+    return cycles;
+}
+
+#endif
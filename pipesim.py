@@ -0,0 +1,191 @@
+"""ctypes bindings for the pipelined simulator's C interface (pipeline_capi.h).
+
+Build the library next to this file first:
+
+    g++ -std=c++17 -O2 -fPIC -shared pipeline_capi.cpp pipeline_sim.cpp \
+        branch_predictor.cpp checkpoint.cpp guest_memory.cpp -o libpipesim.so
+
+(pipesim.dll on Windows, libpipesim.dylib on macOS). Then:
+
+    with PipelineSim('output.mc') as sim:
+        sim.step()                 # one clock cycle, no process spawned
+        state = sim.state()        # PC, registers, pipeline buffers
+        print(sim.stats().cycles)
+"""
+import ctypes
+import os
+import sys
+
+ABI_VERSION = 1
+
+IF_ID, ID_EX, EX_MEM, MEM_WB = range(4)
+
+FWD_RA_FROM_EX_MEM = 1 << 0
+FWD_RA_FROM_MEM_WB = 1 << 1
+FWD_RB_FROM_EX_MEM = 1 << 2
+FWD_RB_FROM_MEM_WB = 1 << 3
+FWD_RM_FROM_EX_MEM = 1 << 4
+FWD_RM_FROM_MEM_WB = 1 << 5
+FWD_EX_MEM_RM_FROM_MEM_WB = 1 << 6
+
+
+class Latch(ctypes.Structure):
+    _fields_ = [
+        ('pc', ctypes.c_uint32),
+        ('ir', ctypes.c_uint32),
+        ('values', ctypes.c_int32 * 3),
+        ('valid', ctypes.c_uint8),
+        ('rd', ctypes.c_uint8),
+        ('reg_write', ctypes.c_uint8),
+        ('mem_read', ctypes.c_uint8),
+    ]
+
+
+class State(ctypes.Structure):
+    _fields_ = [
+        ('cycle', ctypes.c_uint64),
+        ('pc', ctypes.c_uint32),
+        ('halted', ctypes.c_uint8),
+        ('stall', ctypes.c_uint8),
+        ('forwarding', ctypes.c_uint16),
+        ('regs', ctypes.c_int32 * 32),
+        ('latches', Latch * 4),
+    ]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in (
+        'cycles', 'instructions', 'data_transfer', 'alu', 'control', 'stalls',
+        'data_hazards', 'control_hazards', 'mispredictions',
+        'data_hazard_stalls', 'control_hazard_stalls')]
+
+
+class PredictorEntry(ctypes.Structure):
+    _fields_ = [
+        ('pc', ctypes.c_uint32),
+        ('taken', ctypes.c_uint8),
+        ('reserved', ctypes.c_uint8 * 3),
+    ]
+
+
+class BtbEntry(ctypes.Structure):
+    _fields_ = [
+        ('pc', ctypes.c_uint32),
+        ('target', ctypes.c_uint32),
+    ]
+
+
+def _library_name():
+    if sys.platform.startswith('win'):
+        return 'pipesim.dll'
+    if sys.platform == 'darwin':
+        return 'libpipesim.dylib'
+    return 'libpipesim.so'
+
+
+_lib = None
+
+
+def load_library(path=None):
+    """Loads the shared library once (default: next to this file)."""
+    global _lib
+    if _lib is not None:
+        return _lib
+    if path is None:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), _library_name())
+    lib = ctypes.CDLL(path)
+
+    lib.pipesim_abi_version.restype = ctypes.c_uint32
+    lib.pipesim_create.restype = ctypes.c_void_p
+    lib.pipesim_destroy.argtypes = [ctypes.c_void_p]
+    lib.pipesim_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.pipesim_restore.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.pipesim_set_knob.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+    lib.pipesim_step.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.pipesim_step.restype = ctypes.c_uint64
+    lib.pipesim_get_state.argtypes = [ctypes.c_void_p, ctypes.POINTER(State)]
+    lib.pipesim_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(Stats)]
+    lib.pipesim_get_predictor.argtypes = [ctypes.c_void_p, ctypes.POINTER(PredictorEntry), ctypes.c_size_t]
+    lib.pipesim_get_predictor.restype = ctypes.c_size_t
+    lib.pipesim_get_btb.argtypes = [ctypes.c_void_p, ctypes.POINTER(BtbEntry), ctypes.c_size_t]
+    lib.pipesim_get_btb.restype = ctypes.c_size_t
+
+    version = lib.pipesim_abi_version()
+    if version != ABI_VERSION:
+        raise RuntimeError(f'{path}: ABI version {version}, expected {ABI_VERSION}')
+    _lib = lib
+    return lib
+
+
+class PipelineSim:
+    """One simulator instance inside the library."""
+
+    def __init__(self, mc_file=None, library=None):
+        self._lib = load_library(library)
+        self._handle = self._lib.pipesim_create()
+        if not self._handle:
+            raise MemoryError('pipesim_create failed')
+        if mc_file is not None:
+            self.load(mc_file)
+
+    def close(self):
+        if self._handle:
+            self._lib.pipesim_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def load(self, mc_file):
+        if self._lib.pipesim_load(self._handle, os.fsencode(mc_file)) != 0:
+            raise OSError(f'cannot load {mc_file}')
+
+    def restore(self, checkpoint):
+        if self._lib.pipesim_restore(self._handle, os.fsencode(checkpoint)) != 0:
+            raise OSError(f'cannot restore {checkpoint}')
+
+    def set_knob(self, knob, value):
+        if self._lib.pipesim_set_knob(self._handle, knob, int(value)) != 0:
+            raise ValueError(f'unknown knob {knob}')
+
+    def step(self, cycles=1):
+        """Runs up to 'cycles' cycles; returns how many ran."""
+        return self._lib.pipesim_step(self._handle, cycles)
+
+    def run(self):
+        """Runs until the pipeline drains; returns the cycles run."""
+        return self.step(2**64 - 1)
+
+    def state(self):
+        state = State()
+        self._lib.pipesim_get_state(self._handle, ctypes.byref(state))
+        return state
+
+    def stats(self):
+        stats = Stats()
+        self._lib.pipesim_get_stats(self._handle, ctypes.byref(stats))
+        return stats
+
+    def predictor(self):
+        """Branch prediction table as a list of (pc, taken) in PC order."""
+        count = self._lib.pipesim_get_predictor(self._handle, None, 0)
+        entries = (PredictorEntry * max(count, 1))()
+        count = min(count, self._lib.pipesim_get_predictor(self._handle, entries, count))
+        return [(entries[i].pc, bool(entries[i].taken)) for i in range(count)]
+
+    def btb(self):
+        """Branch target buffer as a list of (pc, target) in PC order."""
+        count = self._lib.pipesim_get_btb(self._handle, None, 0)
+        entries = (BtbEntry * max(count, 1))()
+        count = min(count, self._lib.pipesim_get_btb(self._handle, entries, count))
+        return [(entries[i].pc, entries[i].target) for i in range(count)]
+
+    @property
+    def halted(self):
+        return bool(self.state().halted)
@@ -0,0 +1,445 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include "json.hpp"
+#include "cycle_json.h"
+#include "pipeline_sim.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define RVSIMD_HAVE_SOCKETS 1
+#endif
+
+// rvsimd: a long-lived pipeline simulator behind a Unix domain socket.
+//
+// The daemon holds one PipelineSim in memory. Clients connect to the
+// socket and send commands, one per line; every command gets exactly one
+// line back, a JSON object with "ok": true and the results, or "ok": false
+// and an "error". The machine state persists across commands and
+// connections, so a GUI or a script can step, inspect and step again
+// without reloading output.mc or re-running from cycle 0.
+//
+//   load <file.mc>             replace the machine with a program
+//   restore <file.ckpt>        replace the machine with a checkpoint (checkpoint.h)
+//   reset                      reload the last program or checkpoint
+//   step [n]                   run n clock cycles (default 1)
+//   run [max]                  run until the pipeline drains (at most max cycles)
+//   run-to-pc <addr> [max]     run until the next fetch address is addr
+//   regs                       PC and x0..x31
+//   mem <addr> [words]         words of data/stack memory from addr (default 1)
+//   state [fields]             one record of --json (cycle_json.h; default fields, or a list / all)
+//   stats                      the Stat1..Stat12 counters
+//   knob <2..7> <value>        set a knob of the README (knob 5: instruction number, 0 = off)
+//   quit                       close this connection
+//   shutdown                   stop the daemon
+//
+// Addresses and counts may be decimal or 0x-prefixed. Commands run one at
+// a time in arrival order; a long step holds up the other connections.
+// run and run-to-pc without a max stop after the run budget (--run-budget,
+// 100M cycles by default) and say so in the reply ("budget"); SIGINT and
+// SIGTERM end a running command at the next cycle and stop the daemon.
+
+namespace {
+
+const uint64_t MAX_MEMORY_WORDS = 1 << 16;
+const uint64_t DEFAULT_RUN_BUDGET = 100'000'000;
+const size_t MAX_LINE = 64 << 10;   // longest command line a client may send
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+// The simulator and what it was last loaded from.
+class Session {
+public:
+    Session(bool flatMemory, uint64_t runBudget) : runBudget(runBudget) {
+        if (flatMemory && !sim.memory().useFlatBackend()) {
+            std::cout << "[INFO] mmap reservation failed; using paged guest memory.\n";
+        }
+    }
+
+    bool load(const std::string &path) {
+        if (!sim.load(path)) return false;
+        source = path;
+        sourceIsCheckpoint = false;
+        return true;
+    }
+
+    // Runs one command line. Sets 'close' for quit and 'stop' for shutdown.
+    std::string execute(const std::string &line, bool &close, bool &stop);
+
+private:
+    nlohmann::json position() const {
+        return {{"ok", true}, {"cycle", sim.cycles()}, {"pc", hex(sim.pc())}, {"halted", sim.halted()}};
+    }
+    // Runs up to 'limit' cycles, until done(sim) holds, the pipeline
+    // drains or a signal stops the daemon. Returns the cycles run.
+    template <typename Predicate>
+    uint64_t run(uint64_t limit, Predicate done) {
+        if (limit == 0) return 0;
+        uint64_t counted = 0;
+        return sim.runUntil([&](const PipelineSim &s) {
+            return done(s) || ++counted >= limit || stopRequested;
+        });
+    }
+    // Reply of a command that ran cycles
+    nlohmann::json ran(uint64_t cycles) const {
+        nlohmann::json reply = position();
+        reply["cycles"] = cycles;
+        if (stopRequested) reply["interrupted"] = true;
+        return reply;
+    }
+    static std::string hex(uint32_t value) {
+        std::ostringstream ss;
+        ss << "0x" << std::hex << value;
+        return ss.str();
+    }
+
+    PipelineSim sim;
+    uint64_t runBudget;         // cycles for run / run-to-pc without a max
+    std::string source;         // "" until something is loaded
+    bool sourceIsCheckpoint = false;
+};
+
+nlohmann::json failure(const std::string &message) {
+    return {{"ok", false}, {"error", message}};
+}
+
+// Parses a decimal or 0x-prefixed count/address; false on trailing junk.
+bool parseNumber(const std::string &text, uint64_t &value) {
+    try {
+        size_t used = 0;
+        value = std::stoull(text, &used, 0);
+        return used == text.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+std::string Session::execute(const std::string &line, bool &close, bool &stop) {
+    std::istringstream in(line);
+    std::string command;
+    std::vector<std::string> args;
+    in >> command;
+    for (std::string arg; in >> arg;) args.push_back(arg);
+
+    std::vector<uint64_t> numbers;
+    auto numericArgs = [&]() {
+        for (const std::string &arg : args) {
+            uint64_t value;
+            if (!parseNumber(arg, value)) return false;
+            numbers.push_back(value);
+        }
+        return true;
+    };
+    bool loaded = !source.empty();
+
+    nlohmann::json reply;
+    if (command == "load" || command == "restore") {
+        uint64_t instructions;
+        if (args.size() != 1) {
+            reply = failure(command + " expects one file");
+        } else if (command == "load" ? !load(args[0]) : !sim.restoreCheckpoint(args[0], instructions)) {
+            reply = failure("cannot " + command + " " + args[0]);
+        } else {
+            if (command == "restore") {
+                // Like a load, the counters start from zero.
+                sim.resetStats();
+                source = args[0];
+                sourceIsCheckpoint = true;
+            }
+            reply = position();
+        }
+    } else if (command == "quit") {
+        close = true;
+        reply = {{"ok", true}};
+    } else if (command == "shutdown") {
+        close = true;
+        stop = true;
+        reply = {{"ok", true}};
+    } else if (!loaded) {
+        reply = failure(command.empty() ? "empty command" : "no program loaded (load <file.mc> first)");
+    } else if (command == "reset") {
+        uint64_t instructions;
+        bool ok = sourceIsCheckpoint ? sim.restoreCheckpoint(source, instructions) : sim.load(source);
+        if (ok && sourceIsCheckpoint) sim.resetStats();
+        reply = ok ? position() : failure("cannot reload " + source);
+    } else if (command == "step") {
+        if (!numericArgs() || numbers.size() > 1) {
+            reply = failure("usage: step [cycles]");
+        } else {
+            reply = ran(run(numbers.empty() ? 1 : numbers[0], [](const PipelineSim &) { return false; }));
+        }
+    } else if (command == "run") {
+        if (!numericArgs() || numbers.size() > 1) {
+            reply = failure("usage: run [max cycles]");
+        } else {
+            uint64_t limit = numbers.empty() ? runBudget : numbers[0];
+            reply = ran(run(limit, [](const PipelineSim &) { return false; }));
+            if (numbers.empty()) reply["budget"] = runBudget;
+        }
+    } else if (command == "run-to-pc") {
+        if (!numericArgs() || numbers.empty() || numbers.size() > 2 || numbers[0] > UINT32_MAX) {
+            reply = failure("usage: run-to-pc <addr> [max cycles]");
+        } else {
+            uint32_t target = static_cast<uint32_t>(numbers[0]);
+            uint64_t limit = numbers.size() > 1 ? numbers[1] : runBudget;
+            uint64_t cycles = 0;
+            if (sim.pc() != target) {
+                cycles = run(limit, [target](const PipelineSim &s) { return s.pc() == target; });
+            }
+            reply = ran(cycles);
+            reply["reached"] = sim.pc() == target;
+            if (numbers.size() < 2) reply["budget"] = runBudget;
+        }
+    } else if (command == "regs") {
+        const int32_t *regs = sim.registers();
+        reply = position();
+        reply["regs"] = std::vector<int32_t>(regs, regs + PipelineSim::NUM_REGS);
+    } else if (command == "mem") {
+        if (!numericArgs() || numbers.empty() || numbers.size() > 2 || numbers[0] > UINT32_MAX) {
+            reply = failure("usage: mem <addr> [words]");
+        } else if (numbers.size() > 1 && numbers[1] > MAX_MEMORY_WORDS) {
+            reply = failure("at most " + std::to_string(MAX_MEMORY_WORDS) + " words per request");
+        } else {
+            uint32_t addr = static_cast<uint32_t>(numbers[0]);
+            uint64_t count = numbers.size() > 1 ? numbers[1] : 1;
+            std::vector<uint32_t> words(count);
+            for (uint64_t i = 0; i < count; i++) {
+                words[i] = sim.memory().read32(static_cast<uint32_t>(addr + 4 * i));
+            }
+            reply = {{"ok", true}, {"addr", hex(addr)}, {"words", words}};
+        }
+    } else if (command == "state") {
+        unsigned fields = JSON_DEFAULT_FIELDS;
+        if (args.size() > 1 || (args.size() == 1 && !CycleJsonWriter::parseFields(args[0], fields))) {
+            reply = failure("usage: state [field,...|all]");
+        } else {
+            // The record of the last cycle, as --json writes it; WB and the
+            // hazards need the cycle before, which is not kept, so they
+            // show as empty.
+            std::ostringstream record;
+            {
+                CycleJsonWriter writer(record, fields, 0);
+                writer.start(sim);
+                writer.write(sim);
+            }
+            std::string text = record.str();
+            text.pop_back();    // '\n'
+            return "{\"ok\":true,\"state\":" + text + "}";
+        }
+    } else if (command == "stats") {
+        PipelineStats s = sim.stats();
+        reply = {{"ok", true},
+                 {"cycles", s.cycles},
+                 {"instructions", s.instructions},
+                 {"data_transfer", s.dataTransfer},
+                 {"alu", s.alu},
+                 {"control", s.control},
+                 {"stalls", s.stalls},
+                 {"data_hazards", s.dataHazards},
+                 {"control_hazards", s.controlHazards},
+                 {"mispredictions", s.mispredictions},
+                 {"data_hazard_stalls", s.dataHazardStalls},
+                 {"control_hazard_stalls", s.controlHazardStalls},
+                 {"branches", s.branches},
+                 {"branch_misses", s.branchMisses},
+                 {"jumps", s.jumps},
+                 {"jump_misses", s.jumpMisses},
+                 {"btb_lookups", s.btbLookups},
+                 {"btb_hits", s.btbHits},
+                 {"ras_predictions", s.rasPredictions},
+                 {"ras_correct", s.rasCorrect},
+                 {"branch_operand_stalls", s.branchOperandStalls},
+                 {"predictor", sim.predictorDescription()}};
+    } else if (command == "knob") {
+        if (!numericArgs() || numbers.size() != 2 || numbers[0] < 2 || numbers[0] > 7) {
+            reply = failure("usage: knob <2..7> <value>");
+        } else {
+            bool on = numbers[1] != 0;
+            switch (numbers[0]) {
+                case 2: sim.Knob2 = on; break;
+                case 3: sim.Knob3 = on; break;
+                case 4: sim.Knob4 = on; break;
+                case 5:
+                    sim.Knob5 = on;
+                    sim.Knob5InstructionNumber = static_cast<int>(numbers[1]);
+                    break;
+                case 6: sim.Knob6 = on; break;
+                case 7: sim.Knob7 = on; break;
+            }
+            reply = {{"ok", true}};
+        }
+    } else {
+        reply = failure("unknown command \"" + command + "\"");
+    }
+    return reply.dump();
+}
+
+} // namespace
+
+#ifdef RVSIMD_HAVE_SOCKETS
+
+namespace {
+
+void onSignal(int) {
+    stopRequested = 1;
+}
+
+struct Connection {
+    int fd;
+    std::string input;          // received, not yet a whole line
+};
+
+bool sendAll(int fd, const std::string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = ::send(fd, text.data() + sent, text.size() - sent, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int listenOn(const std::string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "ERROR: socket path too long: " << path << "\n";
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR: socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    struct stat existing;
+    if (::stat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        ::unlink(path.c_str()); // left behind by an earlier run
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(fd, 8) != 0) {
+        std::cerr << "ERROR: cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serves connections until shutdown or a signal. Every connection is
+// polled; whole lines are executed in order, one reply line each.
+void serve(int listener, Session &session) {
+    std::vector<Connection> connections;
+    bool stop = false;
+    while (!stop && !stopRequested) {
+        std::vector<pollfd> fds;
+        fds.push_back({listener, POLLIN, 0});
+        for (const Connection &c : connections) fds.push_back({c.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "ERROR: poll: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        for (size_t i = 1; i < fds.size() && !stop; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Connection &c = connections[i - 1];
+            char chunk[4096];
+            ssize_t n = ::recv(c.fd, chunk, sizeof(chunk), 0);
+            bool close = n <= 0;
+            if (n > 0) c.input.append(chunk, static_cast<size_t>(n));
+
+            size_t end;
+            while (!close && (end = c.input.find('\n')) != std::string::npos) {
+                std::string line = c.input.substr(0, end);
+                c.input.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                std::string reply = session.execute(line, close, stop);
+                if (!sendAll(c.fd, reply + "\n")) close = true;
+            }
+            if (!close && c.input.size() > MAX_LINE) {
+                // No line end in sight: drop the client rather than buffer it.
+                sendAll(c.fd, failure("line longer than " + std::to_string(MAX_LINE) + " bytes").dump() + "\n");
+                close = true;
+            }
+            if (close) {
+                ::close(c.fd);
+                c.fd = -1;
+            }
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const Connection &c) { return c.fd < 0; }),
+                          connections.end());
+
+        if (!stop && (fds[0].revents & POLLIN)) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd >= 0) connections.push_back({fd, std::string()});
+        }
+    }
+    for (const Connection &c : connections) ::close(c.fd);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = "rvsimd.sock";
+    std::string program;
+    bool flatMemory = false;
+    uint64_t runBudget = DEFAULT_RUN_BUDGET;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--mmap") {
+            flatMemory = true;
+        } else if (arg == "--run-budget" && i + 1 < argc && parseNumber(argv[i + 1], runBudget) && runBudget > 0) {
+            i++;
+        } else if (arg.rfind("--", 0) != 0 && program.empty()) {
+            program = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [program.mc] [--socket <path>] [--mmap] [--run-budget <cycles>]\n";
+            return 1;
+        }
+    }
+
+    Session session(flatMemory, runBudget);
+    if (!program.empty() && !session.load(program)) {
+        return 1;
+    }
+    int listener = listenOn(socketPath);
+    if (listener < 0) {
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    std::cout << "[INFO] rvsimd listening on " << socketPath;
+    if (!program.empty()) std::cout << " with " << program << " loaded";
+    std::cout << std::endl;
+    serve(listener, session);
+
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    std::cout << "[INFO] rvsimd stopped" << std::endl;
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "ERROR: rvsimd needs Unix domain sockets (Linux, macOS or another POSIX system)\n";
+    return 1;
+}
+
+#endif
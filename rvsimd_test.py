@@ -0,0 +1,106 @@
+"""Test: rvsimd keeps serving after guest programs that divide by zero or
+divide INT_MIN by -1 (divide_test.mc), with and without forwarding.
+
+Build rvsimd next to this file first (see README), then:
+
+    python3 rvsimd_test.py [path/to/rvsimd]
+
+Prints OK, or FAIL lines and exits with status 1.
+"""
+import json
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PROGRAM = os.path.join(HERE, 'divide_test.mc')
+
+# Final registers of divide_test.mc (see differential_test.cpp).
+EXPECTED = {10: -2**31, 11: 0, 12: -1, 13: 7, 14: -1, 15: -2**31, 16: -1,
+            18: -1, 19: 0, 21: -3, 22: -1}
+
+failures = 0
+
+
+def check(ok, what):
+    global failures
+    if not ok:
+        print('FAIL:', what)
+        failures += 1
+
+
+class Client:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX)
+        self.sock.connect(path)
+        self.file = self.sock.makefile('rw')
+
+    def send(self, command):
+        self.file.write(command + '\n')
+        self.file.flush()
+        line = self.file.readline()
+        if not line:
+            raise ConnectionError('rvsimd closed the connection after ' + repr(command))
+        return json.loads(line)
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
+
+
+def connect(path, daemon):
+    for _ in range(100):
+        if daemon.poll() is not None:
+            break
+        try:
+            return Client(path)
+        except OSError:
+            time.sleep(0.05)
+    raise ConnectionError('cannot connect to rvsimd')
+
+
+def run_program(client, forward):
+    check(client.send('load ' + PROGRAM)['ok'], 'load')
+    check(client.send('knob 2 %d' % forward)['ok'], 'knob 2')
+    reply = client.send('run')
+    check(reply['ok'] and reply['halted'], 'run halts (forwarding %d): %s' % (forward, reply))
+    regs = client.send('regs')['regs']
+    for reg, value in EXPECTED.items():
+        check(regs[reg] == value, 'x%d = %d, expected %d (forwarding %d)' % (reg, regs[reg], value, forward))
+
+
+def main():
+    binary = sys.argv[1] if len(sys.argv) > 1 else os.path.join(HERE, 'rvsimd')
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'rvsimd.sock')
+        daemon = subprocess.Popen([binary, '--socket', path], cwd=tmp,
+                                  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            client = connect(path, daemon)
+            for forward in (0, 1):
+                run_program(client, forward)
+            client.close()
+
+            # A new connection still gets answers from the same daemon.
+            client = connect(path, daemon)
+            check(client.send('stats')['ok'], 'stats after the runs')
+            check(client.send('shutdown')['ok'], 'shutdown')
+            client.close()
+            check(daemon.wait(timeout=10) == 0, 'rvsimd exits with status 0')
+        except (ConnectionError, OSError, ValueError) as e:
+            check(False, str(e))
+        finally:
+            if daemon.poll() is None:
+                daemon.kill()
+                daemon.wait()
+            check(daemon.returncode == 0, 'rvsimd exit status %d' % daemon.returncode)
+
+    print('FAILED' if failures else 'OK')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
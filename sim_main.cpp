@@ -1,10 +1,238 @@
 #include "simulator.h"
+#include "batch.h"
+#include "simpoint.h"
 #include "symbol_table.h"
 #include "parser.h"  // Make sure you include your parser header as well.
 #include <iostream> 
 #include <iomanip>  // for hex formatting
 #include "cpu.h"
-int main() {
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char* argv[]) {
+    // Command-line options:
+    //   [file.mc]              machine code to run (default output.mc)
+    //   --stack-size <bytes>   usable stack below the initial SP (default 1 MiB)
+    //   --stack-guard <bytes>  guard region below the stack limit (default 64 KiB)
+    //   --mmap                 back guest memory with one mmap'd 4 GiB reservation
+    //   --engine <name>        switch (reference, traced), threaded, blocks or jit
+    //   --jit-threshold <n>    block entries before the jit engine compiles a block (default 50)
+    //   --quiet                no per-stage trace (the switch engine runs its silent build)
+    //   --batch <manifest>     run every job of a JSON manifest in parallel (see batch.h)
+    //   --report <file>        batch report, .csv or .json (default batch_report.json)
+    //   --threads <n>          batch worker threads (default: one per hardware thread)
+    //   --lockstep             batch jobs of the same program run as SIMD lanes (see lockstep.h)
+    //   --checkpoint-at <n>    run exactly n instructions, save a checkpoint and stop (see checkpoint.h)
+    //   --checkpoint-out <f>   checkpoint file for --checkpoint-at (default checkpoint.ckpt), or
+    //                          the file prefix for --checkpoint-every (default intervals)
+    //   --checkpoint-every <n> checkpoint every n-instruction interval plus a plan for
+    //                          simulator3 --parallel (see simpoint.h)
+    //   --checkpoint-warmup <n> detailed warm-up instructions before each interval (default 0)
+    //   --restore <f>          start from a checkpoint instead of input.asm and the .mc file
+    //   --simpoint <n>         profile BBVs per n-instruction interval and write SimPoint checkpoints (see simpoint.h)
+    //   --simpoint-k <n>       most clusters tried (default 10)
+    //   --simpoint-warmup <n>  detailed warm-up instructions before each point (default 0)
+    //   --simpoint-out <name>  output prefix: <name>.json, <name>.bb, <name>_<i>.ckpt (default simpoint)
+    StackConfig stack;
+    bool useMmap = false;
+    Engine engine = Engine::Switch;
+    uint32_t jitThreshold = 50;
+    bool verbose = true;
+    std::string mcFile = "output.mc";
+    std::string manifest;
+    std::string report = "batch_report.json";
+    unsigned threads = 0;
+    bool lockstep = false;
+    SimPointOptions simpoint;
+    bool profile = false;
+    std::string simpointOut = "simpoint";
+    uint64_t checkpointAt = 0;
+    std::string checkpointOut;
+    uint64_t checkpointEvery = 0;
+    uint64_t checkpointWarmup = 0;
+    std::string restore;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--stack-size") == 0 && i + 1 < argc) {
+            stack.limit = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (std::strcmp(argv[i], "--stack-guard") == 0 && i + 1 < argc) {
+            stack.guard = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (std::strcmp(argv[i], "--mmap") == 0) {
+            useMmap = true;
+        } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "switch") {
+                engine = Engine::Switch;
+            } else if (name == "threaded") {
+                engine = Engine::Threaded;
+            } else if (name == "blocks") {
+                engine = Engine::Blocks;
+            } else if (name == "jit") {
+                engine = Engine::Jit;
+            } else {
+                std::cerr << "Unknown engine '" << name << "' (expected switch, threaded, blocks or jit)\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--quiet") == 0) {
+            verbose = false;
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (std::strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (std::strcmp(argv[i], "--lockstep") == 0) {
+            lockstep = true;
+        } else if (std::strcmp(argv[i], "--checkpoint-at") == 0 && i + 1 < argc) {
+            checkpointAt = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(argv[i], "--checkpoint-out") == 0 && i + 1 < argc) {
+            checkpointOut = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            checkpointEvery = std::strtoull(argv[++i], nullptr, 0);
+            if (checkpointEvery == 0) checkpointEvery = 1;
+        } else if (std::strcmp(argv[i], "--checkpoint-warmup") == 0 && i + 1 < argc) {
+            checkpointWarmup = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restore = argv[++i];
+        } else if (std::strcmp(argv[i], "--simpoint") == 0 && i + 1 < argc) {
+            simpoint.intervalSize = std::strtoull(argv[++i], nullptr, 0);
+            if (simpoint.intervalSize == 0) simpoint.intervalSize = 1;
+            profile = true;
+        } else if (std::strcmp(argv[i], "--simpoint-k") == 0 && i + 1 < argc) {
+            simpoint.maxK = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (std::strcmp(argv[i], "--simpoint-warmup") == 0 && i + 1 < argc) {
+            simpoint.warmup = std::strtoull(argv[++i], nullptr, 0);
+        } else if (std::strcmp(argv[i], "--simpoint-out") == 0 && i + 1 < argc) {
+            simpointOut = argv[++i];
+        } else if (std::strcmp(argv[i], "--jit-threshold") == 0 && i + 1 < argc) {
+            jitThreshold = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+            if (jitThreshold == 0) jitThreshold = 1;
+        } else if (argv[i][0] != '-') {
+            mcFile = argv[i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [file.mc] [--stack-size <bytes>] [--stack-guard <bytes>]"
+                      << " [--mmap] [--engine switch|threaded|blocks|jit]"
+                      << " [--jit-threshold <n>] [--quiet]"
+                      << " [--batch <manifest.json> [--report <file>] [--threads <n>] [--lockstep]]"
+                      << " [--checkpoint-at <n> [--checkpoint-out <file>]] [--restore <file>]"
+                      << " [--checkpoint-every <n> [--checkpoint-warmup <n>] [--checkpoint-out <name>]]"
+                      << " [--simpoint <interval> [--simpoint-k <n>] [--simpoint-warmup <n>] [--simpoint-out <name>]]\n";
+            return 1;
+        }
+    }
+
+    // Batch mode: the .mc files carry their own data, input.asm is not used.
+    if (!manifest.empty()) {
+        std::vector<BatchJob> jobs;
+        if (!loadBatchManifest(manifest, jobs)) return 1;
+        auto start = std::chrono::steady_clock::now();
+        LockstepStats lanes;
+        std::vector<BatchResult> results = runBatch(jobs, threads, stack, lockstep ? &lanes : nullptr);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t total = 0;
+        size_t failed = 0;
+        for (const BatchResult& result : results) {
+            total += result.instructions;
+            if (result.status == "error") failed++;
+        }
+        std::cout << "[BATCH] " << jobs.size() << " jobs (" << failed << " failed to start), "
+                  << total << " instructions in " << seconds << " s ("
+                  << (seconds > 0 ? total / seconds / 1e6 : 0.0) << " MIPS)\n";
+        if (lockstep) {
+            std::cout << "[BATCH] Lockstep: " << lanes.issues << " issues for " << lanes.laneInstructions
+                      << " lane instructions (" << (lanes.issues ? double(lanes.laneInstructions) / lanes.issues : 0.0)
+                      << " lanes per issue), " << lanes.divergentIssues << " divergent issues, "
+                      << lanes.evicted << " lanes left lockstep after a text store\n";
+        }
+        if (!writeBatchReport(report, jobs, results)) return 1;
+        std::cout << "[BATCH] Report written to " << report << "\n";
+        return 0;
+    }
+
+    // SimPoint profiling: like batch mode, the .mc file carries its own data.
+    if (profile) {
+        Program program = loadMCFile(mcFile);
+        auto start = std::chrono::steady_clock::now();
+        BBVProfile bbv = profileBBV(program, mcFile, stack, simpoint.intervalSize);
+        std::vector<SimPoint> points = pickSimPoints(bbv, simpoint);
+        if (!writeSimPoints(simpointOut, program, mcFile, stack, bbv, points, simpoint)) return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "[SIMPOINT] " << bbv.totalInstructions << " instructions, " << bbv.intervals.size()
+                  << " intervals, " << bbv.blockPCs.size() << " blocks, " << points.size()
+                  << " simulation points (" << seconds << " s)\n";
+        for (const SimPoint& point : points) {
+            std::cout << "[SIMPOINT] interval " << point.interval << " (instructions " << point.start
+                      << ".." << point.start + point.length << "), weight " << point.weight
+                      << ", checkpoint " << point.checkpoint << "\n";
+        }
+        std::cout << "[SIMPOINT] Plan written to " << simpointOut << ".json\n";
+        return 0;
+    }
+
+    // Interval checkpoints for a parallel timing run of the whole program.
+    if (checkpointEvery > 0) {
+        if (checkpointOut.empty()) checkpointOut = "intervals";
+        Program program = loadMCFile(mcFile);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<SimPoint> points;
+        if (!writeIntervals(checkpointOut, program, mcFile, stack, checkpointEvery, checkpointWarmup, points)) {
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t total = points.empty() ? 0 : points.back().start + points.back().length;
+        std::cout << "[CHECKPOINT] " << total << " instructions, " << points.size() << " intervals of "
+                  << checkpointEvery << " (" << seconds << " s)\n";
+        std::cout << "[CHECKPOINT] Plan written to " << checkpointOut << ".json\n";
+        return 0;
+    }
+
+    // Checkpoints: start from a saved state and/or stop at an instruction
+    // count and save one. Without --restore the .mc file carries the data,
+    // as in batch mode.
+    if (checkpointAt > 0 || !restore.empty()) {
+        std::unique_ptr<CPU> cpu(new CPU());
+        if (useMmap && !cpu->memory.useFlatBackend()) {
+            std::cout << "[INFO] mmap reservation failed; using paged guest memory.\n";
+        }
+        Program program;
+        uint64_t executed = 0;
+        if (!restore.empty()) {
+            if (!loadCPUCheckpoint(restore, program, *cpu, executed)) return 1;
+            std::cout << "[CHECKPOINT] Restored " << restore << " at instruction " << executed
+                      << ", PC = 0x" << std::hex << cpu->PC << std::dec << "\n";
+        } else {
+            program = loadMCFile(mcFile);
+            loadMCData(mcFile, cpu->memory);
+            cpu->regFile[2] = stack.base;
+        }
+
+        if (checkpointAt > 0) {
+            if (checkpointOut.empty()) checkpointOut = "checkpoint.ckpt";
+            if (checkpointAt < executed) {
+                std::cerr << "[CHECKPOINT] The restored run is already past instruction " << checkpointAt << "\n";
+                return 1;
+            }
+            executed += advance(program, *cpu, stack, checkpointAt - executed);
+            if (executed < checkpointAt) {
+                std::cout << "[CHECKPOINT] The program stopped after " << executed << " instructions\n";
+            }
+            if (!saveCPUCheckpoint(checkpointOut, program, *cpu, executed)) return 1;
+            std::cout << "[CHECKPOINT] Saved " << checkpointOut << " at instruction " << executed
+                      << ", PC = 0x" << std::hex << cpu->PC << std::dec << ", "
+                      << cpu->memory.allocatedPages() << " pages\n";
+            return 0;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        runProgram(program, *cpu, stack, engine, jitThreshold, verbose);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        dumpMemory(*cpu, "final_memory_dump.mc");
+        std::cout << "Simulation complete. " << std::dec << executed + cpu->clock << " instructions in total, "
+                  << cpu->clock << " after the checkpoint in " << seconds << " s\n";
+        return 0;
+    }
+    
     // Create a symbol table and vector for instructions.
     SymbolTable symbolTable;
     std::vector<Instruction> instructions;
@@ -24,16 +252,26 @@ int main() {
         cpu.regFile[i] = 0;
     }
     
+    if (useMmap && !cpu.memory.useFlatBackend()) {
+        std::cout << "[INFO] mmap reservation failed; using paged guest memory.\n";
+    }
+
     // Load machine code, etc.
-    auto instructionsMap = loadMCFile("output.mc");
+    Program program = loadMCFile(mcFile);
     
     // Now symbolTable.dataSegments is populated, so memory initialization will work.
     std::cout << "Starting RISC-V simulation...\n";
-    simulate(instructionsMap, cpu, symbolTable);
+    auto start = std::chrono::steady_clock::now();
+    simulate(program, cpu, symbolTable, stack, engine, jitThreshold, verbose);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     
     // Optionally dump final memory state.
     dumpMemory(cpu, "final_memory_dump.mc");
     
-    std::cout << "Simulation complete. Total clock cycles: " << cpu.clock << "\n";
+    std::cout << "Simulation complete. Total clock cycles: " << std::dec << cpu.clock << "\n";
+    std::cout << "Executed " << std::dec << cpu.clock << " instructions in " << seconds << " s ("
+              << (seconds > 0 ? cpu.clock / seconds / 1e6 : 0.0) << " MIPS)\n";
+    std::cout << "Guest memory TLB hits / misses: " << std::dec << cpu.memory.tlbHits()
+              << " / " << cpu.memory.tlbMisses() << "\n";
     return 0;
 }
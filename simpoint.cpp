@@ -0,0 +1,348 @@
+#include "simpoint.h"
+#include "cpu.h"
+#include "interpreter.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+namespace {
+
+// A fresh CPU with the data lines of the .mc file loaded, as in batch mode.
+std::unique_ptr<CPU> freshCPU(const std::string& mcFile, const StackConfig& stack) {
+    std::unique_ptr<CPU> cpu(new CPU());
+    loadMCData(mcFile, cpu->memory);
+    cpu->regFile[2] = stack.base;
+    return cpu;
+}
+
+// ============================================================================
+// Clustering
+// ============================================================================
+
+using Vec = std::vector<double>;
+
+double distance2(const Vec& a, const Vec& b) {
+    double sum = 0;
+    for (size_t j = 0; j < a.size(); j++) sum += (a[j] - b[j]) * (a[j] - b[j]);
+    return sum;
+}
+
+struct Clustering {
+    std::vector<uint32_t> assignment;   // interval -> cluster
+    std::vector<Vec> centres;
+    double distortion = 0;              // sum of squared distances to the centres
+};
+
+// One k-means run: k-means++ seeding, then Lloyd iterations until no
+// interval changes cluster.
+Clustering kmeans(const std::vector<Vec>& points, uint32_t k, std::mt19937& rng) {
+    Clustering c;
+    size_t n = points.size();
+    std::vector<double> nearest(n, std::numeric_limits<double>::max());
+    c.centres.push_back(points[std::uniform_int_distribution<size_t>(0, n - 1)(rng)]);
+    while (c.centres.size() < k) {
+        double total = 0;
+        for (size_t i = 0; i < n; i++) {
+            nearest[i] = std::min(nearest[i], distance2(points[i], c.centres.back()));
+            total += nearest[i];
+        }
+        size_t pick = 0;
+        if (total > 0) {
+            double r = std::uniform_real_distribution<double>(0, total)(rng);
+            while (pick + 1 < n && (r -= nearest[pick]) > 0) pick++;
+        } else {
+            pick = std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+        }
+        c.centres.push_back(points[pick]);
+    }
+
+    c.assignment.assign(n, UINT32_MAX);
+    for (int iteration = 0; iteration < 100; iteration++) {
+        bool changed = false;
+        c.distortion = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t best = 0;
+            double bestDist = distance2(points[i], c.centres[0]);
+            for (uint32_t m = 1; m < k; m++) {
+                double dist = distance2(points[i], c.centres[m]);
+                if (dist < bestDist) {
+                    best = m;
+                    bestDist = dist;
+                }
+            }
+            if (c.assignment[i] != best) changed = true;
+            c.assignment[i] = best;
+            c.distortion += bestDist;
+        }
+        if (!changed) break;
+        std::vector<Vec> sums(k, Vec(points[0].size(), 0.0));
+        std::vector<size_t> sizes(k, 0);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < points[i].size(); j++) sums[c.assignment[i]][j] += points[i][j];
+            sizes[c.assignment[i]]++;
+        }
+        for (uint32_t m = 0; m < k; m++) {
+            if (sizes[m] == 0) continue;   // empty cluster keeps its centre
+            for (double& v : sums[m]) v /= sizes[m];
+            c.centres[m] = sums[m];
+        }
+    }
+    return c;
+}
+
+// Bayesian information criterion of a clustering under the identical
+// spherical Gaussian model used by X-means and SimPoint.
+double bic(const Clustering& c, size_t n, size_t dims) {
+    double k = static_cast<double>(c.centres.size());
+    double r = static_cast<double>(n);
+    double variance = n > c.centres.size() ? c.distortion / (r - k) : 0.0;
+    variance = std::max(variance, 1e-12);
+    std::vector<size_t> sizes(c.centres.size(), 0);
+    for (uint32_t a : c.assignment) sizes[a]++;
+    const double pi = std::acos(-1.0);
+    double likelihood = 0;
+    for (size_t size : sizes) {
+        if (size == 0) continue;
+        double rn = static_cast<double>(size);
+        likelihood += -rn / 2 * std::log(2 * pi) - rn * dims / 2 * std::log(variance)
+                      - (rn - k) / 2 + rn * std::log(rn) - rn * std::log(r);
+    }
+    double parameters = k * (dims + 1);
+    return likelihood - parameters / 2 * std::log(r);
+}
+
+} // namespace
+
+// ============================================================================
+// Profiling
+// ============================================================================
+
+BBVProfile profileBBV(const Program& loaded, const std::string& mcFile,
+                      const StackConfig& stack, uint64_t intervalSize) {
+    BBVProfile profile;
+    profile.intervalSize = intervalSize;
+    Program program = loaded;
+    std::unique_ptr<CPU> cpu = freshCPU(mcFile, stack);
+
+    std::unordered_map<uint32_t, uint32_t> ids;   // start PC -> block id
+    std::vector<uint64_t> counts;                 // block id -> instructions in this interval
+    std::vector<uint32_t> touched;                // ids with a non-zero count
+    uint64_t inInterval = 0;
+    auto closeInterval = [&]() {
+        std::sort(touched.begin(), touched.end());
+        std::vector<std::pair<uint32_t, uint64_t>> bbv;
+        bbv.reserve(touched.size());
+        for (uint32_t id : touched) {
+            bbv.emplace_back(id, counts[id]);
+            counts[id] = 0;
+        }
+        touched.clear();
+        profile.intervals.push_back(std::move(bbv));
+        profile.lengths.push_back(inInterval);
+        inInterval = 0;
+    };
+
+    // With a budget of one instruction runThreaded() stops after every
+    // taken jump or branch, so each call runs exactly one block.
+    for (;;) {
+        uint32_t entry = cpu->PC;
+        uint64_t before = cpu->clock;
+        ExitReason reason = runThreaded(program, *cpu, stack, nullptr, 1);
+        uint64_t retired = cpu->clock - before;
+        if (retired > 0) {
+            auto it = ids.emplace(entry, static_cast<uint32_t>(profile.blockPCs.size()));
+            if (it.second) {
+                profile.blockPCs.push_back(entry);
+                counts.push_back(0);
+            }
+            uint32_t id = it.first->second;
+            if (counts[id] == 0) touched.push_back(id);
+            counts[id] += retired;
+            inInterval += retired;
+            profile.totalInstructions += retired;
+            if (inInterval >= intervalSize) closeInterval();
+        }
+        if (reason != ExitReason::InstructionLimit) {
+            profile.reason = reason;
+            break;
+        }
+    }
+    if (inInterval > 0) closeInterval();
+    return profile;
+}
+
+// ============================================================================
+// Interval selection
+// ============================================================================
+
+std::vector<SimPoint> pickSimPoints(const BBVProfile& profile, const SimPointOptions& options) {
+    std::vector<SimPoint> points;
+    size_t n = profile.intervals.size();
+    if (n == 0) return points;
+
+    // Normalize each BBV to its interval length and project it onto
+    // 'dimensions' random directions (one uniform [-1, 1] row per block).
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    size_t dims = std::max<uint32_t>(1, options.dimensions);
+    std::vector<double> projection(profile.blockPCs.size() * dims);
+    for (double& v : projection) v = uniform(rng);
+    std::vector<Vec> projected(n, Vec(dims, 0.0));
+    for (size_t i = 0; i < n; i++) {
+        for (const auto& entry : profile.intervals[i]) {
+            double share = static_cast<double>(entry.second) / profile.lengths[i];
+            for (size_t j = 0; j < dims; j++) projected[i][j] += share * projection[entry.first * dims + j];
+        }
+    }
+
+    // Cluster for every k (best of a few seedings each) and keep the
+    // smallest k whose BIC reaches 90% of the observed BIC range.
+    uint32_t maxK = static_cast<uint32_t>(std::min<size_t>(std::max(1u, options.maxK), n));
+    std::vector<Clustering> runs;
+    std::vector<double> scores;
+    for (uint32_t k = 1; k <= maxK; k++) {
+        Clustering best;
+        for (int seeding = 0; seeding < 5; seeding++) {
+            Clustering c = kmeans(projected, k, rng);
+            if (seeding == 0 || c.distortion < best.distortion) best = std::move(c);
+        }
+        scores.push_back(bic(best, n, dims));
+        runs.push_back(std::move(best));
+    }
+    double lo = *std::min_element(scores.begin(), scores.end());
+    double hi = *std::max_element(scores.begin(), scores.end());
+    size_t chosen = 0;
+    while (chosen + 1 < scores.size() && scores[chosen] < lo + 0.9 * (hi - lo)) chosen++;
+    const Clustering& clustering = runs[chosen];
+
+    // One point per non-empty cluster: the interval nearest its centre.
+    std::vector<uint64_t> starts(n, 0);
+    for (size_t i = 1; i < n; i++) starts[i] = starts[i - 1] + profile.lengths[i - 1];
+    for (uint32_t m = 0; m < clustering.centres.size(); m++) {
+        uint64_t instructions = 0;
+        size_t nearest = n;
+        double nearestDist = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (clustering.assignment[i] != m) continue;
+            instructions += profile.lengths[i];
+            double dist = distance2(projected[i], clustering.centres[m]);
+            if (nearest == n || dist < nearestDist) {
+                nearest = i;
+                nearestDist = dist;
+            }
+        }
+        if (nearest == n) continue;
+        SimPoint point;
+        point.cluster = m;
+        point.interval = nearest;
+        point.start = starts[nearest];
+        point.length = profile.lengths[nearest];
+        point.weight = static_cast<double>(instructions) / profile.totalInstructions;
+        points.push_back(point);
+    }
+    std::sort(points.begin(), points.end(),
+              [](const SimPoint& a, const SimPoint& b) { return a.interval < b.interval; });
+    return points;
+}
+
+// ============================================================================
+// Checkpoints and plan
+// ============================================================================
+
+namespace {
+
+// Writes one checkpoint per point, each 'warmup' instructions ahead of its
+// interval (filling in point.warmup and point.checkpoint), in program order
+// on one run, then the plan <prefix>.json.
+bool writePlan(const std::string& prefix, const Program& loaded, const std::string& mcFile,
+               const StackConfig& stack, uint64_t intervalSize, uint64_t totalInstructions,
+               size_t intervals, std::vector<SimPoint>& points, uint64_t warmup) {
+    std::string base = std::filesystem::path(prefix).filename().string();
+    Program program = loaded;
+    std::unique_ptr<CPU> cpu = freshCPU(mcFile, stack);
+    uint64_t executed = 0;
+    for (size_t p = 0; p < points.size(); p++) {
+        SimPoint& point = points[p];
+        uint64_t target = point.start - std::min(warmup, point.start);
+        if (target > executed) executed += advance(program, *cpu, stack, target - executed);
+        point.warmup = point.start - executed;
+        point.checkpoint = base + "_" + std::to_string(p) + ".ckpt";
+        if (!saveCPUCheckpoint(prefix + "_" + std::to_string(p) + ".ckpt", program, *cpu, executed)) {
+            return false;
+        }
+    }
+
+    nlohmann::json plan;
+    plan["program"] = mcFile;
+    plan["interval_size"] = intervalSize;
+    plan["total_instructions"] = totalInstructions;
+    plan["intervals"] = intervals;
+    plan["points"] = nlohmann::json::array();
+    for (const SimPoint& point : points) {
+        nlohmann::json entry;
+        entry["cluster"] = point.cluster;
+        entry["interval"] = point.interval;
+        entry["start"] = point.start;
+        entry["length"] = point.length;
+        entry["weight"] = point.weight;
+        entry["warmup"] = point.warmup;
+        entry["checkpoint"] = point.checkpoint;
+        plan["points"].push_back(entry);
+    }
+    std::ofstream out(prefix + ".json");
+    if (!out) {
+        std::cerr << "[SIMPOINT] Cannot write " << prefix << ".json\n";
+        return false;
+    }
+    out << plan.dump(2) << "\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+bool writeSimPoints(const std::string& prefix, const Program& program, const std::string& mcFile,
+                    const StackConfig& stack, const BBVProfile& profile,
+                    std::vector<SimPoint>& points, const SimPointOptions& options) {
+    // BBVs in SimPoint's format: one "T:id:count :id:count ..." line per
+    // interval, block ids counted from 1.
+    std::ofstream bb(prefix + ".bb");
+    if (!bb) {
+        std::cerr << "[SIMPOINT] Cannot write " << prefix << ".bb\n";
+        return false;
+    }
+    for (const auto& interval : profile.intervals) {
+        bb << "T";
+        for (const auto& entry : interval) bb << ":" << entry.first + 1 << ":" << entry.second << " ";
+        bb << "\n";
+    }
+    return writePlan(prefix, program, mcFile, stack, profile.intervalSize, profile.totalInstructions,
+                     profile.intervals.size(), points, options.warmup);
+}
+
+bool writeIntervals(const std::string& prefix, const Program& loaded, const std::string& mcFile,
+                    const StackConfig& stack, uint64_t intervalSize, uint64_t warmup,
+                    std::vector<SimPoint>& points) {
+    // A functional run first, for the instruction count.
+    Program program = loaded;
+    std::unique_ptr<CPU> cpu = freshCPU(mcFile, stack);
+    uint64_t total = advance(program, *cpu, stack, UINT64_MAX);
+
+    points.clear();
+    for (uint64_t start = 0; start < total; start += intervalSize) {
+        SimPoint point;
+        point.cluster = static_cast<uint32_t>(points.size());
+        point.interval = points.size();
+        point.start = start;
+        point.length = std::min(intervalSize, total - start);
+        point.weight = static_cast<double>(point.length) / total;
+        points.push_back(point);
+    }
+    return writePlan(prefix, loaded, mcFile, stack, intervalSize, total, points.size(), points, warmup);
+}
@@ -0,0 +1,85 @@
+#ifndef SIMPOINT_H
+#define SIMPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "simulator.h"
+
+// SimPoint-style interval selection for the functional simulator.
+//
+// profileBBV() runs a program on the threaded engine and records a basic
+// block vector (BBV) for every fixed-size interval of retired instructions:
+// how many instructions each dynamic block contributed to the interval. A
+// block is a straight-line run that starts at a jump or branch target and
+// ends at the next taken jump or branch; intervals close at block ends, so
+// an interval can overshoot its size by one block.
+//
+// pickSimPoints() clusters the intervals (k-means on a random projection of
+// the normalized BBVs, k chosen by the Bayesian information criterion) and
+// picks the interval closest to each cluster centre as its simulation point,
+// weighted by the share of the program's instructions in its cluster.
+//
+// writeIntervals() skips the clustering and makes every interval a point,
+// so that the pipeline simulator can time the whole program in parallel
+// (--parallel), one thread per share of the intervals.
+//
+// writeSimPoints() re-runs the program and writes one binary checkpoint per
+// point (checkpoint.h), taken 'warmup' instructions ahead of it, plus a JSON
+// plan that the pipeline simulator reads with --simpoints to time only
+// those intervals and combine their CPI.
+
+struct BBVProfile {
+    uint64_t intervalSize = 0;
+    uint64_t totalInstructions = 0;
+    std::vector<uint32_t> blockPCs;      // block id -> start PC
+    // Per interval: (block id, instructions) pairs and the interval length.
+    std::vector<std::vector<std::pair<uint32_t, uint64_t>>> intervals;
+    std::vector<uint64_t> lengths;
+    ExitReason reason = ExitReason::EndOfProgram;
+};
+
+struct SimPoint {
+    uint32_t cluster = 0;
+    uint64_t interval = 0;      // index of the chosen interval
+    uint64_t start = 0;         // instructions retired before it
+    uint64_t length = 0;        // its instructions
+    double weight = 0;          // share of all instructions in its cluster
+    uint64_t warmup = 0;        // instructions between checkpoint and start
+    std::string checkpoint;     // file name, relative to the plan
+};
+
+struct SimPointOptions {
+    uint64_t intervalSize = 100000;
+    uint32_t maxK = 10;          // clusters tried: 1..maxK
+    uint32_t dimensions = 15;    // random projection size
+    uint64_t warmup = 0;         // detailed warm-up before each point
+    uint32_t seed = 1;
+};
+
+// Profiles 'program' (a private copy is run) on a fresh CPU whose memory
+// holds the data lines of 'mcFile'.
+BBVProfile profileBBV(const Program& program, const std::string& mcFile,
+                      const StackConfig& stack, uint64_t intervalSize);
+
+// Clusters the profile's intervals; returns one point per cluster, in
+// interval order (start, length and weight filled in).
+std::vector<SimPoint> pickSimPoints(const BBVProfile& profile, const SimPointOptions& options);
+
+// Writes <prefix>.bb (the BBVs in SimPoint's text format), one checkpoint
+// <prefix>_<n>.ckpt per point and the plan <prefix>.json. Returns false if
+// a file cannot be written.
+bool writeSimPoints(const std::string& prefix, const Program& program, const std::string& mcFile,
+                    const StackConfig& stack, const BBVProfile& profile,
+                    std::vector<SimPoint>& points, const SimPointOptions& options);
+
+// Splits the whole run into consecutive 'intervalSize'-instruction points
+// (the last may be shorter), each weighted by its length, and writes their
+// checkpoints, 'warmup' instructions ahead, and the plan <prefix>.json.
+// Returns false if a file cannot be written.
+bool writeIntervals(const std::string& prefix, const Program& program, const std::string& mcFile,
+                    const StackConfig& stack, uint64_t intervalSize, uint64_t warmup,
+                    std::vector<SimPoint>& points);
+
+#endif
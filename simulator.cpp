@@ -1,4 +1,7 @@
 #include "simulator.h"
+#include "checkpoint.h"
+#include "interpreter.h"
+#include "trace.h"
 #include "symbol_table.h"  // For SymbolTable, DataSegment, DataEntry
 #include <iostream>
 #include <sstream>
@@ -6,11 +9,20 @@
 #include <iomanip>
 #include <cstdint>
 #include <map>
-// ─── Add these right below your includes ─────────────────────────────────────────
-constexpr uint32_t STACK_SIZE = 1 << 20;     // 1 MiB stack
-constexpr uint32_t STACK_BASE = 0x8000'0000; // choose a high address as "top of stack"
-constexpr uint32_t STACK_END  = STACK_BASE - STACK_SIZE;
-// ────────────────────────────────────────────────────────────────────────────────
+#include <algorithm>
+
+// ===== Helper: true if addr falls in the guard region below the stack limit. =====
+static bool inStackGuard(const StackConfig &stack, uint32_t addr) {
+    uint32_t stackEnd = stack.base - stack.limit;   // lowest usable stack address
+    return addr < stackEnd && addr >= stackEnd - stack.guard;
+}
+
+static void reportStackOverflow(const StackConfig &stack, uint32_t addr, uint32_t pc) {
+    std::cerr << "[ERROR] Stack overflow: access to 0x" << std::hex << addr
+              << " at PC = 0x" << pc << " is below the stack limit 0x"
+              << (stack.base - stack.limit) << std::dec
+              << " (stack size " << stack.limit << " bytes)\n";
+}
 
 
 // ===== Helper: Sign-extends a value that has "bits" bits. =====
@@ -46,28 +58,166 @@ int32_t getJTypeImm(uint32_t IR) {
     return signExtend(imm, 21);
 }
 
-// ===== Load machine code from file (address -> instruction string). =====
-std::map<uint32_t, std::string> loadMCFile(const std::string& filename) {
+// ===== Decode one instruction word into a DecodedInstr. =====
+// The handler comes from the ISA table (isa.h); the immediate is extracted
+// by the format of the opcode, whether or not the word is a valid instruction.
+DecodedInstr decodeInstruction(uint32_t instr) {
+    DecodedInstr d;
+    d.raw    = instr;
+    d.opcode = instr & 0x7F;
+    d.rd     = (instr >> 7) & 0x1F;
+    d.funct3 = (instr >> 12) & 0x7;
+    d.rs1    = (instr >> 15) & 0x1F;
+    d.rs2    = (instr >> 20) & 0x1F;
+    d.funct7 = (instr >> 25) & 0x7F;
+    d.valid  = true;
+
+    switch (ISA_FORMATS[d.opcode]) {
+        case InstrFormat::I:  d.imm = getITypeImm(instr); break;
+        case InstrFormat::S:  d.imm = getSTypeImm(instr); break;
+        case InstrFormat::SB: d.imm = getBTypeImm(instr); break;
+        case InstrFormat::U:  d.imm = getUTypeImm(instr); break;
+        case InstrFormat::UJ: d.imm = getJTypeImm(instr); break;
+        default: break;
+    }
+
+    const IsaEntry* entry = isaLookup(instr);
+    d.op = entry ? entry->op : OP_ILLEGAL;
+    d.exec = d.op;
+    return d;
+}
+
+// ===== Superinstruction fusion. =====
+// Which Fused pair 'a' followed by 'b' forms, or a.op if none. Each idiom
+// requires the second instruction to consume the first one's result.
+static uint8_t fusedExec(const DecodedInstr& a, const DecodedInstr& b) {
+    if (a.rd == 0) return a.op;
+    if (a.op == OP_LUI && b.op == OP_ADDI && b.rd == a.rd && b.rs1 == a.rd) {
+        return FUSED_LUI_ADDI;
+    }
+    if (a.op == OP_AUIPC && b.op == OP_JALR && b.rs1 == a.rd) {
+        return FUSED_AUIPC_JALR;
+    }
+    if (a.op == OP_ADDI && a.rs1 == a.rd && b.op == OP_BNE && (b.rs1 == a.rd || b.rs2 == a.rd)) {
+        return FUSED_ADDI_BNE;
+    }
+    return a.op;
+}
+
+void Program::fuse(uint32_t lo, uint32_t hi) {
+    for (uint32_t i = lo; i <= hi && i < code.size(); i++) {
+        DecodedInstr& d = code[i];
+        d.exec = i + 1 < code.size() ? fusedExec(d, code[i + 1]) : d.op;
+    }
+}
+
+// ===== Stores into the program text. =====
+bool Program::storeText(uint32_t addr, uint32_t value, uint32_t size) {
+    bool touched = false;
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t a = addr + i;
+        uint32_t offset = a - base;
+        if (offset >= textSize()) continue;
+        uint32_t index = offset >> 2;
+        DecodedInstr& slot = code[index];
+        uint32_t shift = (offset & 0x3) * 8;
+        uint32_t raw = (slot.raw & ~(0xFFu << shift)) | (((value >> (8 * i)) & 0xFF) << shift);
+        slot = decodeInstruction(raw);
+        lo = std::min(lo, index);
+        hi = std::max(hi, index);
+        touched = true;
+    }
+    // The instruction before the store may have been fused with the old bytes.
+    if (touched) fuse(lo > 0 ? lo - 1 : 0, hi);
+    return touched;
+}
+
+// ===== Load the text segment of a .mc file into a predecoded Program. =====
+Program loadMCFile(const std::string& filename) {
     std::ifstream infile(filename);
-    std::map<uint32_t, std::string> instructions;
+    std::map<uint32_t, uint32_t> words;   // address -> instruction word
     std::string line;
     while (std::getline(infile, line)) {
         std::stringstream ss(line);
         std::string pc_str, instr_str;
         ss >> pc_str >> instr_str;
+        if (pc_str.empty() || instr_str.empty()) continue;
         uint32_t pc = std::stoul(pc_str, nullptr, 16);
-        instructions[pc] = instr_str;
+        if (pc >= 0x10000000) continue;   // data segment, not program text
+        words[pc] = std::stoul(instr_str, nullptr, 16);
     }
-    return instructions;
+    return buildProgram(words);
 }
 
-// ===== Dump data memory to a file (each memory word printed in hex). =====
+// ===== Predecode a set of instruction words into a Program. =====
+Program buildProgram(const std::map<uint32_t, uint32_t>& words) {
+    Program program;
+    if (words.empty()) return program;
+    program.base = words.begin()->first;
+    uint32_t last = words.rbegin()->first;
+    // One extra invalid entry at the end: running off the program always
+    // lands on a "no instruction" slot.
+    program.code.resize(((last - program.base) >> 2) + 2);
+    for (const auto& w : words) {
+        if ((w.first - program.base) & 0x3) continue;   // misaligned: not reachable
+        program.code[(w.first - program.base) >> 2] = decodeInstruction(w.second);
+    }
+    program.fuse(0, static_cast<uint32_t>(program.code.size() - 1));
+    return program;
+}
+
+// ===== Checkpoints of the functional simulator (see checkpoint.h). =====
+bool saveCPUCheckpoint(const std::string& filename, const Program& program, const CPU& cpu,
+                       uint64_t instructions) {
+    Checkpoint state;
+    state.instructions = instructions;
+    state.pc = cpu.PC;
+    state.regs = cpu.regFile;
+    for (size_t i = 0; i < program.code.size(); i++) {
+        if (program.code[i].valid) {
+            state.text[program.base + static_cast<uint32_t>(i) * 4] = program.code[i].raw;
+        }
+    }
+    return saveCheckpoint(filename, state, cpu.memory);
+}
+
+bool loadCPUCheckpoint(const std::string& filename, Program& program, CPU& cpu,
+                       uint64_t& instructions) {
+    Checkpoint state;
+    if (!loadCheckpoint(filename, state, cpu.memory)) return false;
+    program = buildProgram(state.text);
+    cpu.PC = state.pc;
+    cpu.regFile = state.regs;
+    cpu.clock = 0;
+    instructions = state.instructions;
+    return true;
+}
+
+// ===== Load the data lines of a .mc file into guest memory. =====
+bool loadMCData(const std::string& filename, GuestMemory& memory) {
+    std::ifstream infile(filename);
+    if (!infile) return false;
+    std::string line;
+    while (std::getline(infile, line)) {
+        std::stringstream ss(line);
+        std::string addr_str, value_str;
+        ss >> addr_str >> value_str;
+        if (addr_str.empty() || value_str.empty()) continue;
+        uint32_t addr = std::stoul(addr_str, nullptr, 16);
+        if (addr < 0x10000000) continue;   // program text
+        memory.write32(addr, static_cast<uint32_t>(std::stoul(value_str, nullptr, 16)));
+    }
+    return true;
+}
+
+// ===== Dump data memory to a file (each non-zero memory word printed in hex). =====
 void dumpMemory(const CPU& cpu, const std::string& filename) {
     std::ofstream outfile(filename);
-    for (const auto& mem : cpu.memory) {
-        outfile << "0x" << std::hex << mem.first << " 0x" 
-                << std::setfill('0') << std::setw(8) << mem.second << "\n";
-    }
+    cpu.memory.forEachWord(0, 0xFFFFFFFF, [&](uint32_t addr, uint32_t word) {
+        outfile << "0x" << std::hex << addr << " 0x"
+                << std::setfill('0') << std::setw(8) << word << "\n";
+    });
     std::cout << "[DUMP] Data memory dumped to " << filename << "\n";
 }
 
@@ -75,30 +225,20 @@ void dumpMemory(const CPU& cpu, const std::string& filename) {
  * ===== Initialize CPU memory from Data Segments in the SymbolTable. =====
  * 
  * We assume each DataEntry has a 'value' (stored in an int) and a 'size' in bytes.
- * We unpack the value's bytes (little-endian) and store them into the CPU's memory map
- * at the correct addresses (word-aligned in a 32-bit word map).
+ * We unpack the value's bytes (little-endian) and copy them into guest memory
+ * at the correct addresses.
  */
 void initializeMemoryFromDataSegments(CPU &cpu,  SymbolTable &symbolTable) {
     for (const DataSegment &seg : symbolTable.dataSegments) {
         uint32_t addr = seg.startAddress;
         for (const DataEntry &entry : seg.contents) {
-            // For each byte in this entry...
-            for (uint32_t i = 0; i < entry.size; i++) {
-                uint8_t byte = (entry.value >> (8 * i)) & 0xFF;
-                uint32_t byteAddr = addr + i;
-                uint32_t wordAddr = byteAddr & ~0x3;    // Word-aligned address
-                uint32_t offset   = (byteAddr & 0x3);   // Byte offset in that word
-
-                // Load the existing word from memory if present, else 0.
-                uint32_t word = 0;
-                if (cpu.memory.find(wordAddr) != cpu.memory.end()) {
-                    word = cpu.memory[wordAddr];
-                }
-
-                // Clear the target byte and set it to 'byte'.
-                word = (word & ~(0xFF << (offset * 8))) | ((byte & 0xFF) << (offset * 8));
-                cpu.memory[wordAddr] = word;
+            // Unpack the value into bytes (a .dword is sign-extended from int).
+            uint8_t bytes[8];
+            int64_t value = entry.value;
+            for (uint32_t i = 0; i < entry.size && i < 8; i++) {
+                bytes[i] = static_cast<uint8_t>((value >> (8 * i)) & 0xFF);
             }
+            cpu.memory.load(addr, bytes, entry.size < 8 ? entry.size : 8);
             addr += entry.size;
         }
     }
@@ -110,63 +250,158 @@ void initializeMemoryFromDataSegments(CPU &cpu,  SymbolTable &symbolTable) {
  * We pass in the symbol table so that we can call initializeMemoryFromDataSegments
  * before running the instruction loop, ensuring that data for lw, lb, etc. is present.
  */
-void simulate(std::map<uint32_t, std::string>& instructions, CPU& cpu,  SymbolTable &symbolTable) {
+template <bool Verbose>
+static void runSwitch(Program& program, CPU& cpu, const StackConfig &stack,
+                      uint64_t maxInstructions = UINT64_MAX);
+
+void simulate(Program& program, CPU& cpu,  SymbolTable &symbolTable,
+              const StackConfig &stack, Engine engine, uint32_t jitThreshold, bool verbose) {
     // --- STEP 0: Initialize memory from the data segments. ---
     initializeMemoryFromDataSegments(cpu, symbolTable);
     
     // Optionally, verify with:
     // dumpMemory(cpu, "init_data_dump.mc");
-    cpu.regFile[2] = STACK_BASE;  
+    // The stack needs no pre-zeroing: untouched pages read as 0 and are
+    // only allocated on their first store.
+    cpu.regFile[2] = stack.base;
+
+    runProgram(program, cpu, stack, engine, jitThreshold, verbose);
+}
+
+void runProgram(Program& program, CPU& cpu, const StackConfig &stack, Engine engine,
+                uint32_t jitThreshold, bool verbose) {
+    if (engine == Engine::Switch) {
+        if (verbose) {
+            runSwitch<true>(program, cpu, stack);
+        } else {
+            runSwitch<false>(program, cpu, stack);
+        }
+        return;
+    }
+
+    ExitReason reason;
+    if (engine == Engine::Blocks || engine == Engine::Jit) {
+        BlockStats stats;
+        reason = runBlocks(program, cpu, stack, &stats, engine == Engine::Jit ? jitThreshold : 0);
+        std::cout << "[INFO] Block cache: " << stats.translated << " blocks translated, "
+                  << stats.chained << " chained exits, " << stats.lookups << " lookups, "
+                  << stats.invalidated << " invalidated\n";
+        if (engine == Engine::Jit) {
+            if (stats.jitUnavailable) {
+                std::cout << "[INFO] JIT: not available on this host, all blocks interpreted\n";
+            } else {
+                uint64_t total = cpu.clock;
+                std::cout << "[INFO] JIT: " << stats.jitBlocks << " blocks compiled ("
+                          << stats.jitRejected << " left interpreted), "
+                          << stats.jitCodeBytes << " bytes of code, compile time "
+                          << stats.jitCompileSeconds * 1e3 << " ms, coverage "
+                          << (total ? 100.0 * stats.jitInstructions / total : 0.0)
+                          << "% of instructions in native code\n";
+            }
+        }
+    } else {
+        FusionStats stats;
+        reason = runThreaded(program, cpu, stack, &stats);
+        // Hit rate: share of the retired instructions that ran inside a pair.
+        static const char* const names[FUSED_COUNT] = {"lui+addi", "auipc+jalr", "addi+bne"};
+        std::cout << "[INFO] Fusion:";
+        for (uint32_t i = 0; i < FUSED_COUNT; i++) {
+            std::cout << (i ? ", " : " ") << names[i] << " " << stats.sites[i] << " sites / "
+                      << stats.hits[i] << " hits ("
+                      << (stats.retired ? 200.0 * stats.hits[i] / stats.retired : 0.0) << "%)";
+        }
+        std::cout << "\n";
+    }
 
-    // (Optional) Pre-zero the stack pages if you want:
-    for (uint32_t addr = STACK_END; addr < STACK_BASE; addr += 4) {
-        cpu.memory[addr] = 0;
+    // Report the stop the same way the reference loop does.
+    switch (reason) {
+        case ExitReason::EndOfProgram:
+            std::cout << "[INFO] No instruction at PC = 0x" << std::hex << cpu.PC
+                      << ". Simulation complete." << std::dec << std::endl;
+            break;
+        case ExitReason::Halt:
+            std::cout << "[HALT] HALT instruction encountered. Stopping simulation.\n";
+            dumpMemory(cpu, "data_memory_dump.mc");
+            break;
+        case ExitReason::Illegal:
+            std::cerr << "[ERROR] Unsupported instruction 0x" << std::hex << std::setfill('0')
+                      << std::setw(8) << program.fetch(cpu.PC)->raw
+                      << " at PC = 0x" << cpu.PC << std::dec << "\n";
+            break;
+        case ExitReason::StackOverflow: {
+            const DecodedInstr* inst = program.fetch(cpu.PC);
+            reportStackOverflow(stack, cpu.regFile[inst->rs1] + inst->imm, cpu.PC);
+            break;
+        }
+        case ExitReason::InstructionLimit:
+            std::cout << "[INFO] Instruction limit reached at PC = 0x" << std::hex << cpu.PC
+                      << std::dec << "\n";
+            break;
     }
+}
 
-    while (true) {
-        std::cout << "\n--------------------\n";
-        std::cout << "[CYCLE " << cpu.clock << "]\n";
+// ===== Run an exact number of instructions. =====
+uint64_t advance(Program& program, CPU& cpu, const StackConfig& stack, uint64_t count) {
+    // runThreaded() only stops at a taken branch or jump, so it can overshoot
+    // its budget by one straight-line run, which is never longer than the
+    // text. Leave that much to the reference loop, which stops exactly.
+    uint64_t slack = program.code.size();
+    uint64_t retired = 0;
+    while (retired + slack < count) {
+        uint64_t before = cpu.clock;
+        ExitReason reason = runThreaded(program, cpu, stack, nullptr, count - slack - retired);
+        retired += cpu.clock - before;
+        if (reason != ExitReason::InstructionLimit) return retired;
+    }
+    uint64_t before = cpu.clock;
+    runSwitch<false>(program, cpu, stack, count - retired);
+    return retired + (cpu.clock - before);
+}
+
+/*
+ * ===== Reference engine: decode/execute with a nested switch. =====
+ *
+ * Kept as the behavioural reference for the faster engines in
+ * interpreter.cpp. The verbose instantiation prints every stage of every
+ * cycle; the silent one has the trace compiled out (see trace.h) but still
+ * reports how the run ended.
+ */
+template <bool Verbose>
+static void runSwitch(Program& program, CPU& cpu, const StackConfig &stack,
+                      uint64_t maxInstructions) {
+    Trace<Verbose> trace;
+    for (uint64_t executed = 0; executed < maxInstructions; executed++) {
+        trace << "\n--------------------\n";
+        trace << "[CYCLE " << cpu.clock << "]\n";
         
         // ===== STEP 1: FETCH =====
-        if (instructions.find(cpu.PC) == instructions.end()) {
+        const DecodedInstr* inst = program.fetch(cpu.PC);
+        if (!inst) {
             std::cout << "[INFO] No instruction at PC = 0x" 
                       << std::hex << cpu.PC 
                       << ". Simulation complete." << std::endl;
             break;
         }
-        cpu.IR = std::stoul(instructions[cpu.PC], nullptr, 16);
-        std::cout << "[FETCH] PC = 0x" << std::hex << cpu.PC 
+        cpu.IR = inst->raw;
+        trace << "[FETCH] PC = 0x" << std::hex << cpu.PC 
                   << ", IR = 0x" << std::setfill('0') << std::setw(8) << cpu.IR << "\n";
     
         // ===== STEP 2: DECODE =====
-        uint32_t opcode = cpu.IR & 0x7F;
-        uint32_t rd     = (cpu.IR >> 7) & 0x1F;
-        uint32_t funct3 = (cpu.IR >> 12) & 0x7;
-        uint32_t rs1    = (cpu.IR >> 15) & 0x1F;
-        uint32_t rs2    = (cpu.IR >> 20) & 0x1F;
-        uint32_t funct7 = (cpu.IR >> 25) & 0x7F;
-        int32_t  imm    = 0;
+        // Fields, immediate and handler were extracted once by loadMCFile.
+        uint32_t opcode = inst->opcode;
+        uint32_t rd     = inst->rd;
+        uint32_t funct3 = inst->funct3;
+        uint32_t rs1    = inst->rs1;
+        uint32_t rs2    = inst->rs2;
+        int32_t  imm    = inst->imm;
     
-        std::cout << "[DECODE] opcode = 0x" << std::hex << opcode 
+        trace << "[DECODE] opcode = 0x" << std::hex << opcode 
                   << ", rd = x" << std::dec << rd 
                   << ", rs1 = x" << rs1;
         if (opcode == 0x23 || opcode == 0x63 || opcode == 0x33) {
-            std::cout << ", rs2 = x" << rs2;
-        }
-        std::cout << "\n";
-    
-        // Identify the immediate if used.
-        if (opcode == 0x13 || opcode == 0x03 || opcode == 0x67) {  // I-type
-            imm = getITypeImm(cpu.IR);
-        } else if (opcode == 0x23) {                              // S-type
-            imm = getSTypeImm(cpu.IR);
-        } else if (opcode == 0x63) {                              // B-type
-            imm = getBTypeImm(cpu.IR);
-        } else if (opcode == 0x37 || opcode == 0x17) {            // U-type
-            imm = getUTypeImm(cpu.IR);
-        } else if (opcode == 0x6F) {                              // J-type
-            imm = getJTypeImm(cpu.IR);
+            trace << ", rs2 = x" << rs2;
         }
+        trace << "\n";
     
         // ===== STEP 3: EXECUTE =====
         int32_t aluResult = 0;
@@ -174,241 +409,230 @@ void simulate(std::map<uint32_t, std::string>& instructions, CPU& cpu,  SymbolTa
         uint32_t newPC    = cpu.PC + 4; // Next instruction by default
         bool writeback    = true;       // By default, result goes to register rd
     
-        switch (opcode) {
+        // The handler index comes from the ISA table (isa.h).
+        const int32_t a = cpu.regFile[rs1];
+        const int32_t b = cpu.regFile[rs2];
+        const uint32_t shamt = (cpu.IR >> 20) & 0x1F;
+        switch (inst->op) {
             // -- R-Type (0x33) --
-            case 0x33:
-                if (funct7 == 0x00) {
-                    // ADD, SLL, SLT, SLTU, XOR, SRL, OR, AND
-                    if (funct3 == 0x0) { // ADD
-                        aluResult = cpu.regFile[rs1] + cpu.regFile[rs2];
-                        std::cout << "[EXECUTE] add x" << rd << " = x" << rs1 << " + x" << rs2 << "\n";
-                    } else if (funct3 == 0x1) { // SLL
-                        aluResult = cpu.regFile[rs1] << (cpu.regFile[rs2] & 0x1F);
-                        std::cout << "[EXECUTE] sll x" << rd << "\n";
-                    } else if (funct3 == 0x2) { // SLT
-                        aluResult = (cpu.regFile[rs1] < cpu.regFile[rs2]) ? 1 : 0;
-                        std::cout << "[EXECUTE] slt x" << rd << "\n";
-                    } else if (funct3 == 0x3) { // SLTU
-                        aluResult = ((uint32_t)cpu.regFile[rs1] < (uint32_t)cpu.regFile[rs2]) ? 1 : 0;
-                        std::cout << "[EXECUTE] sltu x" << rd << "\n";
-                    } else if (funct3 == 0x4) { // XOR
-                        aluResult = cpu.regFile[rs1] ^ cpu.regFile[rs2];
-                        std::cout << "[EXECUTE] xor x" << rd << "\n";
-                    } else if (funct3 == 0x5) {
-                        if (funct7 == 0x00) { // SRL
-                            aluResult = (uint32_t)cpu.regFile[rs1] >> (cpu.regFile[rs2] & 0x1F);
-                            std::cout << "[EXECUTE] srl x" << rd << "\n";
-                        } else if (funct7 == 0x20) { // SRA
-                            aluResult = cpu.regFile[rs1] >> (cpu.regFile[rs2] & 0x1F);
-                            std::cout << "[EXECUTE] sra x" << rd << "\n";
-                        }
-                    } else if (funct3 == 0x6) { // OR
-                        aluResult = cpu.regFile[rs1] | cpu.regFile[rs2];
-                        std::cout << "[EXECUTE] or x" << rd << "\n";
-                    } else if (funct3 == 0x7) { // AND
-                        aluResult = cpu.regFile[rs1] & cpu.regFile[rs2];
-                        std::cout << "[EXECUTE] and x" << rd << "\n";
-                    }
-                } else if (funct7 == 0x20 && funct3 == 0x0) { // SUB
-                    aluResult = cpu.regFile[rs1] - cpu.regFile[rs2];
-                    std::cout << "[EXECUTE] sub x" << rd << "\n";
-                } else if (funct7 == 0x01) {
-                    // M-extension: MUL, DIV, REM
-                    if (funct3 == 0x0) { // MUL
-                        aluResult = cpu.regFile[rs1] * cpu.regFile[rs2];
-                        std::cout << "[EXECUTE] mul x" << rd << "\n";
-                    } else if (funct3 == 0x4) { // DIV
-                        if (cpu.regFile[rs2] == 0) {
-                            aluResult = -1; // division by zero => -1
-                            std::cout << "[EXECUTE] div x" << rd << " (div by zero)\n";
-                        } else {
-                            aluResult = cpu.regFile[rs1] / cpu.regFile[rs2];
-                            std::cout << "[EXECUTE] div x" << rd << "\n";
-                        }
-                    } else if (funct3 == 0x6) { // REM
-                        if (cpu.regFile[rs2] == 0) {
-                            aluResult = cpu.regFile[rs1]; // remainder by zero => dividend
-                            std::cout << "[EXECUTE] rem x" << rd << " (div by zero)\n";
-                        } else {
-                            aluResult = cpu.regFile[rs1] % cpu.regFile[rs2];
-                            std::cout << "[EXECUTE] rem x" << rd << "\n";
-                        }
-                    }
-                }
+            case OP_ADD:
+                aluResult = a + b;
+                trace << "[EXECUTE] add x" << rd << " = x" << rs1 << " + x" << rs2 << "\n";
+                break;
+            case OP_SUB:
+                aluResult = a - b;
+                trace << "[EXECUTE] sub x" << rd << "\n";
+                break;
+            case OP_SLL:
+                aluResult = a << (b & 0x1F);
+                trace << "[EXECUTE] sll x" << rd << "\n";
+                break;
+            case OP_SLT:
+                aluResult = (a < b) ? 1 : 0;
+                trace << "[EXECUTE] slt x" << rd << "\n";
+                break;
+            case OP_SLTU:
+                aluResult = ((uint32_t)a < (uint32_t)b) ? 1 : 0;
+                trace << "[EXECUTE] sltu x" << rd << "\n";
+                break;
+            case OP_XOR:
+                aluResult = a ^ b;
+                trace << "[EXECUTE] xor x" << rd << "\n";
+                break;
+            case OP_SRL:
+                aluResult = (uint32_t)a >> (b & 0x1F);
+                trace << "[EXECUTE] srl x" << rd << "\n";
+                break;
+            case OP_SRA:
+                aluResult = a >> (b & 0x1F);
+                trace << "[EXECUTE] sra x" << rd << "\n";
+                break;
+            case OP_OR:
+                aluResult = a | b;
+                trace << "[EXECUTE] or x" << rd << "\n";
+                break;
+            case OP_AND:
+                aluResult = a & b;
+                trace << "[EXECUTE] and x" << rd << "\n";
+                break;
+            // M-extension: MUL, DIV, REM
+            case OP_MUL:
+                aluResult = a * b;
+                trace << "[EXECUTE] mul x" << rd << "\n";
                 break;
-            
+            case OP_DIV:
+                aluResult = signedDiv(a, b);
+                trace << "[EXECUTE] div x" << rd << (b == 0 ? " (div by zero)\n" : "\n");
+                break;
+            case OP_REM:
+                aluResult = signedRem(a, b);
+                trace << "[EXECUTE] rem x" << rd << (b == 0 ? " (div by zero)\n" : "\n");
+                break;
+
             // -- I-Type Arithmetic (0x13) --
-            case 0x13:
-                if (funct3 == 0x0) { // ADDI
-                    aluResult = cpu.regFile[rs1] + imm;
-                    std::cout << "[EXECUTE] addi x" << rd << "\n";
-                } else if (funct3 == 0x2) { // SLTI
-                    aluResult = (cpu.regFile[rs1] < imm) ? 1 : 0;
-                    std::cout << "[EXECUTE] slti x" << rd << "\n";
-                } else if (funct3 == 0x3) { // SLTIU
-                    aluResult = ((uint32_t)cpu.regFile[rs1] < (uint32_t)imm) ? 1 : 0;
-                    std::cout << "[EXECUTE] sltiu x" << rd << "\n";
-                } else if (funct3 == 0x4) { // XORI
-                    aluResult = cpu.regFile[rs1] ^ imm;
-                    std::cout << "[EXECUTE] xori x" << rd << "\n";
-                } else if (funct3 == 0x6) { // ORI
-                    aluResult = cpu.regFile[rs1] | imm;
-                    std::cout << "[EXECUTE] ori x" << rd << "\n";
-                } else if (funct3 == 0x7) { // ANDI
-                    aluResult = cpu.regFile[rs1] & imm;
-                    std::cout << "[EXECUTE] andi x" << rd << "\n";
-                } else if (funct3 == 0x1) { // SLLI
-                    uint32_t shamt = cpu.IR >> 20; // lower 5 bits
-                    aluResult = cpu.regFile[rs1] << (shamt & 0x1F);
-                    std::cout << "[EXECUTE] slli x" << rd << "\n";
-                } else if (funct3 == 0x5) { // SRLI/SRAI
-                    uint32_t shamt = cpu.IR >> 20;
-                    if (funct7 == 0x00) { // SRLI
-                        aluResult = (uint32_t)cpu.regFile[rs1] >> (shamt & 0x1F);
-                        std::cout << "[EXECUTE] srli x" << rd << "\n";
-                    } else if (funct7 == 0x20) { // SRAI
-                        aluResult = cpu.regFile[rs1] >> (shamt & 0x1F);
-                        std::cout << "[EXECUTE] srai x" << rd << "\n";
-                    }
-                }
+            case OP_ADDI:
+                aluResult = a + imm;
+                trace << "[EXECUTE] addi x" << rd << "\n";
+                break;
+            case OP_SLTI:
+                aluResult = (a < imm) ? 1 : 0;
+                trace << "[EXECUTE] slti x" << rd << "\n";
+                break;
+            case OP_SLTIU:
+                aluResult = ((uint32_t)a < (uint32_t)imm) ? 1 : 0;
+                trace << "[EXECUTE] sltiu x" << rd << "\n";
+                break;
+            case OP_XORI:
+                aluResult = a ^ imm;
+                trace << "[EXECUTE] xori x" << rd << "\n";
                 break;
-            
+            case OP_ORI:
+                aluResult = a | imm;
+                trace << "[EXECUTE] ori x" << rd << "\n";
+                break;
+            case OP_ANDI:
+                aluResult = a & imm;
+                trace << "[EXECUTE] andi x" << rd << "\n";
+                break;
+            case OP_SLLI:
+                aluResult = a << shamt;
+                trace << "[EXECUTE] slli x" << rd << "\n";
+                break;
+            case OP_SRLI:
+                aluResult = (uint32_t)a >> shamt;
+                trace << "[EXECUTE] srli x" << rd << "\n";
+                break;
+            case OP_SRAI:
+                aluResult = a >> shamt;
+                trace << "[EXECUTE] srai x" << rd << "\n";
+                break;
+
             // -- I-Type Load (0x03) --
-            case 0x03: {
-                uint32_t addr = cpu.regFile[rs1] + imm;
-                std::cout << "[EXECUTE] Load from address 0x" << std::hex << addr << "\n";
+            case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: {
+                uint32_t addr = a + imm;
+                trace << "[EXECUTE] Load from address 0x" << std::hex << addr << "\n";
                 aluResult = addr;
                 break;
             }
-            
+
             // -- S-Type Store (0x23) --
-            case 0x23: {
-                uint32_t addr = cpu.regFile[rs1] + imm;
+            case OP_SB: case OP_SH: case OP_SW: {
+                uint32_t addr = a + imm;
                 aluResult = addr;
-                std::cout << "[EXECUTE] Store to address 0x" << std::hex << addr << "\n";
+                trace << "[EXECUTE] Store to address 0x" << std::hex << addr << "\n";
                 writeback = false;
                 break;
             }
-            
+
             // -- B-Type Branch (0x63) --
-            case 0x63:
-                if (funct3 == 0x0) { // BEQ
-                    branchTaken = (cpu.regFile[rs1] == cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] beq: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
-                } else if (funct3 == 0x1) { // BNE
-                    branchTaken = (cpu.regFile[rs1] != cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] bne: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
-                } else if (funct3 == 0x4) { // BLT
-                    branchTaken = (cpu.regFile[rs1] < cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] blt: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
-                } else if (funct3 == 0x5) { // BGE
-                    branchTaken = (cpu.regFile[rs1] >= cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] bge: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
-                } else if (funct3 == 0x6) { // BLTU
-                    branchTaken = ((uint32_t)cpu.regFile[rs1] < (uint32_t)cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] bltu: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
-                } else if (funct3 == 0x7) { // BGEU
-                    branchTaken = ((uint32_t)cpu.regFile[rs1] >= (uint32_t)cpu.regFile[rs2]);
-                    std::cout << "[EXECUTE] bgeu: Branch " << (branchTaken ? "taken" : "not taken") << "\n";
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU: {
+                const char* name = "";
+                switch (inst->op) {
+                    case OP_BEQ:  branchTaken = (a == b);                      name = "beq";  break;
+                    case OP_BNE:  branchTaken = (a != b);                      name = "bne";  break;
+                    case OP_BLT:  branchTaken = (a < b);                       name = "blt";  break;
+                    case OP_BGE:  branchTaken = (a >= b);                      name = "bge";  break;
+                    case OP_BLTU: branchTaken = ((uint32_t)a < (uint32_t)b);   name = "bltu"; break;
+                    default:      branchTaken = ((uint32_t)a >= (uint32_t)b);  name = "bgeu"; break;
                 }
+                trace << "[EXECUTE] " << name << ": Branch " << (branchTaken ? "taken" : "not taken") << "\n";
                 if (branchTaken) {
                     newPC = cpu.PC + imm;
                 }
                 writeback = false;
                 break;
-            
+            }
+
             // -- U-Type Instructions (LUI, AUIPC) --
-            case 0x37: // LUI
+            case OP_LUI:
                 aluResult = imm;
-                std::cout << "[EXECUTE] lui x" << rd << "\n";
+                trace << "[EXECUTE] lui x" << rd << "\n";
                 break;
-            case 0x17: // AUIPC
+            case OP_AUIPC:
                 aluResult = cpu.PC + imm;
-                std::cout << "[EXECUTE] auipc x" << rd << "\n";
+                trace << "[EXECUTE] auipc x" << rd << "\n";
                 break;
-            
+
             // -- J-Type (JAL) --
-            case 0x6F: {
+            case OP_JAL: {
                 aluResult = cpu.PC + 4;  // Return address
                 newPC = cpu.PC + imm;
-                std::cout << "[EXECUTE] jal: Jumping to 0x" << std::hex << newPC << "\n";
+                trace << "[EXECUTE] jal: Jumping to 0x" << std::hex << newPC << "\n";
                 break;
             }
-            
+
             // -- I-Type JALR (0x67) --
-            case 0x67: {
+            case OP_JALR: {
                 aluResult = cpu.PC + 4;  // Return address
-                newPC = (cpu.regFile[rs1] + imm) & ~1; // Clear LSB
-                std::cout << "[EXECUTE] jalr: Jumping to 0x" << std::hex << newPC << "\n";
+                newPC = (a + imm) & ~1; // Clear LSB
+                trace << "[EXECUTE] jalr: Jumping to 0x" << std::hex << newPC << "\n";
                 break;
             }
-            
+
             // -- Custom HALT (0x7F) --
-            case 0x7F:
+            case OP_HALT:
                 std::cout << "[HALT] HALT instruction encountered. Stopping simulation.\n";
                 dumpMemory(cpu, "data_memory_dump.mc");
                 return;
-            
+
             default:
                 std::cerr << "[ERROR] Unsupported opcode: 0x" << std::hex << opcode << "\n";
                 return;
         }
-    
+
         // ===== STEP 4: MEMORY ACCESS =====
+        if ((opcode == 0x03 || opcode == 0x23) && inStackGuard(stack, aluResult)) {
+            reportStackOverflow(stack, aluResult, cpu.PC);
+            return;
+        }
         if (opcode == 0x03) { // Load instructions
             uint32_t addr = aluResult;
             if (funct3 == 0x0) { // LB
-                uint32_t word = cpu.memory[addr & ~0x3];
-                uint8_t byte = (word >> ((addr & 0x3) * 8)) & 0xFF;
+                uint8_t byte = cpu.memory.read8(addr);
                 aluResult = signExtend(byte, 8);
-                std::cout << "[MEMORY] lb: Loaded byte 0x" << std::hex << (int)byte << "\n";
+                trace << "[MEMORY] lb: Loaded byte 0x" << std::hex << (int)byte << "\n";
             } else if (funct3 == 0x1) { // LH
-                uint32_t word = cpu.memory[addr & ~0x3];
-                uint16_t half = (word >> ((addr & 0x2) * 8)) & 0xFFFF;
+                uint16_t half = cpu.memory.read16(addr);
                 aluResult = signExtend(half, 16);
-                std::cout << "[MEMORY] lh: Loaded half 0x" << std::hex << half << "\n";
+                trace << "[MEMORY] lh: Loaded half 0x" << std::hex << half << "\n";
             } else if (funct3 == 0x2) { // LW
-                aluResult = cpu.memory[addr];
-                std::cout << "[MEMORY] lw: Loaded word 0x" << std::hex << aluResult << "\n";
+                aluResult = cpu.memory.read32(addr);
+                trace << "[MEMORY] lw: Loaded word 0x" << std::hex << aluResult << "\n";
             } else if (funct3 == 0x4) { // LBU
-                uint32_t word = cpu.memory[addr & ~0x3];
-                uint8_t byte = (word >> ((addr & 0x3) * 8)) & 0xFF;
+                uint8_t byte = cpu.memory.read8(addr);
                 aluResult = byte; // zero-extended
-                std::cout << "[MEMORY] lbu: Loaded byte 0x" << std::hex << (int)byte << "\n";
+                trace << "[MEMORY] lbu: Loaded byte 0x" << std::hex << (int)byte << "\n";
             } else if (funct3 == 0x5) { // LHU
-                uint32_t word = cpu.memory[addr & ~0x3];
-                uint16_t half = (word >> ((addr & 0x2) * 8)) & 0xFFFF;
+                uint16_t half = cpu.memory.read16(addr);
                 aluResult = half; // zero-extended
-                std::cout << "[MEMORY] lhu: Loaded half 0x" << std::hex << half << "\n";
+                trace << "[MEMORY] lhu: Loaded half 0x" << std::hex << half << "\n";
             }
         }
         if (opcode == 0x23) { // Store instructions
             uint32_t addr = aluResult;
             uint32_t data = cpu.regFile[rs2];
             if (funct3 == 0x0) { // SB
-                uint32_t word = cpu.memory[addr & ~0x3];
-                int shift = (addr & 0x3) * 8;
-                word = (word & ~(0xFF << shift)) | ((data & 0xFF) << shift);
-                cpu.memory[addr & ~0x3] = word;
-                std::cout << "[MEMORY] sb: Stored byte 0x" << std::hex << (data & 0xFF)
+                cpu.memory.write8(addr, data & 0xFF);
+                trace << "[MEMORY] sb: Stored byte 0x" << std::hex << (data & 0xFF)
                           << " at 0x" << addr << "\n";
             } else if (funct3 == 0x1) { // SH
-                uint32_t word = cpu.memory[addr & ~0x3];
-                int shift = (addr & 0x2) * 8;
-                word = (word & ~(0xFFFF << shift)) | ((data & 0xFFFF) << shift);
-                cpu.memory[addr & ~0x3] = word;
-                std::cout << "[MEMORY] sh: Stored half 0x" << std::hex << (data & 0xFFFF)
+                cpu.memory.write16(addr, data & 0xFFFF);
+                trace << "[MEMORY] sh: Stored half 0x" << std::hex << (data & 0xFFFF)
                           << " at 0x" << addr << "\n";
             } else if (funct3 == 0x2) { // SW
-                cpu.memory[addr] = data;
-                std::cout << "[MEMORY] sw: Stored word 0x" << std::hex << data
+                cpu.memory.write32(addr, data);
+                trace << "[MEMORY] sw: Stored word 0x" << std::hex << data
                           << " at 0x" << addr << "\n";
             }
+            if (funct3 <= 0x2 && program.mayTouchText(addr) &&
+                program.storeText(addr, data, 1u << funct3)) {
+                trace << "[MEMORY] Store modified program text at 0x" << addr << "\n";
+            }
         }
     
         // ===== STEP 5: WRITEBACK =====
         if (writeback && rd != 0) {
-            std::cout << "[WRITEBACK] Writing 0x" << std::hex << aluResult
+            trace << "[WRITEBACK] Writing 0x" << std::hex << aluResult
                       << " to x" << std::dec << rd << "\n";
             cpu.regFile[rd] = aluResult;
         }
@@ -416,7 +640,7 @@ void simulate(std::map<uint32_t, std::string>& instructions, CPU& cpu,  SymbolTa
         cpu.PC = newPC;
         cpu.clock++;
     
-        std::cout << "[STATE] PC = 0x" << std::hex << cpu.PC
+        trace << "[STATE] PC = 0x" << std::hex << cpu.PC
                   << ", Clock = " << std::dec << cpu.clock << "\n";
     }
 }
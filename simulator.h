@@ -1,15 +1,143 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 #include "cpu.h"
+#include "isa.h"
 #include "symbol_table.h"
-// Loads the machine code (.mc file) into a map: address -> instruction string.
-std::map<uint32_t, std::string> loadMCFile(const std::string& filename);
+
+// Superinstructions for common two-instruction idioms. The first instruction
+// of a fused pair carries one of these as its 'exec' index; the threaded
+// engine then runs both instructions in one handler. The second instruction
+// keeps its own entry, so a jump straight to it still executes it alone.
+enum Fused : uint8_t {
+    FUSED_LUI_ADDI = OP_COUNT,      // lui rd, hi ; addi rd, rd, lo       (32-bit constant)
+    FUSED_AUIPC_JALR,               // auipc rt, hi ; jalr rd, lo(rt)     (far call)
+    FUSED_ADDI_BNE,                 // addi rd, rd, k ; bne rd/rs, ...    (loop counter)
+    FUSED_END
+};
+constexpr uint32_t FUSED_COUNT = FUSED_END - OP_COUNT;
+
+// One instruction, decoded once at load time.
+struct DecodedInstr {
+    uint32_t raw = 0;      // instruction word
+    uint8_t  opcode = 0;
+    uint8_t  rd = 0;
+    uint8_t  rs1 = 0;
+    uint8_t  rs2 = 0;
+    uint8_t  funct3 = 0;
+    uint8_t  funct7 = 0;
+    uint8_t  op = OP_ILLEGAL;   // handler index (Op)
+    uint8_t  exec = OP_ILLEGAL; // threaded-engine handler: op, or a Fused pair starting here
+    bool     valid = false;     // false => no instruction at this address
+    int32_t  imm = 0;           // immediate, already extracted and sign-extended
+};
+
+// Program text as a contiguous array of predecoded instructions.
+// The instruction at address PC lives at code[(PC - base) >> 2].
+struct Program {
+    uint32_t base = 0;
+    std::vector<DecodedInstr> code;
+
+    // Returns the instruction at pc, or nullptr if there is none.
+    const DecodedInstr* fetch(uint32_t pc) const {
+        uint32_t index = (pc - base) >> 2;
+        if ((pc & 0x3) || index >= code.size() || !code[index].valid) {
+            return nullptr;
+        }
+        return &code[index];
+    }
+
+    // Bytes of program text (the trailing sentinel entry is not text).
+    uint32_t textSize() const {
+        return code.empty() ? 0 : static_cast<uint32_t>(code.size() - 1) * 4;
+    }
+
+    // Cheap filter for the store handlers: false means a 'size'-byte store
+    // at addr cannot touch the program text.
+    bool mayTouchText(uint32_t addr) const {
+        return addr + 3 - base < textSize() + 3;
+    }
+
+    // Applies a 'size'-byte store at addr to the text and re-decodes the
+    // instructions it overlaps, so that stores into the program are seen by
+    // instruction fetch. Returns false if no text byte was written.
+    bool storeText(uint32_t addr, uint32_t value, uint32_t size);
+
+    // Recomputes 'exec' for code[lo..hi]: an entry that starts one of the
+    // Fused idioms together with its successor gets the fused index, any
+    // other entry its own op. loadMCFile() and storeText() keep it current.
+    void fuse(uint32_t lo, uint32_t hi);
+};
+
+// Decodes one instruction word (fields, immediate and handler index).
+DecodedInstr decodeInstruction(uint32_t instr);
+// Stack layout used by simulate(). The stack grows down from 'base'; the
+// addresses [base - limit, base) are usable stack. Any load or store that
+// falls in the 'guard' bytes just below the limit is reported as a stack
+// overflow and stops the simulation. Stack pages are demand-zero: they read
+// as 0 and are only allocated when first written.
+struct StackConfig {
+    uint32_t base  = 0x8000'0000;  // initial SP (top of stack)
+    uint32_t limit = 1 << 20;      // 1 MiB of usable stack
+    uint32_t guard = 64 << 10;     // 64 KiB guard region below the limit
+};
+
+// Execution engine used by simulate().
+enum class Engine {
+    Switch,     // reference: nested switch, prints every stage of every cycle
+    Threaded,   // threaded-code interpreter over the predecoded program (silent)
+    Blocks,     // basic-block translation cache with chained blocks (silent)
+    Jit,        // Blocks, plus x86-64 code for hot blocks (silent)
+};
+
+// Why an execution engine stopped.
+enum class ExitReason {
+    EndOfProgram,   // no instruction at PC
+    Halt,           // custom HALT instruction (opcode 0x7F)
+    Illegal,        // unsupported instruction
+    StackOverflow,  // load/store into the stack guard region
+    InstructionLimit, // instruction budget used up (batch runs)
+};
+
+// Loads the text segment of a machine code (.mc) file and predecodes it.
+// Lines at or above 0x10000000 (the data segment) are not part of the program.
+Program loadMCFile(const std::string& filename);
+// Writes the data-segment lines (addresses >= 0x10000000) of a .mc file, or
+// of a data.mc-style dump, into 'memory' as 32-bit words. Returns false if
+// the file cannot be opened.
+bool loadMCData(const std::string& filename, GuestMemory& memory);
+// Predecodes instruction words (address -> word) into a Program, as
+// loadMCFile() does for the text lines of a file.
+Program buildProgram(const std::map<uint32_t, uint32_t>& words);
+
+// Saves the program text, PC, registers and memory as a binary checkpoint
+// (checkpoint.h); 'instructions' is the retired count recorded with it.
+bool saveCPUCheckpoint(const std::string& filename, const Program& program, const CPU& cpu,
+                       uint64_t instructions);
+// Replaces program, PC, registers and memory with a checkpoint and resets
+// cpu.clock; 'instructions' receives the retired count it was taken at.
+bool loadCPUCheckpoint(const std::string& filename, Program& program, CPU& cpu,
+                       uint64_t& instructions);
 
 // Main simulation loop that processes instructions step-by-step.
-void simulate(std::map<uint32_t, std::string>& instructions, CPU& cpu,  SymbolTable &symbolTable);
+// Stores into the program text update 'program' in place. 'verbose' picks
+// the traced or the silent instantiation of the switch engine (the other
+// engines never trace).
+void simulate(Program& program, CPU& cpu,  SymbolTable &symbolTable,
+              const StackConfig &stack = StackConfig(), Engine engine = Engine::Switch,
+              uint32_t jitThreshold = 50, bool verbose = true);
+// The run part of simulate(): executes from cpu.PC on the current registers
+// and memory without initializing anything (e.g. after loadCPUCheckpoint()).
+void runProgram(Program& program, CPU& cpu, const StackConfig &stack, Engine engine,
+                uint32_t jitThreshold = 50, bool verbose = true);
+// Runs exactly 'count' instructions from cpu.PC, or fewer if the program
+// stops first, silently; returns the number retired. Used to stop at a
+// given instruction count (checkpoints).
+uint64_t advance(Program& program, CPU& cpu, const StackConfig& stack, uint64_t count);
 
 
 // Dumps the data memory into an output file before halting.
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+
+// Compile-time trace level for the simulation loops.
+//
+// A loop that prints per-instruction or per-cycle output is written once as
+// a template on 'bool Verbose' and instantiated twice. Trace<true> forwards
+// to std::cout; in Trace<false> every operator<< is an empty inline
+// function, so the silent instantiation contains no formatting code at all.
+// The command line picks the instantiation at startup.
+template <bool Verbose>
+struct Trace {
+    template <typename T>
+    Trace& operator<<(const T& value) {
+        if constexpr (Verbose) std::cout << value;
+        return *this;
+    }
+    // Manipulators such as std::endl, std::hex and std::dec.
+    Trace& operator<<(std::ostream& (*manip)(std::ostream&)) {
+        if constexpr (Verbose) std::cout << manip;
+        return *this;
+    }
+    Trace& operator<<(std::ios_base& (*manip)(std::ios_base&)) {
+        if constexpr (Verbose) std::cout << manip;
+        return *this;
+    }
+};
+
+#endif